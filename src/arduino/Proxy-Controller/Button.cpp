@@ -0,0 +1,143 @@
+/*
+  Button.cpp - Debounced button of an axis, see Button.h
+*/
+
+#include "Arduino.h"
+#include "Button.h"
+#include "Proxy.h"
+
+Button *Button::_interruptButtons[BUTTON_INTERRUPTS];
+
+//attachInterrupt() calls back without a context, so every interrupt has its own function
+template <uint8_t INT> void Button::_onInterrupt(){
+  Button *button = _interruptButtons[INT];
+  button->onEdge(digitalRead(button->_pin), micros());
+}
+
+Button::Button(){
+  _pin = 0;
+  _axis = NULL;
+  _state = LOW;
+  _level = LOW;
+  _edgeTime = 0;
+  _edges = 0;
+  _edgeSteps = 0;
+  _latchPending = false;
+  _acceptedTime = 0;
+  _ignoreRelease = false;
+  _head = 0;
+  _count = 0;
+}
+
+/* pin <= 0: no button. axis: whose step position is latched with every event */
+void Button::begin(int pin, Proxy *axis){
+  _pin = pin;
+  _axis = axis;
+  if(_pin <= 0){
+    return;
+  }
+  pinMode(_pin, INPUT);
+  _state = _level = digitalRead(_pin);
+  int interrupt = digitalPinToInterrupt(_pin);
+  if(interrupt != NOT_AN_INTERRUPT && interrupt < BUTTON_INTERRUPTS){
+    _interruptButtons[interrupt] = this;
+    attachInterrupt(interrupt, interrupt == 0 ? _onInterrupt<0> : _onInterrupt<1>, CHANGE);
+  }
+}
+
+/* the debounced level, -1 without a button */
+int Button::getState(){
+  return _pin > 0 ? _state : -1;
+}
+
+/* samples the pin and reports the level the contact has settled on, every run of the button task. The pin is read
+   with interrupts on (the serial receive interrupt must not wait for it); an edge the interrupt took meanwhile is
+   newer than the sample, which is dropped then. */
+void Button::update(){
+  if(_pin <= 0){
+    return;
+  }
+  uint8_t edges = _edges;
+  unsigned long now = micros();
+  uint8_t level = digitalRead(_pin);
+  noInterrupts();
+  if(_edges != edges){
+    interrupts();
+    return;
+  }
+  if(level != _level){            //without an interrupt, or an edge the interrupt came too late for
+    onEdge(level, now);
+  }
+  if(_level != _state && now - _edgeTime >= BUTTON_DEBOUNCE_TIME){
+    accept(_level, _edgeTime, _edgeSteps);   //bounced into the other state
+  }
+  interrupts();
+}
+
+/* takes the oldest event off the queue, false if there is none */
+bool Button::next(ButtonEvent &event){
+  noInterrupts();
+  bool found = false;
+  while(!found && _count > 0){
+    event = _queue[_head];
+    _head = (_head + 1) % BUTTON_QUEUE_SIZE;
+    _count--;
+    found = !(_ignoreRelease && event.type == BUTTON_EVENT_DOWN);
+    if(!found){
+      _ignoreRelease = false;
+    }
+  }
+  interrupts();
+  return found;
+}
+
+bool Button::pending(){
+  return _count > 0;
+}
+
+/* the release of the press that is going on is not reported (e.g. the one that ended a calibration phase) */
+void Button::ignoreRelease(){
+  _ignoreRelease = _state == HIGH;
+}
+
+/* the step timer ISR, after counting a step: the position of an edge that came meanwhile */
+void Button::latch(long steps){
+  if(!_latchPending){
+    return;
+  }
+  _latchPending = false;
+  _edgeSteps = steps;
+  if(_count > 0){
+    ButtonEvent &last = _queue[(_head + _count - 1) % BUTTON_QUEUE_SIZE];
+    if(last.time == _edgeTime){
+      last.steps = steps;
+    }
+  }
+}
+
+/* an edge, from the interrupt or with interrupts off. The first one to change the state counts, the bounces
+   within BUTTON_DEBOUNCE_TIME after it only move the level update() checks. */
+void Button::onEdge(uint8_t level, unsigned long now){
+  _level = level;
+  _edgeTime = now;
+  _edges++;
+  long steps = 0;
+  _latchPending = _axis != NULL && !_axis->latchSteps(steps);
+  _edgeSteps = steps;
+  if(level != _state && now - _acceptedTime >= BUTTON_DEBOUNCE_TIME){
+    accept(level, now, steps);
+  }
+}
+
+void Button::accept(uint8_t level, unsigned long time, long steps){
+  _state = level;
+  _acceptedTime = time;
+  if(_count == BUTTON_QUEUE_SIZE){
+    return;
+  }
+  ButtonEvent &event = _queue[(_head + _count) % BUTTON_QUEUE_SIZE];
+  event.type = level == LOW ? BUTTON_EVENT_DOWN : BUTTON_EVENT_UP;
+  event.time = time;
+  event.steps = steps;
+  _count++;
+}
@@ -1,13 +1,68 @@
 /*
   Button.h - Definition of the Button Events
   Created by André Zenner, May 31, 2016.
+
+  Button reads the button of an axis without blocking the loop. On a pin with an external interrupt (INT0/INT1),
+  every edge is caught by the interrupt as it happens, with its time and the step position of the axis at that
+  moment; other pins are sampled by update(). The first edge that changes the state counts (so presses much
+  shorter than a loop() pass are seen), the contact bounces after it are ignored for BUTTON_DEBOUNCE_TIME, and
+  update() reports the level the contact has settled on if it differs once that time has passed.
+  The events wait in a small queue for the loop. Pin change interrupts are not used: SoftwareSerial, which talks
+  to the WiFi module on the UNO, takes all their vectors.
 */
 
 #ifndef Button_h
 #define Button_h
 
+#include "Arduino.h"
+
 #define BUTTON_EVENT_NONE 0
 #define BUTTON_EVENT_DOWN 1
 #define BUTTON_EVENT_UP 2
 
+#define BUTTON_DEBOUNCE_TIME 5000       //us of contact bounce after an edge
+#define BUTTON_QUEUE_SIZE 4             //events the loop has not taken yet, more are dropped
+#define BUTTON_INTERRUPTS 2             //INT0, INT1
+
+struct ButtonEvent {
+  uint8_t type;                         //BUTTON_EVENT_DOWN (the pin went LOW) or BUTTON_EVENT_UP (HIGH)
+  unsigned long time;                   //micros() at the edge
+  long steps;                           //position of the axis at the edge
+};
+
+class Proxy;
+
+class Button
+{
+  public:
+    Button();
+    void begin(int pin, Proxy *axis);
+    int getState();
+    void update();
+    bool next(ButtonEvent &event);
+    bool pending();
+    void ignoreRelease();
+    void latch(long steps);
+
+  private:
+    int _pin;
+    Proxy *_axis;
+    volatile uint8_t _state;            //debounced level
+    volatile uint8_t _level;            //level after the last edge seen
+    volatile unsigned long _edgeTime;   //micros() of that edge
+    volatile uint8_t _edges;            //counts them, for update() to tell whether one came while it read the pin
+    volatile long _edgeSteps;
+    volatile bool _latchPending;        //the edge came while the step ISR was counting, see latch()
+    volatile unsigned long _acceptedTime;
+    bool _ignoreRelease;
+    ButtonEvent _queue[BUTTON_QUEUE_SIZE];
+    volatile uint8_t _head, _count;
+
+    void onEdge(uint8_t level, unsigned long now);
+    void accept(uint8_t level, unsigned long time, long steps);
+
+    static Button *_interruptButtons[BUTTON_INTERRUPTS];
+    template <uint8_t INT> static void _onInterrupt();
+};
+
 #endif
@@ -0,0 +1,59 @@
+/*
+  CalibrationStore.cpp - Keeps the calibration and settings of every axis in EEPROM across resets.
+*/
+
+#include "Arduino.h"
+#include "CalibrationStore.h"
+#include <EEPROM.h>
+
+/* false if there is no record for the axis, it is damaged, of an older layout or was left while moving */
+bool CalibrationStore::load(uint8_t id, CalibrationData &data) {
+  EEPROM.get(address(id), data);
+  return data.version == CALIBRATION_STORE_VERSION && data.checksum == checksum(data) && !data.moving;
+}
+
+/* sets version and checksum of data and writes the next byte that differs from the record, if the EEPROM is ready.
+   true once the record is data, call again until then. */
+bool CalibrationStore::save(uint8_t id, CalibrationData &data) {
+  if (!eeprom_is_ready()) {
+    return false;
+  }
+  data.version = CALIBRATION_STORE_VERSION;
+  data.moving = 0;
+  data.checksum = checksum(data);
+  int record = address(id);
+  int moving = record + offsetof(CalibrationData, moving);
+  const uint8_t *bytes = (const uint8_t *)&data;
+  for (size_t i = 0; i < sizeof(CalibrationData); i++) {
+    if (i == offsetof(CalibrationData, moving) || EEPROM.read(record + i) == bytes[i]) {
+      continue;
+    }
+    if (EEPROM.read(moving) == 0) {
+      EEPROM.write(moving, 1);      //invalid until the last byte is written
+    } else {
+      EEPROM.write(record + i, bytes[i]);
+    }
+    return false;
+  }
+  EEPROM.update(moving, 0);
+  return true;
+}
+
+/* marks the record of the axis as left while moving, until it is saved again (one byte, if it was not marked yet) */
+void CalibrationStore::setMoving(uint8_t id) {
+  EEPROM.update(address(id) + offsetof(CalibrationData, moving), 1);
+}
+
+int CalibrationStore::address(uint8_t id) {
+  return CALIBRATION_STORE_ADDRESS + id * sizeof(CalibrationData);
+}
+
+uint16_t CalibrationStore::checksum(const CalibrationData &data) {
+  const uint8_t *bytes = (const uint8_t *)&data;
+  uint16_t sum1 = 0, sum2 = 0;
+  for (size_t i = offsetof(CalibrationData, maxPosition); i < offsetof(CalibrationData, checksum); i++) {
+    sum1 = (sum1 + bytes[i]) % 255;
+    sum2 = (sum2 + sum1) % 255;
+  }
+  return (sum2 << 8) | sum1;
+}
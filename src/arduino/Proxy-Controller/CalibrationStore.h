@@ -0,0 +1,47 @@
+/*
+  CalibrationStore.h - Keeps the calibration and settings of every axis in EEPROM across resets.
+
+  One record per axis (by id, see StepScheduler), checked by version and checksum. The record also tells
+  whether the axis was moving: from the start of a move until the axis has been saved again at rest, the
+  position on record is not where the weight is, and a reset in between makes the record invalid.
+  An EEPROM byte takes 3.3 ms to write, so save() writes at most one byte per call, and only when the
+  EEPROM is ready: the flag first, the changed bytes, the flag cleared last. A reset halfway leaves a
+  record that is not loaded.
+*/
+
+#ifndef CalibrationStore_h
+#define CalibrationStore_h
+
+#include "Arduino.h"
+#include "MoveTimeModel.h"
+
+#define CALIBRATION_STORE_ADDRESS 0       //of the record of axis 0
+#define CALIBRATION_STORE_VERSION 2       //change with the layout of CalibrationData
+
+struct CalibrationData {
+  uint8_t version;
+  uint8_t moving;
+  long maxPosition;                       //steps, from the calibration
+  long position;                          //steps, at rest
+  uint8_t stepperMode;
+  uint16_t speed;                         //steps/s
+  float acceleration, jerk;
+  long holdDelay, releaseDelay;           //ms, see Proxy::getPowerState()
+  uint8_t holdCurrent;                    //%
+  uint16_t stepTime[TIMING_MODES][TIMING_SPEED_COUNT];   //see MoveTimeModel
+  uint16_t checksum;                      //Fletcher-16 over the bytes from maxPosition on
+};
+
+class CalibrationStore
+{
+  public:
+    static bool load(uint8_t id, CalibrationData &data);
+    static bool save(uint8_t id, CalibrationData &data);
+    static void setMoving(uint8_t id);
+
+  private:
+    static int address(uint8_t id);
+    static uint16_t checksum(const CalibrationData &data);
+};
+
+#endif
@@ -0,0 +1,247 @@
+/*
+  EspLink.cpp - Serial link to the ESP8266 module: rate negotiation and in-place parsing of what the module sends.
+*/
+
+#include "Arduino.h"
+#include "EspLink.h"
+
+#define ESP_LINK_STATE_TEXT 0
+#define ESP_LINK_STATE_MUX 1          //after "+IPD,"
+#define ESP_LINK_STATE_LENGTH 2       //after "+IPD,<mux>,"
+#define ESP_LINK_STATE_PAYLOAD 3
+
+static const char IPD[] = "+IPD,";
+static const char CLOSED[] = ",CLOSED";
+
+EspLink::EspLink(EspSerial &serial) : _serial(serial), _baud(ESP_LINK_BOOT_BAUD), _state(ESP_LINK_STATE_TEXT),
+  _matched(0), _column(0), _lineMux(0), _mux(0), _pending(0), _passthrough(false) {
+}
+
+/* returns the rate the link runs at: baud, or ESP_LINK_BOOT_BAUD if the module did not take it. A module that is
+   at baud already (the controller was reset, the module was not) is found there first. */
+long EspLink::begin(long baud) {
+  _serial.begin(baud);
+  if (command(F("AT"))) {
+    _baud = baud;
+  } else {
+    _serial.begin(ESP_LINK_BOOT_BAUD);
+    _baud = ESP_LINK_BOOT_BAUD;
+    _serial.print(F("AT+UART_CUR="));
+    _serial.print(baud);
+    _serial.println(F(",8,1,0,0"));
+    if (waitFor("OK", "ERROR", ESP_LINK_AT_TIMEOUT)) {
+      delay(5);                       //the OK leaves the module at the old rate
+      _serial.begin(baud);
+      if (command(F("AT"))) {
+        _baud = baud;
+      } else {
+        _serial.begin(ESP_LINK_BOOT_BAUD);
+      }
+    }
+  }
+  return _baud;
+}
+
+/* the module echoes command lines by default, which doubles the serial time of every AT+CIPSEND */
+bool EspLink::setEcho(bool on) {
+  return command(on ? F("ATE1") : F("ATE0"));
+}
+
+long EspLink::getBaud() {
+  return _baud;
+}
+
+/* takes the next byte out of the UART buffer, data and mux_id tell what it was (see ESP_LINK_*) */
+uint8_t EspLink::receive(uint8_t &mux_id, uint8_t &data) {
+  if (_serial.available() <= 0) {
+    return ESP_LINK_NONE;
+  }
+  uint8_t c = _serial.read();
+  data = c;
+  if (_passthrough) {
+    mux_id = 0;
+    return ESP_LINK_DATA;
+  }
+  switch (_state) {
+    case ESP_LINK_STATE_PAYLOAD:
+      mux_id = _mux;
+      if (--_pending == 0) {
+        _state = ESP_LINK_STATE_TEXT;
+      }
+      return ESP_LINK_DATA;
+    case ESP_LINK_STATE_MUX:
+      if (c >= '0' && c <= '9') {
+        _mux = _mux * 10 + c - '0';
+      } else if (c == ',') {
+        _state = ESP_LINK_STATE_LENGTH;
+      } else if (c == ':' && _mux > 0) {   //"+IPD,<length>:" of single connection mode
+        _pending = _mux;
+        _mux = 0;
+        _state = ESP_LINK_STATE_PAYLOAD;
+      } else {
+        _state = ESP_LINK_STATE_TEXT;
+      }
+      return ESP_LINK_TEXT;
+    case ESP_LINK_STATE_LENGTH:
+      if (c >= '0' && c <= '9') {
+        _pending = _pending * 10 + c - '0';
+      } else {
+        _state = c == ':' && _pending > 0 ? ESP_LINK_STATE_PAYLOAD : ESP_LINK_STATE_TEXT;
+      }
+      return ESP_LINK_TEXT;
+    default:
+      return text(c, mux_id);
+  }
+}
+
+/* payload bytes of the +IPD message being received that are still to come */
+uint16_t EspLink::getPending() {
+  return _state == ESP_LINK_STATE_PAYLOAD ? _pending : 0;
+}
+
+/* sends an AT command line and waits for its OK */
+bool EspLink::command(const __FlashStringHelper *command, uint32_t timeout) {
+  _serial.println(command);
+  return waitFor("OK", "ERROR", timeout);
+}
+
+/* reads the module's text until success (true) or failure (false) shows up, or the timeout (ms) passes.
+   Client data arriving meanwhile is lost, only for use while no client is connected. */
+bool EspLink::waitFor(const char *success, const char *failure, uint32_t timeout) {
+  uint8_t matchedSuccess = 0, matchedFailure = 0;
+  unsigned long start = millis();
+  while (millis() - start < timeout) {
+    uint8_t mux_id, c;
+    uint8_t what = receive(mux_id, c);
+    if (what != ESP_LINK_TEXT) {
+      continue;
+    }
+    matchedSuccess = c == success[matchedSuccess] ? matchedSuccess + 1 : (c == success[0] ? 1 : 0);
+    matchedFailure = c == failure[matchedFailure] ? matchedFailure + 1 : (c == failure[0] ? 1 : 0);
+    if (success[matchedSuccess] == '\0') {
+      return true;
+    }
+    if (failure[matchedFailure] == '\0') {
+      return false;
+    }
+  }
+  return false;
+}
+
+/* sends an AT command line, copies the rest of the first line of the response starting with prefix to value
+   ("" if there is none) and waits for the OK. Client data arriving meanwhile is lost. */
+bool EspLink::query(const __FlashStringHelper *command, const __FlashStringHelper *prefix, char *value, uint8_t size,
+                    uint32_t timeout) {
+  const char *p = (const char *)prefix;
+  char line[ESP_LINK_LINE_SIZE];
+  value[0] = '\0';
+  _serial.println(command);
+  unsigned long start = millis();
+  while (readLine(line, start, timeout)) {
+    if (strcmp(line, "OK") == 0 || strcmp(line, "ERROR") == 0) {
+      return line[0] == 'O';
+    }
+    uint8_t n = 0;
+    char c;
+    while ((c = pgm_read_byte(p + n)) != '\0' && line[n] == c) {
+      n++;
+    }
+    if (c == '\0' && value[0] == '\0') {
+      strncpy(value, line + n, size - 1);
+      value[size - 1] = '\0';
+    }
+  }
+  return false;
+}
+
+/* AT+CIPSTATUS: returns the number of TCP connections (UDP links are not counted) and copies the address of the client on mux_id to ip
+   ("" if there is none). Client data arriving meanwhile is lost. */
+uint8_t EspLink::getStatus(uint8_t mux_id, char *ip, uint8_t size) {
+  static const char STATUS[] = "+CIPSTATUS:";
+  char line[ESP_LINK_LINE_SIZE];
+  uint8_t connections = 0;
+  ip[0] = '\0';
+  _serial.println(F("AT+CIPSTATUS"));
+  unsigned long start = millis();
+  while (readLine(line, start, ESP_LINK_AT_TIMEOUT)) {
+    if (strcmp(line, "OK") == 0 || strcmp(line, "ERROR") == 0) {
+      break;
+    }
+    if (strncmp(line, STATUS, sizeof(STATUS) - 1) != 0 || strstr(line, "\"TCP\"") == NULL) {
+      continue;
+    }
+    connections++;                    //+CIPSTATUS:<mux>,"TCP","<ip>",<port>,<tetype>
+    char *quote = line;
+    for (uint8_t i = 0; i < 3 && quote != NULL; i++) {
+      quote = strchr(quote + (i > 0), '"');   //the third one opens the address
+    }
+    char *address = quote;
+    char *end = address != NULL ? strchr(address + 1, '"') : NULL;
+    if (line[sizeof(STATUS) - 1] - '0' == mux_id && end != NULL && end - address - 1 < size) {
+      memcpy(ip, address + 1, end - address - 1);
+      ip[end - address - 1] = '\0';
+    }
+  }
+  return connections;
+}
+
+void EspLink::setPassthrough(bool on) {
+  _passthrough = on;
+  _state = ESP_LINK_STATE_TEXT;
+  _matched = 0;
+  _column = 0;
+}
+
+bool EspLink::isPassthrough() {
+  return _passthrough;
+}
+
+/* the next line of the module's text into line (ESP_LINK_LINE_SIZE, cut off beyond), false once timeout (ms) has
+   passed since start */
+bool EspLink::readLine(char *line, unsigned long start, uint32_t timeout) {
+  uint8_t length = 0;
+  while (millis() - start < timeout) {
+    uint8_t id, c;
+    if (receive(id, c) != ESP_LINK_TEXT) {
+      continue;
+    }
+    if (c == '\n') {
+      line[length] = '\0';
+      return true;
+    }
+    if (c != '\r' && length < ESP_LINK_LINE_SIZE - 1) {
+      line[length++] = c;
+    }
+  }
+  return false;
+}
+
+/* the module's own output: looks for the start of "+IPD," anywhere and for "<mux>,CLOSED" at the start of a line */
+uint8_t EspLink::text(uint8_t c, uint8_t &mux_id) {
+  _matched = c == IPD[_matched] ? _matched + 1 : (c == IPD[0] ? 1 : 0);
+  if (IPD[_matched] == '\0') {
+    _matched = 0;
+    _column = 0;
+    _mux = 0;
+    _pending = 0;
+    _state = ESP_LINK_STATE_MUX;
+    return ESP_LINK_TEXT;
+  }
+
+  if (c == '\n') {
+    _column = 0;
+    return ESP_LINK_TEXT;
+  }
+  if (_column == 0 && c >= '0' && c <= '9') {
+    _lineMux = c - '0';
+  } else if (_column == 0 || _column > sizeof(CLOSED) - 1 || c != CLOSED[_column - 1]) {
+    _column = sizeof(CLOSED) + 1;     //not that line, until the next one
+    return ESP_LINK_TEXT;
+  }
+  _column++;
+  if (_column == sizeof(CLOSED)) {
+    mux_id = _lineMux;
+    return ESP_LINK_CLOSED;
+  }
+  return ESP_LINK_TEXT;
+}
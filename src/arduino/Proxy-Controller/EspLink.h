@@ -0,0 +1,75 @@
+/*
+  EspLink.h - Serial link to the ESP8266 module: rate negotiation and in-place parsing of what the module sends.
+
+  The module boots at ESP_LINK_BOOT_BAUD. begin() moves it to a faster rate with AT+UART_CUR (not stored in
+  the module's flash, a module reset is back at the boot rate), and setEcho() switches the echo of command lines
+  off, so an AT+CIPSEND round trip costs a fraction of the serial time. The UART driver's receive interrupt fills its ring buffer,
+  receive() walks through that buffer one byte at a time with a small state machine: the payload of an
+  "+IPD,<mux>,<length>:" message goes to the caller byte by byte as it arrives, without being collected into
+  a String or a buffer of its own first, everything else as text, and "<mux>,CLOSED" is reported on its own.
+  In passthrough (AT+CIPMODE=1, one connection) every byte is the client's, as data of mux 0.
+  Responses are read into fixed buffers on the stack (query(), getStatus()), the link allocates nothing.
+*/
+
+#ifndef EspLink_h
+#define EspLink_h
+
+//TARGET PLATFORM
+#define PLATFORM_UNO
+//#define PLATFORM_MEGA     //un-comment only the target platform
+
+#include "Arduino.h"
+#ifdef PLATFORM_UNO
+  #include <SoftwareSerial.h>
+  #define SOFT_SERIAL_RX 7
+  #define SOFT_SERIAL_TX 8
+  typedef SoftwareSerial EspSerial;
+  #define ESP_LINK_BAUD 57600         //fastest rate SoftwareSerial receives reliably on a 16 MHz AVR
+#else
+  typedef HardwareSerial EspSerial;   //Serial1
+  #define ESP_LINK_BAUD 115200
+#endif
+
+#define ESP_LINK_BOOT_BAUD 9600       //set in the module with AT+UART_DEF
+#define ESP_LINK_AT_TIMEOUT 1000      //ms for the OK of a command
+#define ESP_LINK_LINE_SIZE 48         //longest line of text query() and getStatus() look at
+
+//what receive() found
+#define ESP_LINK_NONE 0               //the UART buffer is empty
+#define ESP_LINK_TEXT 1               //a byte of the module's own output (responses, notifications)
+#define ESP_LINK_DATA 2               //a byte a client sent on mux_id
+#define ESP_LINK_CLOSED 3             //the client on mux_id went away
+
+class EspLink
+{
+  public:
+    EspLink(EspSerial &serial);
+    long begin(long baud = ESP_LINK_BAUD);
+    long getBaud();
+    bool setEcho(bool on);
+    uint8_t receive(uint8_t &mux_id, uint8_t &data);
+    uint16_t getPending();
+    bool command(const __FlashStringHelper *command, uint32_t timeout = ESP_LINK_AT_TIMEOUT);
+    bool waitFor(const char *success, const char *failure, uint32_t timeout);
+    bool query(const __FlashStringHelper *command, const __FlashStringHelper *prefix, char *value, uint8_t size,
+               uint32_t timeout = ESP_LINK_AT_TIMEOUT);
+    uint8_t getStatus(uint8_t mux_id, char *ip, uint8_t size);
+    void setPassthrough(bool on);
+    bool isPassthrough();
+
+  private:
+    EspSerial &_serial;
+    long _baud;
+    uint8_t _state;
+    uint8_t _matched;                 //bytes of "+IPD," matched in text
+    uint8_t _column;                  //position in the current line of text, for "<mux>,CLOSED"
+    uint8_t _lineMux;
+    uint8_t _mux;
+    uint16_t _pending;                //payload bytes of the current +IPD message still to come
+    bool _passthrough;
+
+    bool readLine(char *line, unsigned long start, uint32_t timeout);
+    uint8_t text(uint8_t c, uint8_t &mux_id);
+};
+
+#endif
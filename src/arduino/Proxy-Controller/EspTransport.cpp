@@ -0,0 +1,308 @@
+/*
+  EspTransport.cpp - The ESP8266 WiFi module on the serial port as the transport of the ProxyControlServer.
+*/
+
+#include "Arduino.h"
+#include "EspTransport.h"
+#include "ProxyProtocol.h"
+#include "Log.h"
+
+EspTransport::EspTransport() : _connectToWifi(true), _ssid(NULL), _pw(NULL), _port(0), _timeout(0), _moduleReady(false),
+  _datagramPort(0), _beep(NULL), _link(_serial1) {
+  _serial1.begin(ESP_LINK_BOOT_BAUD);
+}
+
+/* the network to join (the module opens one of its own if connectToWifi is false), the TCP port to serve and the s
+   until an idle client is dropped. beep: sounds the errors of the set up, returns at once */
+void EspTransport::init(bool connectToWifi, const __FlashStringHelper *ssid, const __FlashStringHelper *pw, int port,
+                        int timeout, void (*beep)(int)) {
+  _connectToWifi = connectToWifi;
+  _ssid = ssid;
+  _pw = pw;
+  _port = port;
+  _timeout = timeout;
+  _beep = beep;
+}
+
+/* sets the module up the first time, then starts its TCP server */
+bool EspTransport::start() {
+  if (!_moduleReady) {
+    setupModule();
+    _moduleReady = true;
+  }
+  return startServer();
+}
+
+/* station + soft AP, joins the network, several clients. AT+CWMODE takes effect at once on AT firmware 0.18, without
+   the module reset the library did, which also put the module back at its boot rate. */
+void EspTransport::setupModule() {
+  bool initSuccess = true;
+  char value[ESP_LINK_LINE_SIZE];
+  LOG_INFO(F("\tESP8266-WiFi Module link at "));
+  LOG_INFO(_link.begin());
+  LOG_INFO(F(" baud\r\n"));
+  _link.query(F("AT+GMR"), F("AT version:"), value, sizeof(value));
+  LOG_INFO(F("\tESP8266-WiFi Module AT Version:"));
+  LOG_INFOLN(value);
+
+  if (_link.command(F("AT+CWMODE=3"))) {
+    LOG_INFO(F("\tOperation Mode set to 'station + softap' ... OK\r\n"));
+    initSuccess &= true;
+  } else {
+    LOG_ERROR(F("\tOperation Mode set to 'station + softap' ... ERROR\r\n"));
+    initSuccess &= false;
+    if (_beep != NULL) {
+      _beep(200);   //queued, see Feedback
+      _beep(200);
+      _beep(400);
+    }
+  }
+
+  if (_connectToWifi) {
+    _serial1.print(F("AT+CWJAP=\""));
+    _serial1.print(_ssid);
+    _serial1.print(F("\",\""));
+    _serial1.print(_pw);
+    _serial1.println(F("\""));
+    if (_link.waitFor("OK", "FAIL", ESP_JOIN_TIMEOUT)) {
+      LOG_INFOLN(_ssid);
+      LOG_INFO(F("\tJoined WiFi Network ... SUCCESS\r\n"));
+      initSuccess &= true;
+    } else {
+      LOG_ERRORLN(_ssid);
+      LOG_ERROR(F("\tJoined WiFi Network ... ERROR\r\n"));
+      initSuccess &= false;
+    }
+  } else {
+    LOG_INFO(F("\tWiFi Network opened! Not joining external WiFi Network according to configuration!\r\n"));
+    initSuccess &= true;
+  }
+
+  if (_connectToWifi) {
+    _link.query(F("AT+CIFSR"), F("+CIFSR:STAIP,"), value, sizeof(value));
+  } else {
+    _link.query(F("AT+CIFSR"), F("+CIFSR:APIP,"), value, sizeof(value));
+  }
+  LOG_INFO(F("\tIP: "));
+  LOG_INFOLN(value);
+
+  if (_link.command(F("AT+CIPMUX=1"))) {
+    LOG_INFO(F("\tEnabled 'multi-client' Mode ... SUCCESS\r\n"));
+    initSuccess &= true;
+  } else {
+    LOG_ERROR(F("\tEnabled 'multi-client' Mode ... ERROR\r\n"));
+    initSuccess &= false;
+  }
+
+  if (_link.setEcho(false)) {
+    LOG_INFO(F("\tCommand echo off ... SUCCESS\r\n"));
+  } else {
+    LOG_ERROR(F("\tCommand echo off ... ERROR\r\n"));
+  }
+
+  if (initSuccess) {
+    LOG_INFO(F("\t\t--> WiFi Module ready!\n\n"));
+  } else {
+    LOG_ERROR(F("\t\t--> Error initializing WiFi Module!\n\n"));
+  }
+}
+
+
+bool EspTransport::startServer() {
+  bool startServerSuccess = true;
+  _serial1.print(F("AT+CIPSERVER=1,"));
+  _serial1.println(_port);
+  if (_link.waitFor("OK", "ERROR", ESP_LINK_AT_TIMEOUT)) {
+    LOG_INFO(F("\tPort: "));
+    LOG_INFO(_port);
+    LOG_INFO(F("\n"));
+    LOG_INFO(F("\tStarting TCP Server ... SUCCESS\r\n"));
+    startServerSuccess &= true;
+  } else {
+    LOG_ERROR(F("\tStarting TCP Server ... ERROR\r\n"));
+    startServerSuccess &= false;
+  }
+
+  _serial1.print(F("AT+CIPSTO="));
+  _serial1.println(_timeout);
+  if (_link.waitFor("OK", "ERROR", ESP_LINK_AT_TIMEOUT)) {
+    LOG_INFO(F("\tSet TCP Server Timeout to "));
+    LOG_INFO(_timeout);
+    LOG_INFO(F(" seconds ... SUCCESS\r\n"));
+    startServerSuccess &= true;
+  } else {
+    LOG_ERROR(F("\tSet TCP Server Timeout to "));
+    LOG_ERROR(_timeout);
+    LOG_ERROR(F(" seconds ... ERROR\r\n"));
+    startServerSuccess &= false;
+  }
+
+  if (_datagramPort != 0) {
+    startServerSuccess &= openDatagrams();
+  }
+
+  if (startServerSuccess) {
+    LOG_INFOLN(F("\t\t--> Ready to receive remote commands!\n\n"));
+  } else {
+    LOG_ERRORLN(F("\t\t--> Could not start TCP server correctly!\n\n"));
+  }
+  return startServerSuccess;
+}
+
+/* the UDP endpoint next to the TCP server, opened again whenever the server starts (after passthrough) */
+bool EspTransport::startDatagrams(uint16_t port) {
+  _datagramPort = port;
+  return openDatagrams();
+}
+
+/* link PROTOCOL_UDP_MUX in mode 2: the datagrams go to the peer that sent the last one */
+bool EspTransport::openDatagrams() {
+  _serial1.print(F("AT+CIPSTART="));
+  _serial1.print(PROTOCOL_UDP_MUX);
+  _serial1.print(F(",\"UDP\",\"0.0.0.0\","));
+  _serial1.print(_datagramPort);
+  _serial1.print(F(","));
+  _serial1.print(_datagramPort);
+  _serial1.println(F(",2"));
+  if (_link.waitFor("OK", "ERROR", ESP_LINK_AT_TIMEOUT)) {
+    LOG_INFO(F("\tUDP Port: "));
+    LOG_INFOLN(_datagramPort);
+    return true;
+  }
+  LOG_ERRORLN(F("\tOpening the UDP endpoint ... ERROR"));
+  return false;
+}
+
+bool EspTransport::stop() {
+  if (_link.command(F("AT+CIPSERVER=0"))) {
+    LOG_INFOLN(F("\t\t--> Stopping TCP Server ... SUCCESS"));
+    return true;
+  } else {
+    LOG_ERRORLN(F("\t\t--> Stopping TCP Server ... ERROR"));
+    return false;
+  }
+}
+
+/* takes everything the module has sent so far off the link, client data to the listener */
+bool EspTransport::poll() {
+  bool received = false;
+  uint8_t mux_id, data, what;
+  while ((what = _link.receive(mux_id, data)) != ESP_LINK_NONE) {
+    if (what == ESP_LINK_DATA) {
+      _listener->onReceived(mux_id, data);
+      received = true;
+    } else if (what == ESP_LINK_CLOSED) {
+      _listener->onClosed(mux_id);
+    }
+  }
+  return received;
+}
+
+/* AT+CIPSEND as in ESP8266::send(), which waits 5 s for the '>' prompt even when the module has already
+   answered that the link is gone. Here an ERROR ends the attempt at once, so a client that went away costs one
+   AT round trip instead of stalling the loop. What clients send meanwhile is kept, not discarded as by the library. */
+bool EspTransport::send(uint8_t mux_id, const uint8_t *buffer, uint8_t len) {
+  if (_link.isPassthrough()) {        //straight to the one client
+    _serial1.write(buffer, len);
+    return true;
+  }
+  poll();
+  _serial1.print(F("AT+CIPSEND="));
+  _serial1.print(mux_id);
+  _serial1.print(F(","));
+  _serial1.println(len);
+  if (waitFor(">", "ERROR", SESSION_PROMPT_TIMEOUT)) {
+    poll();
+    _serial1.write(buffer, len);
+    if (waitFor("SEND OK", "ERROR", SESSION_SEND_TIMEOUT)) {
+      LOG_TRACE(F("\t\t--> Data sent!"));
+      return true;
+    }
+  }
+  return false;
+}
+
+/* reads the module's output until success (true) or failure (false) shows up, or the timeout (ms) passes.
+   Client data on the way goes to the listener. */
+bool EspTransport::waitFor(const char *success, const char *failure, uint32_t timeout) {
+  uint8_t matchedSuccess = 0, matchedFailure = 0;
+  unsigned long start = millis();
+  while (millis() - start < timeout) {
+    uint8_t mux_id, c;
+    uint8_t what = _link.receive(mux_id, c);
+    if (what == ESP_LINK_DATA) {
+      _listener->onReceived(mux_id, c);
+      continue;
+    }
+    if (what == ESP_LINK_CLOSED) {
+      _listener->onClosed(mux_id);
+    }
+    if (what != ESP_LINK_TEXT) {
+      continue;
+    }
+    matchedSuccess = c == success[matchedSuccess] ? matchedSuccess + 1 : (c == success[0] ? 1 : 0);
+    matchedFailure = c == failure[matchedFailure] ? matchedFailure + 1 : (c == failure[0] ? 1 : 0);
+    if (success[matchedSuccess] == '\0') {
+      return true;
+    }
+    if (failure[matchedFailure] == '\0') {
+      return false;
+    }
+  }
+  return false;
+}
+
+/* the module connects to the server of the client on mux_id at its address, which is mux 0 then and the bytes go
+   through. Refused unless it is the only TCP client (the datagram endpoint is closed meanwhile); falls back to the TCP
+   server if the module cannot connect. */
+uint8_t EspTransport::startPassthrough(uint8_t mux_id, uint16_t port) {
+  char ip[16];
+  if (_link.getStatus(mux_id, ip, sizeof(ip)) != 1 || ip[0] == '\0') {
+    return TRANSPORT_PASSTHROUGH_REFUSED;
+  }
+  bool success = _link.command(F("AT+CIPSERVER=0")) && _link.command(F("AT+CIPCLOSE=5")) && _link.command(F("AT+CIPMUX=0"));
+  if (success) {
+    _serial1.print(F("AT+CIPSTART=\"TCP\",\""));
+    _serial1.print(ip);
+    _serial1.print(F("\","));
+    _serial1.println(port);
+    success = _link.waitFor("OK", "ERROR", PASSTHROUGH_CONNECT_TIMEOUT) && _link.command(F("AT+CIPMODE=1"));
+  }
+  if (success) {
+    _serial1.println(F("AT+CIPSEND"));
+    success = _link.waitFor(">", "ERROR", ESP_LINK_AT_TIMEOUT);
+  }
+  if (!success) {
+    _link.command(F("AT+CIPMODE=0"));
+    _link.command(F("AT+CIPCLOSE"));
+    _link.command(F("AT+CIPMUX=1"));
+    startServer();
+    return TRANSPORT_PASSTHROUGH_FAILED;
+  }
+  _link.setPassthrough(true);
+  LOG_INFO(F("\tPassthrough to "));
+  LOG_INFO(ip);
+  LOG_INFO(F(":"));
+  LOG_INFOLN(port);
+  return TRANSPORT_PASSTHROUGH_STARTED;
+}
+
+/* "+++" ends passthrough, then the module is set up as TCP server for several clients again */
+void EspTransport::stopPassthrough() {
+  if (!_link.isPassthrough()) {
+    return;
+  }
+  delay(PASSTHROUGH_GUARD_TIME);
+  _serial1.print(F("+++"));
+  delay(PASSTHROUGH_GUARD_TIME);
+  _link.setPassthrough(false);
+  _link.command(F("AT+CIPMODE=0"));
+  _link.command(F("AT+CIPCLOSE"));
+  _link.command(F("AT+CIPMUX=1"));
+  startServer();
+  LOG_INFOLN(F("\tPassthrough ended"));
+}
+
+bool EspTransport::isPassthrough() {
+  return _link.isPassthrough();
+}
@@ -0,0 +1,60 @@
+/*
+  EspTransport.h - The ESP8266 WiFi module on the serial port as the transport of the ProxyControlServer.
+
+  The module is set up with the first start(): it joins the WiFi network (or opens its own), serves up to
+  PROTOCOL_MAX_CONNECTIONS clients on one TCP port and replies go out with one AT+CIPSEND round trip each.
+  In passthrough the module connects to the server of the one client instead and the bytes go through both ways.
+  The datagram endpoint is a UDP link of the module on link id PROTOCOL_UDP_MUX, in the mode that answers the last peer.
+  The module is driven with plain AT commands over the EspLink, not with the ESP8266 library, whose String
+  arguments and responses would fragment the 2 KB heap of the UNO: nothing is allocated after setup().
+*/
+
+#ifndef EspTransport_h
+#define EspTransport_h
+
+#include "Arduino.h"
+#include "ProxyTransport.h"
+#include "EspLink.h"      //TARGET PLATFORM
+
+#define SESSION_PROMPT_TIMEOUT 5000     //ms for the '>' of AT+CIPSEND, as in ESP8266::send()
+#define SESSION_SEND_TIMEOUT 10000      //ms for SEND OK
+#define PASSTHROUGH_CONNECT_TIMEOUT 5000  //ms for the module to connect to the client's server
+#define PASSTHROUGH_GUARD_TIME 1000     //ms of silence before and after the "+++" that ends passthrough
+#define ESP_JOIN_TIMEOUT 10000          //ms for AT+CWJAP to join the network
+
+class EspTransport : public ProxyTransport
+{
+  public:
+    EspTransport();
+    void init(bool connectToWifi, const __FlashStringHelper *ssid, const __FlashStringHelper *pw, int port, int timeout,
+              void (*beep)(int) = NULL);
+    bool start();
+    bool stop();
+    bool poll();
+    bool send(uint8_t mux_id, const uint8_t *buffer, uint8_t len);
+    uint8_t startPassthrough(uint8_t mux_id, uint16_t port);
+    void stopPassthrough();
+    bool isPassthrough();
+    bool startDatagrams(uint16_t port);
+
+  private:
+    bool _connectToWifi;
+    const __FlashStringHelper *_ssid, *_pw;   //in flash, F("...")
+    int _port, _timeout;
+    bool _moduleReady;                  //set up by the first start()
+    uint16_t _datagramPort;             //0 = no datagram endpoint
+    void (*_beep)(int);
+    #ifdef PLATFORM_UNO
+      SoftwareSerial _serial1 = SoftwareSerial(SOFT_SERIAL_RX, SOFT_SERIAL_TX);
+    #else
+      HardwareSerial &_serial1 = Serial1;
+    #endif
+    EspLink _link;
+
+    void setupModule();
+    bool startServer();
+    bool openDatagrams();
+    bool waitFor(const char *success, const char *failure, uint32_t timeout);
+};
+
+#endif
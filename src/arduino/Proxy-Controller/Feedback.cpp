@@ -0,0 +1,108 @@
+/*
+  Feedback.cpp - LED and buzzer patterns that play while the controller goes on working.
+*/
+
+#include "Arduino.h"
+#include "Feedback.h"
+
+uint8_t Feedback::_pins[FEEDBACK_CHANNELS];
+FeedbackStep Feedback::_queue[FEEDBACK_CHANNELS][FEEDBACK_QUEUE_SIZE];
+uint8_t Feedback::_head[FEEDBACK_CHANNELS];
+uint8_t Feedback::_count[FEEDBACK_CHANNELS];
+unsigned long Feedback::_start[FEEDBACK_CHANNELS];
+uint16_t Feedback::_duration[FEEDBACK_CHANNELS];
+bool Feedback::_active = false;
+
+void Feedback::begin(uint8_t ledPin, uint8_t buzzerPin){
+  _pins[FEEDBACK_LED] = ledPin;
+  _pins[FEEDBACK_BUZZER] = buzzerPin;
+  pinMode(ledPin, OUTPUT);
+  pinMode(buzzerPin, OUTPUT);
+}
+
+/* on and off for duration ms each, times times. Dropped as a whole if the queue has no room for it. */
+void Feedback::blink(uint8_t times, uint16_t duration){
+  if(!room(FEEDBACK_LED, 2 * times)){
+    return;
+  }
+  for(uint8_t i = 0; i < times; i++){
+    add(FEEDBACK_LED, 1, duration);
+    add(FEEDBACK_LED, 0, duration);
+  }
+  update();                       //starts at once if the LED is free
+}
+
+/* the LED on or off from now on, the blinks not played yet are dropped */
+void Feedback::light(bool on){
+  _count[FEEDBACK_LED] = 0;
+  _duration[FEEDBACK_LED] = 0;
+  digitalWrite(_pins[FEEDBACK_LED], on ? HIGH : LOW);
+}
+
+/* a tone of duration ms, and silence for pause ms before the next one */
+void Feedback::beep(uint16_t frequency, uint16_t duration, uint16_t pause){
+  if(!room(FEEDBACK_BUZZER, pause > 0 ? 2 : 1)){
+    return;
+  }
+  add(FEEDBACK_BUZZER, frequency, duration);
+  if(pause > 0){
+    add(FEEDBACK_BUZZER, 0, pause);
+  }
+  update();
+}
+
+/* starts the next step of every channel whose step is over */
+void Feedback::update(){
+  if(!_active){
+    return;
+  }
+  unsigned long now = millis();
+  _active = false;
+  for(uint8_t channel = 0; channel < FEEDBACK_CHANNELS; channel++){
+    if(_duration[channel] > 0 && now - _start[channel] < _duration[channel]){
+      _active = true;             //still playing
+      continue;
+    }
+    if(_count[channel] == 0){
+      _duration[channel] = 0;
+      continue;
+    }
+    play(channel, _queue[channel][_head[channel]], now);
+    _head[channel] = (_head[channel] + 1) % FEEDBACK_QUEUE_SIZE;
+    _count[channel]--;
+    _active = true;
+  }
+}
+
+/* a pattern is playing or waiting */
+bool Feedback::busy(){
+  return _active;
+}
+
+bool Feedback::add(uint8_t channel, uint16_t value, uint16_t duration){
+  if(_count[channel] == FEEDBACK_QUEUE_SIZE){
+    return false;
+  }
+  FeedbackStep &step = _queue[channel][(_head[channel] + _count[channel]) % FEEDBACK_QUEUE_SIZE];
+  step.value = value;
+  step.duration = duration;
+  _count[channel]++;
+  _active = true;
+  return true;
+}
+
+bool Feedback::room(uint8_t channel, uint8_t steps){
+  return FEEDBACK_QUEUE_SIZE - _count[channel] >= steps;
+}
+
+void Feedback::play(uint8_t channel, const FeedbackStep &step, unsigned long now){
+  _start[channel] = now;
+  _duration[channel] = step.duration;
+  if(channel == FEEDBACK_LED){
+    digitalWrite(_pins[channel], step.value ? HIGH : LOW);
+  }else if(step.value > 0){
+    tone(_pins[channel], step.value, step.duration);
+  }else{
+    noTone(_pins[channel]);
+  }
+}
@@ -0,0 +1,50 @@
+/*
+  Feedback.h - LED and buzzer patterns that play while the controller goes on working.
+
+  blink(), beep() and light() only queue steps (a free channel starts at once) and return; update() switches the
+  outputs when a step is over. It runs as a task of the loop (see TaskScheduler) every ms, so a step may last a
+  ms longer than asked, or a reply's round trip longer while the network task sends. LED and buzzer have a queue each and play at the same time.
+  A full queue drops what is added (feedback for a burst of commands plays once).
+  The buzzer steps use tone(), which times the sound itself (Timer2).
+*/
+
+#ifndef Feedback_h
+#define Feedback_h
+
+#include "Arduino.h"
+
+#define FEEDBACK_LED 0
+#define FEEDBACK_BUZZER 1
+#define FEEDBACK_CHANNELS 2
+#define FEEDBACK_QUEUE_SIZE 8     //steps per channel
+
+/* one step: the LED on (value 1) or off (0), the buzzer at value Hz or silent (0), for duration ms */
+struct FeedbackStep {
+  uint16_t value;
+  uint16_t duration;
+};
+
+class Feedback
+{
+  public:
+    static void begin(uint8_t ledPin, uint8_t buzzerPin);
+    static void blink(uint8_t times, uint16_t duration);
+    static void light(bool on);
+    static void beep(uint16_t frequency, uint16_t duration, uint16_t pause = 0);
+    static void update();
+    static bool busy();
+
+  private:
+    static uint8_t _pins[FEEDBACK_CHANNELS];
+    static FeedbackStep _queue[FEEDBACK_CHANNELS][FEEDBACK_QUEUE_SIZE];
+    static uint8_t _head[FEEDBACK_CHANNELS], _count[FEEDBACK_CHANNELS];
+    static unsigned long _start[FEEDBACK_CHANNELS];
+    static uint16_t _duration[FEEDBACK_CHANNELS];   //of the step playing, 0 = idle
+    static bool _active;
+
+    static bool add(uint8_t channel, uint16_t value, uint16_t duration);
+    static bool room(uint8_t channel, uint8_t steps);
+    static void play(uint8_t channel, const FeedbackStep &step, unsigned long now);
+};
+
+#endif
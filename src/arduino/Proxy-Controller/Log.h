@@ -0,0 +1,46 @@
+/*
+  Log.h - Compile-time log levels for the debug output on the (USB) Serial port.
+  Messages above LOG_LEVEL are compiled out together with their arguments, so nothing is
+  formatted or sent for them. At 9600 baud every printed character costs about 1 ms.
+*/
+
+#ifndef Log_h
+#define Log_h
+
+#define LOG_LEVEL_OFF 0       //release: no serial output at all
+#define LOG_LEVEL_ERROR 1     //failures only
+#define LOG_LEVEL_INFO 2      //start-up, calibration and state changes
+#define LOG_LEVEL_TRACE 3     //every packet and command, including the per-packet self-test
+
+//set the level here or with a build flag, e.g. arduino-cli compile --build-property "compiler.cpp.extra_flags=-DLOG_LEVEL=0"
+#ifndef LOG_LEVEL
+  #define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#include "Arduino.h"
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+  #define LOG_ERROR(...) Serial.print(__VA_ARGS__)
+  #define LOG_ERRORLN(...) Serial.println(__VA_ARGS__)
+#else
+  #define LOG_ERROR(...) do {} while (0)
+  #define LOG_ERRORLN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  #define LOG_INFO(...) Serial.print(__VA_ARGS__)
+  #define LOG_INFOLN(...) Serial.println(__VA_ARGS__)
+#else
+  #define LOG_INFO(...) do {} while (0)
+  #define LOG_INFOLN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+  #define LOG_TRACE(...) Serial.print(__VA_ARGS__)
+  #define LOG_TRACELN(...) Serial.println(__VA_ARGS__)
+#else
+  #define LOG_TRACE(...) do {} while (0)
+  #define LOG_TRACELN(...) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+/*
+  MotionPlanner.cpp - Step-by-step velocity planning with acceleration (trapezoidal) and jerk (S-curve) limits.
+*/
+
+#include "Arduino.h"
+#include "MotionPlanner.h"
+
+MotionPlanner::MotionPlanner() {
+  _maxVelocity = 1;
+  _acceleration = PLANNER_DEFAULT_ACCELERATION;
+  _jerk = PLANNER_DEFAULT_JERK;
+  _scale = 1;
+  applyScale();
+  reset();
+}
+
+void MotionPlanner::setMaxVelocity(float velocity) {
+  _maxVelocity = max(velocity, 1.0f);
+  applyScale();
+}
+
+void MotionPlanner::setAcceleration(float acceleration) {
+  _acceleration = constrain(acceleration, PLANNER_MIN_ACCELERATION, PLANNER_MAX_ACCELERATION);
+  applyScale();
+}
+
+void MotionPlanner::setJerk(float jerk) {
+  _jerk = constrain(jerk, 0, PLANNER_MAX_JERK);
+  applyScale();
+}
+
+/* (0,1], a running move adapts with its next step */
+void MotionPlanner::setScale(float scale) {
+  _scale = constrain(scale, 0.001, 1);
+  applyScale();
+}
+
+float MotionPlanner::getMaxVelocity() {
+  return _maxVelocity;
+}
+
+float MotionPlanner::getAcceleration() {
+  return _acceleration;
+}
+
+float MotionPlanner::getJerk() {
+  return _jerk;
+}
+
+void MotionPlanner::applyScale() {
+  _velocityLimit = max(_maxVelocity * _scale, 1.0f);
+  _accelerationLimit = max(_acceleration * _scale, (float)PLANNER_MIN_ACCELERATION);
+  _jerkLimit = _jerk * _scale;
+}
+
+/* standstill, e.g. after an immediate stop */
+void MotionPlanner::reset() {
+  _velocity = 0;
+  _currentAcceleration = 0;
+}
+
+float MotionPlanner::getVelocity() {
+  return _velocity;
+}
+
+/* velocity (signed, steps/s) of the step to make now, 0 once the weight rests on the target */
+float MotionPlanner::next(long stepsToGo) {
+  float speed = fabs(_velocity);
+  int direction = _velocity > 0 ? 1 : -1;
+
+  if (speed == 0) {                 //start from standstill
+    if (stepsToGo == 0) {
+      return 0;
+    }
+    _currentAcceleration = 0;
+    _velocity = stepsToGo > 0 ? minSpeed() : -minSpeed();
+    return _velocity;
+  }
+
+  long ahead = stepsToGo * direction;
+  if (ahead <= 0 && speed <= minSpeed()) {    //slow enough to stop or turn around on the spot
+    _currentAcceleration = 0;
+    if (stepsToGo == 0) {
+      _velocity = 0;
+    } else {
+      _velocity = stepsToGo > 0 ? minSpeed() : -minSpeed();
+    }
+    return _velocity;
+  }
+
+  bool brake = ahead <= 0 || stoppingDistance(speed) >= ahead;
+  bool tooFast = speed > _velocityLimit;
+
+  if (_jerkLimit == 0) {            //trapezoid: v^2 changes by 2a per step
+    float speed2 = speed * speed + ((brake || tooFast) ? -2 : 2) * _accelerationLimit;
+    speed = speed2 > 0 ? sqrt(speed2) : 0;
+    if (!brake) {
+      speed = tooFast ? max(speed, _velocityLimit) : min(speed, _velocityLimit);
+    }
+  } else {                          //S-curve: the acceleration follows its target at the jerk limit
+    float dt = 1 / speed;
+    float target;
+    if (brake || tooFast) {
+      target = -_accelerationLimit;
+    } else if (_currentAcceleration > 0 && _velocityLimit - speed <= _currentAcceleration * _currentAcceleration / (2 * _jerkLimit)) {
+      target = 0;                   //ease into the maximum velocity
+    } else {
+      target = speed < _velocityLimit ? _accelerationLimit : 0;
+    }
+    float change = _jerkLimit * dt;
+    if (_currentAcceleration < target) {
+      _currentAcceleration = min(_currentAcceleration + change, target);
+    } else {
+      _currentAcceleration = max(_currentAcceleration - change, target);
+    }
+    speed += _currentAcceleration * dt;
+    if (!brake && !tooFast) {
+      speed = min(speed, _velocityLimit);
+    }
+  }
+  speed = max(speed, minSpeed());
+  _velocity = direction * speed;
+  return _velocity;
+}
+
+/* velocity (signed, steps/s) of the step to make now towards a target that moves at targetVelocity (steps/s, signed):
+   the target's velocity plus the velocity the weight can still brake from to meet it, approached within the
+   acceleration limit (jerk is not applied, the target changes with every setpoint). 0 once the weight rests on a
+   target at rest. */
+float MotionPlanner::follow(long stepsToGo, float targetVelocity) {
+  float speed = fabs(_velocity);
+  if (stepsToGo == 0 && fabs(targetVelocity) < minSpeed() && speed <= minSpeed()) {
+    _velocity = 0;                  //on the target, slow enough to stay
+    _currentAcceleration = 0;
+    return 0;
+  }
+  float wanted = targetVelocity;
+  if (stepsToGo != 0) {
+    float approach = sqrt(2 * _accelerationLimit * labs(stepsToGo));
+    wanted += stepsToGo > 0 ? approach : -approach;
+  }
+  wanted = constrain(wanted, -_velocityLimit, _velocityLimit);
+  float change = speed > 0 ? _accelerationLimit / speed : minSpeed();   //within the time to the next step
+  if (wanted > _velocity) {
+    _velocity = min(_velocity + change, wanted);
+  } else {
+    _velocity = max(_velocity - change, wanted);
+  }
+  if (fabs(_velocity) < 1) {        //no step to make at this velocity, it goes on in the direction wanted
+    _velocity = wanted >= 0 ? 1 : -1;
+  }
+  return _velocity;
+}
+
+/* the speed of the first step: one step covers exactly the distance needed to reach it */
+float MotionPlanner::minSpeed() {
+  return min((float)sqrt(2 * _accelerationLimit), _velocityLimit);
+}
+
+/* steps needed to come to rest from speed (S-curve: including the ramps of the deceleration) */
+float MotionPlanner::stoppingDistance(float speed) {
+  float distance = speed * speed / (2 * _accelerationLimit);
+  if (_jerkLimit > 0) {
+    distance += speed * _accelerationLimit / (2 * _jerkLimit);
+  }
+  return distance;
+}
@@ -0,0 +1,52 @@
+/*
+  MotionPlanner.h - Step-by-step velocity planning with acceleration (trapezoidal) and jerk (S-curve) limits.
+
+  The planner is asked once per step for the velocity of the next step, given the steps still to go.
+  It accelerates towards the maximum velocity as long as it can still brake in time and brakes otherwise,
+  so a new target is taken into account with the very next step (a target behind the weight makes it
+  brake, pass the stopping point and come back). Jerk 0 gives trapezoidal profiles.
+  A scale below 1 slows a move down as a whole (all three limits), e.g. to end together with another axis.
+  follow() tracks a target that moves on its own (follow mode, see Proxy::follow()) instead of coming to rest on it.
+  All values are in steps, steps/s, steps/s^2 and steps/s^3.
+*/
+
+#ifndef MotionPlanner_h
+#define MotionPlanner_h
+
+#include "Arduino.h"
+
+#define PLANNER_DEFAULT_ACCELERATION 2000.0
+#define PLANNER_DEFAULT_JERK 0.0
+#define PLANNER_MIN_ACCELERATION 10.0       //keeps the first step within the 16 bit step timer
+#define PLANNER_MAX_ACCELERATION 50000.0
+#define PLANNER_MAX_JERK 1000000.0
+
+class MotionPlanner
+{
+  public:
+    MotionPlanner();
+    void setMaxVelocity(float velocity);
+    void setAcceleration(float acceleration);
+    void setJerk(float jerk);
+    void setScale(float scale);
+    float getMaxVelocity();
+    float getAcceleration();
+    float getJerk();
+    void reset();
+    float next(long stepsToGo);
+    float follow(long stepsToGo, float targetVelocity);
+    float getVelocity();
+
+  private:
+    float _maxVelocity, _acceleration, _jerk;   //as set
+    float _scale;
+    float _velocityLimit, _accelerationLimit, _jerkLimit;   //scaled, used for planning
+    float _velocity;              //signed, of the step made last
+    float _currentAcceleration;   //along the direction of motion, S-curve only
+
+    void applyScale();
+    float minSpeed();
+    float stoppingDistance(float speed);
+};
+
+#endif
@@ -0,0 +1,113 @@
+/*
+  MoveTimeModel.cpp - Predicts how long a planned move takes, from step times measured during calibration.
+*/
+
+#include "Arduino.h"
+#include "MoveTimeModel.h"
+
+static const uint16_t TIMING_SPEEDS[TIMING_SPEED_COUNT] = {100, 250, 500, 1000, 2000};   //steps/s
+#define ZETA_HALF -1.4603545    //sum(1/sqrt(k), k = 1..n) = 2 sqrt(n) + ZETA_HALF for large n
+
+MoveTimeModel::MoveTimeModel() {
+  for (uint8_t m = 0; m < TIMING_MODES; m++) {
+    for (uint8_t s = 0; s < TIMING_SPEED_COUNT; s++) {
+      _stepTime[m][s] = 0;
+    }
+  }
+  _lastError = 0;
+  _errorSum = 0;
+  _maxError = 0;
+  _errorCount = 0;
+}
+
+uint16_t MoveTimeModel::speed(uint8_t index) {
+  return TIMING_SPEEDS[index];
+}
+
+/* mode as for Adafruit_StepperMotor::onestep() (SINGLE = 1 ... MICROSTEP = 4) */
+void MoveTimeModel::setStepTime(uint8_t mode, uint8_t speedIndex, uint16_t us) {
+  if (mode >= 1 && mode <= TIMING_MODES && speedIndex < TIMING_SPEED_COUNT) {
+    _stepTime[mode - 1][speedIndex] = us;
+  }
+}
+
+uint16_t MoveTimeModel::getStepTime(uint8_t mode, uint8_t speedIndex) {
+  if (mode >= 1 && mode <= TIMING_MODES && speedIndex < TIMING_SPEED_COUNT) {
+    return _stepTime[mode - 1][speedIndex];
+  }
+  return 0;
+}
+
+/* in ms, for a move over steps from standstill to standstill */
+long MoveTimeModel::predict(long steps, float maxVelocity, float acceleration, float jerk, uint8_t mode) {
+  steps = abs(steps);
+  if (steps == 0 || maxVelocity <= 0 || acceleration <= 0) {
+    return 0;
+  }
+  float velocity = 1000000.0 / (1000000.0 / maxVelocity + overhead(mode, maxVelocity));   //what the stepping mode keeps up with
+
+  float seconds;
+  float rampSteps = velocity * velocity / (2 * acceleration);
+  if (steps >= 2 * rampSteps) {
+    seconds = 2 * velocity / acceleration + (steps - 2 * rampSteps) / velocity;
+  } else {
+    seconds = 2 * sqrt(steps / acceleration);     //never reaches the maximum velocity
+  }
+  /* the planner steps at sqrt(2 a k) on the k-th step of a ramp, which is ahead of the continuous profile,
+     and the move is over with its last step, one interval before the profile comes to rest */
+  seconds += (2 * ZETA_HALF - 1) / sqrt(2 * acceleration);
+  if (jerk > 0) {
+    seconds += acceleration / jerk;               //the acceleration ramps of both phases
+  }
+  if (seconds < 0) {
+    seconds = 0;
+  }
+  return (long)(seconds * 1000 + 0.5);
+}
+
+/* us per step beyond the timer interval at velocity, interpolated between the measured speeds */
+float MoveTimeModel::overhead(uint8_t mode, float velocity) {
+  if (mode < 1 || mode > TIMING_MODES || _stepTime[mode - 1][0] == 0) {
+    return 0;
+  }
+  const uint16_t *measured = _stepTime[mode - 1];
+  float extra[TIMING_SPEED_COUNT];
+  for (uint8_t s = 0; s < TIMING_SPEED_COUNT; s++) {
+    extra[s] = max(measured[s] - 1000000.0 / TIMING_SPEEDS[s], 0.0);
+  }
+  if (velocity <= TIMING_SPEEDS[0]) {
+    return extra[0];
+  }
+  for (uint8_t s = 1; s < TIMING_SPEED_COUNT; s++) {
+    if (velocity <= TIMING_SPEEDS[s]) {
+      float t = (velocity - TIMING_SPEEDS[s - 1]) / (TIMING_SPEEDS[s] - TIMING_SPEEDS[s - 1]);
+      return extra[s - 1] + t * (extra[s] - extra[s - 1]);
+    }
+  }
+  return extra[TIMING_SPEED_COUNT - 1];
+}
+
+/* both in ms, a positive error means the move took longer than predicted */
+void MoveTimeModel::recordError(long predicted, long actual) {
+  long error = actual - predicted;
+  _lastError = error;
+  if (_errorCount < 0xFFFF) {
+    _errorCount++;
+    _errorSum += abs(error);
+  }
+  if ((unsigned long)abs(error) > _maxError) {
+    _maxError = abs(error);
+  }
+}
+
+/* TIMING_ERROR_LAST (signed), TIMING_ERROR_MEAN or TIMING_ERROR_MAX (absolute), in ms */
+long MoveTimeModel::getError(uint8_t which) {
+  switch (which) {
+    case TIMING_ERROR_MEAN:
+      return _errorCount > 0 ? _errorSum / _errorCount : 0;
+    case TIMING_ERROR_MAX:
+      return _maxError;
+    default:
+      return _lastError;
+  }
+}
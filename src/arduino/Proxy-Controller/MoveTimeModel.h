@@ -0,0 +1,44 @@
+/*
+  MoveTimeModel.h - Predicts how long a planned move takes, from step times measured during calibration.
+
+  For every stepping mode, the calibration steps a short burst at each of the TIMING_SPEEDS and stores the
+  time per step that was actually achieved (a MICROSTEP step is 16 transfers to the motor shield, so it
+  cannot keep up with fast rates). A prediction runs the acceleration/jerk limited profile (see
+  MotionPlanner) up to the velocity the stepping mode achieves at the requested one. The error of every
+  prediction against the finished move is recorded.
+*/
+
+#ifndef MoveTimeModel_h
+#define MoveTimeModel_h
+
+#include "Arduino.h"
+
+#define TIMING_MODES 4              //SINGLE, DOUBLE, INTERLEAVE, MICROSTEP
+#define TIMING_SPEED_COUNT 5
+#define TIMING_BURST_STEPS 8        //half of them up, half back down, per mode and speed
+
+#define TIMING_ERROR_LAST 0
+#define TIMING_ERROR_MEAN 1
+#define TIMING_ERROR_MAX 2
+
+class MoveTimeModel
+{
+  public:
+    MoveTimeModel();
+    static uint16_t speed(uint8_t index);
+    void setStepTime(uint8_t mode, uint8_t speedIndex, uint16_t us);
+    uint16_t getStepTime(uint8_t mode, uint8_t speedIndex);
+    long predict(long steps, float maxVelocity, float acceleration, float jerk, uint8_t mode);
+    void recordError(long predicted, long actual);
+    long getError(uint8_t which);
+
+  private:
+    uint16_t _stepTime[TIMING_MODES][TIMING_SPEED_COUNT];   //us per step, 0 = not measured
+    long _lastError;
+    unsigned long _errorSum, _maxError;
+    uint16_t _errorCount;
+
+    float overhead(uint8_t mode, float velocity);
+};
+
+#endif
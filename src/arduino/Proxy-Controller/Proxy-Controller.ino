@@ -7,13 +7,18 @@
  * USED LIBRARIES:
  *    * AccelStepper (Adafruit fork to support MotorShield v2.3 https://github.com/adafruit/AccelStepper
  *    * Adafruit MotorShield v2 Library https://github.com/adafruit/Adafruit_Motor_Shield_V2_Library
- *    * WeeESP8266 Library by itead for the WiFi functionality https://github.com/itead/ITEADLIB_Arduino_WeeESP8266
  *    * Standard Arduino Libraries (SoftwareSerial, ...)
  */
 
 /*-----( Import needed libraries )-----*/
 #include "Proxy.h"
 #include "ProxyControlServer.h"
+#include "EspTransport.h"
+#include "ProxyStats.h"
+#include "ProxyMemory.h"
+#include "TaskScheduler.h"
+#include "Feedback.h"
+#include "Log.h"
 
 
 /*-----( Declare Constants and Pin Numbers )-----*/
@@ -21,11 +26,15 @@
 #define VERSION 17
 #define USE_WIFI true
 #define CONNECT_TO_WIFI true
+#define USE_UDP true                //the datagram endpoint for setpoints and telemetry next to the TCP server (PROTOCOL_UDP_PORT)
 #define ENABLE_BUTTON true
 
 //MOTOR CONTROL                   
 #define motorPort 2
 #define motorStepsPerRevolution 200
+#ifndef secondMotorPort
+  #define secondMotorPort 0         //1 = a second weight axis on motor port #1 (M1 and M2), 0 = none
+#endif
 
 //WIFI
 #define SSID        "WIFINAME1"
@@ -35,48 +44,78 @@
 
 //USER INPUT
 #define buttonPin 2
+#define secondButtonPin 5           //end stop of the second axis
 
 //USER OUTPUT
 #define LEDPin 3
 #define buzzerPin 4
 
+//TASKS of the loop (see TaskScheduler): period and budget per run in us, they run in this order when due
+#define BUTTON_TASK_PERIOD 1000
+#define BUTTON_TASK_BUDGET 1000
+#define NETWORK_TASK_PERIOD 1000
+#define NETWORK_TASK_BUDGET 25000   //room for one reply (an AT+CIPSEND round trip), see SESSION_FRAME_TIME
+#define MOTOR_TASK_PERIOD 1000
+#define MOTOR_TASK_BUDGET 1000
+#define FEEDBACK_TASK_PERIOD 1000
+#define FEEDBACK_TASK_BUDGET 1000
+#define TELEMETRY_TASK_PERIOD 5000
+#define TELEMETRY_TASK_BUDGET 25000 //one sample to a subscriber
+
 
 /*-----( Declare objects )-----*/
 //Declarations of functions passed to other parts of the system
 void beep(int mil);
 void light(int mil);
+//Declarations of helpers (generated by the Arduino IDE, needed by the host build in src/sim)
+void calibrationButton(Proxy &axis);
+void notifyReady();
+void buttonTask();
+void networkTask();
+void motorTask();
+void feedbackTask();
+void telemetryTask();
 
 // NEMA 14: stepper motor with 200 steps per revolution (1.8 degree)
 // connected to motor port #2 (M3 and M4)
-Proxy proxy(motorStepsPerRevolution, motorPort, DOUBLE, ENABLE_BUTTON ? buttonPin : 0, &beep, &light);
+Proxy proxy(motorStepsPerRevolution, motorPort, DOUBLE, buttonPin, &beep, &light);   //the button is also the end stop
+#if secondMotorPort > 0
+Proxy secondProxy(motorStepsPerRevolution, secondMotorPort, DOUBLE, secondButtonPin, &beep, &light);
+#endif
+EspTransport espTransport;          //TARGET PLATFORM: the ESP8266 on the serial port
+ProxyTransport *transport = &espTransport;   //the host build serves a TCP socket instead (see src/sim/host)
 ProxyControlServer server;
 
 
 /*-----( Declare Variables )-----*/
-//none
+bool secondCalibrationPending = secondMotorPort > 0;   //the axes are calibrated one after the other
+unsigned long lastLoop = 0;  //micros(), for the loop period in the stats (see ProxyStats)
 
 void setup()   /****** SETUP: RUNS ONCE ******/
 {
+  ProxyMemory::begin();
   Serial.begin(9600);
-  Serial.println(F("\nProxy-Controller initializing ...\n"));
+  LOG_INFOLN(F("\nProxy-Controller initializing ...\n"));
 
   /* VERSION INFO */
-  Serial.print(F("\tProxy Firmware Version: v"));
-  Serial.println(VERSION);
+  LOG_INFO(F("\tProxy Firmware Version: v"));
+  LOG_INFOLN(VERSION);
   
   /* INIT USER I/O */
-  Serial.println(F("\tUser I/O initializing ..."));
+  LOG_INFOLN(F("\tUser I/O initializing ..."));
   pinMode(buttonPin, INPUT);
+  pinMode(secondButtonPin, INPUT);
         //DEBUG
         //attachInterrupt(digitalPinToInterrupt(buttonPin), onInterrupt, CHANGE);
         //END DEBUG
-  pinMode(LEDPin, OUTPUT);
-  pinMode(buzzerPin, OUTPUT);
-  tone(buzzerPin, 261, 100);
-  Serial.println(F("\tUser I/O initialized!"));
+  Feedback::begin(LEDPin, buzzerPin);
+  Feedback::beep(261, 100);
+  LOG_INFOLN(F("\tUser I/O initialized!"));
 
-  /* INIT MOTOR */
-  proxy.init();
+  /* INIT MOTORS */
+  for(uint8_t id = 0; id < StepScheduler::count(); id++){
+    StepScheduler::get(id)->init();
+  }
   
   /* INIT WIFI */
   if(USE_WIFI){
@@ -86,111 +125,155 @@ void setup()   /****** SETUP: RUNS ONCE ******/
       delay(2000);
     }
     //bool connectWifi = CONNECT_TO_WIFI && !initialPress;
-    String ssid = initialPress ? SSID2 : SSID;
-    String password = initialPress ? PASSWORD2 : PASSWORD;
-    server.init(CONNECT_TO_WIFI, ssid, password, 8090, 7200, &proxy, VERSION, &beep, &light);
+    const __FlashStringHelper *ssid = initialPress ? F(SSID2) : F(SSID);   //in flash, no String on the heap
+    const __FlashStringHelper *password = initialPress ? F(PASSWORD2) : F(PASSWORD);
+    espTransport.init(CONNECT_TO_WIFI, ssid, password, 8090, 7200, &beep);
+    server.init(transport, &proxy, VERSION, &beep, &light);
     server.startServer();
+    if(USE_UDP){
+      server.startDatagrams(PROTOCOL_UDP_PORT);
+    }
   }else{
-    Serial.println(F("\tSkipping WiFi according to configuration"));
+    LOG_INFOLN(F("\tSkipping WiFi according to configuration"));
   }
   
   notifyReady();
-  Serial.println(F("Proxy-Controller initialized!\n\n"));
+  LOG_INFO(F("\tFree SRAM: "));
+  LOG_INFOLN(ProxyMemory::getFree());
+  LOG_INFOLN(F("Proxy-Controller initialized!\n\n"));
 
-  /* START INITIAL CALIBRATION */
-  proxy.calibrationStart();  
+  /* START INITIAL CALIBRATION, unless the one saved before the reset is still valid */
+  if(!proxy.restoreCalibration()){
+    proxy.calibrationStart();
+  }
+  if(secondCalibrationPending){
+    secondCalibrationPending = !secondProxy.restoreCalibration();
+  }
+
+  /* TASKS */
+  TaskScheduler::add(&buttonTask, BUTTON_TASK_PERIOD, BUTTON_TASK_BUDGET);
+  if(USE_WIFI){
+    TaskScheduler::add(&networkTask, NETWORK_TASK_PERIOD, NETWORK_TASK_BUDGET);
+  }
+  TaskScheduler::add(&motorTask, MOTOR_TASK_PERIOD, MOTOR_TASK_BUDGET);
+  TaskScheduler::add(&feedbackTask, FEEDBACK_TASK_PERIOD, FEEDBACK_TASK_BUDGET);
+  if(USE_WIFI){
+    TaskScheduler::add(&telemetryTask, TELEMETRY_TASK_PERIOD, TELEMETRY_TASK_BUDGET);
+  }
 
 }//--(end setup )---
 
 //DEBUG
 void onInterrupt(){
-  Serial.println(analogRead(buttonPin));  
+  LOG_TRACELN(analogRead(buttonPin));  
 }
 //END DEBUG
 
 
 void loop()   /****** LOOP: RUNS CONSTANTLY ******/
 {
-
-  /* USER I/O */
-  if(buttonPressed(buttonPin) && proxy.calibrating() != CALIBRATION_PHASE_NONE){
-    if(proxy.calibrating() == CALIBRATION_PHASE_UP){
-      tone(buzzerPin, 800, 100);
-      delay(500);
-      proxy.calibrationMaximumReached();
-    }else if(proxy.calibrating() == CALIBRATION_PHASE_DOWN){
-      proxy.calibrationMinimumReached();
-      tone(buzzerPin, 800, 100);
-      delay(200);
-      tone(buzzerPin, 800, 100);
-      delay(200);
-      delay(2000);
-    }
+  unsigned long now = micros();
+  if(lastLoop != 0){
+    ProxyStats::record(STATS_LOOP_PERIOD, now - lastLoop);
   }
+  lastLoop = now;
+  TaskScheduler::run();         //the tasks that are due, then waits for the next one
+}//--(end main loop )---
+
+
+
+/*-----( Declare User-written Functions )-----*/
+
+/* USER I/O: the button stops the axis at once, the clients are told by the network task */
+void buttonTask(){
+  calibrationButton(proxy);
   
-  if(ENABLE_BUTTON && proxy.calibrating() == CALIBRATION_PHASE_NONE){
-    int buttonEvent = proxy.getButtonEvent();
-    if(buttonEvent != BUTTON_EVENT_NONE){
+  if(proxy.calibrating() == CALIBRATION_PHASE_NONE){
+    ButtonEvent buttonEvent;    //taken also without ENABLE_BUTTON, so the queue does not fill up
+    if(proxy.getButtonEvent(buttonEvent) && ENABLE_BUTTON){
       proxy.stopNow();
-      server.sendButtonEvent(server.getLastMuxID(), buttonEvent, proxy.getCurrentPosition()); 
+      if(USE_WIFI){
+        server.queueButtonEvent(buttonEvent, proxy.getPosition(buttonEvent.steps));   //to every client subscribed
+      }
       //if(buttonEvent == BUTTON_EVENT_DOWN){
       //  proxy.savePower();
       //}
     }
   }
-  
-  /* WIFI */
-  if(USE_WIFI && !proxy.operating()){
-    server.listenForCommands();
+
+#if secondMotorPort > 0
+  if(secondCalibrationPending && proxy.calibrating() == CALIBRATION_PHASE_NONE){
+    secondCalibrationPending = false;
+    secondProxy.calibrationStart();
   }
+  calibrationButton(secondProxy);
 
-  /* MOTOR */
-  proxy.go();
-  
-}//--(end main loop )---
+  if(secondProxy.calibrating() == CALIBRATION_PHASE_NONE){
+    ButtonEvent buttonEvent;
+    if(secondProxy.getButtonEvent(buttonEvent) && ENABLE_BUTTON){
+      secondProxy.stopNow();    //the button events of the protocol are the first axis'
+    }
+  }
+#endif
+}
 
+/* WIFI: never waits for data, also while moving: steps are timer driven, a new target retargets the move */
+void networkTask(){
+  server.listenForCommands();
+}
 
+/* MOTORS */
+void motorTask(){
+  for(uint8_t id = 0; id < StepScheduler::count(); id++){
+    StepScheduler::get(id)->go();   //finishes a move once the step timer has reached the target
+  }
+}
 
-/*-----( Declare User-written Functions )-----*/
+/* LED and buzzer patterns go on while the loop works */
+void feedbackTask(){
+  Feedback::update();
+}
 
-/* Blinks the LED x times for y millies */
-void blink(int ledPin, int times, int mil){
-  for(int i=0; i<times; i++){
-    digitalWrite(ledPin, HIGH);
-    delay(mil);
-    digitalWrite(ledPin,LOW);
-    delay(mil);
-  }
+/* TELEMETRY: after the motors, so a finished move is reported in the same pass */
+void telemetryTask(){
+  server.sendTelemetry();
 }
 
-bool buttonPressed(int pin){
-  int buttonState = digitalRead(pin);
-  delay(1);
-  int buttonState2 = digitalRead(pin);
-  return buttonState == buttonState2 && buttonState == HIGH;
+/* walks an axis through its calibration with the button at its end stop, at the position where it closed */
+void calibrationButton(Proxy &axis){
+  ButtonEvent buttonEvent;
+  if(axis.calibrating() == CALIBRATION_PHASE_NONE || !axis.getButtonEvent(buttonEvent) || buttonEvent.type != BUTTON_EVENT_UP){
+    return;                     //releases and the presses during the step time bursts are not the end stop's
+  }
+  if(axis.calibrating() == CALIBRATION_PHASE_UP){
+    Feedback::beep(800, 100);
+    axis.calibrationMaximumReached(buttonEvent.steps);
+  }else if(axis.calibrating() == CALIBRATION_PHASE_DOWN){
+    axis.calibrationMinimumReached(buttonEvent.steps);
+    Feedback::beep(800, 100, 100);
+    Feedback::beep(800, 100);
+  }
 }
 
 void notifyReady() {
-  tone(buzzerPin, 261, 100);
-  blink(LEDPin, 3, 100);
-  tone(buzzerPin, 523, 100);
-  delay(100);
-  tone(buzzerPin, 523, 100);
+  Feedback::beep(261, 100, 500);  //the high tones after the blinks
+  Feedback::blink(3, 100);
+  Feedback::beep(523, 200);
 }
 
-//to be passed to other system parts
+//to be passed to other system parts: a beep of mil ms and as long a pause after it, returns at once
 void beep(int mil){
-  tone(buzzerPin, 261, mil);
+  Feedback::beep(261, mil, mil);
 }
 
-//to be passed to other system parts
+//to be passed to other system parts: -1 = off, 0 = on, otherwise one blink of mil ms, returns at once
 void light(int mil){
   if(mil == -1){
-    digitalWrite(LEDPin, LOW);
+    Feedback::light(false);
   }else if(mil == 0){
-    digitalWrite(LEDPin, HIGH);
+    Feedback::light(true);
   }else{
-    blink(LEDPin, 1,mil);
+    Feedback::blink(1, mil);
   }
 }
 
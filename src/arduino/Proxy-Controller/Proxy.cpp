@@ -5,84 +5,173 @@
 
 #include "Arduino.h"
 #include "Proxy.h"
+#include "Log.h"
 
-Proxy *Proxy::_activeProxy;
+
+//AccelStepper calls back without a context, so every axis id has its own pair of functions
+template <uint8_t ID> void Proxy::_forwardStep(){
+  StepScheduler::get(ID)->step(FORWARD);
+}
+
+template <uint8_t ID> void Proxy::_backwardStep(){
+  StepScheduler::get(ID)->step(BACKWARD);
+}
 
 Proxy::Proxy(int stepsPerRevolution, int stepperPort, int stepperMode, int buttonPin, void(*beep)(int), void(*light)(int))
 {
-  Serial.println(F("Creating Proxy object ..."));
+  LOG_INFOLN(F("Creating Proxy object ..."));
 
-  Proxy::_activeProxy = this;
+  _id = StepScheduler::add(this);
+  if(_id >= STEP_SCHEDULER_MAX_AXES){
+    LOG_ERROR(F("ERROR: no stepper port left for another Proxy object, it will not move!\n"));
+  }
   _stepsPerTurn = stepsPerRevolution;
   _currentSpeed = DEFAULT_SPEED;
   _stepperPort = stepperPort;
   _stepperMode = stepperMode;
+  _driver = &_output;
   _operating = false;
-  _maxPosition = 0;
+  setRange(0);
   _calibrationPhase = CALIBRATION_PHASE_NONE;
   _beep = beep;
   _light = light;
   _startTime = 0;
   _endTime = 0;
-  _referenceSpeed = _currentSpeed;
-  _referenceTime = 0;
+  _lastStepTime = 0;
+  _predictedTime = 0;
+  _predictionPending = false;
+  _following = false;
+  _followTarget = 0;
+  _followVelocity = 0;
+  _followTime = 0;
+  _timingCell = 0;
+  _timingStep = 0;
+  _timingStart = 0;
+  _timingMode = stepperMode;
   _buttonPin = buttonPin;
-  _prevButtonState = LOW;
-  _powerOn = true;
+  _counting = false;
+  _powerState = POWER_RELEASED;   //the shield starts with the coils off
+  _holdDelay = POWER_HOLD_DELAY;
+  _releaseDelay = POWER_RELEASE_DELAY;
+  _holdCurrent = POWER_HOLD_CURRENT;
+  _storeDirty = false;
+  _storeMoving = true;
+  _queueRunning = false;
+  _waypointMoving = false;
+  _waypointDwell = 0;
+  _queueStart = 0;
+  _dwellUntil = 0;
+  _planner.setMaxVelocity(_currentSpeed);
 
-  _AFMS = Adafruit_MotorShield();   //default I2C address
-  _adaStepper = _AFMS.getStepper(stepsPerRevolution, stepperPort);
-  _stepper = AccelStepper(_forwardStep, _backwardStep);
+  if(_id == 1){
+    _stepper = AccelStepper(_forwardStep<1>, _backwardStep<1>);
+  }else{                            //without an id it is never stepped
+    _stepper = AccelStepper(_forwardStep<0>, _backwardStep<0>);
+  }
+
+  LOG_INFO(F("Proxy object created as axis "));
+  LOG_INFO(_id);
+  LOG_INFO(F(".\n"));
+}
 
-  Serial.print(F("Proxy object created and set active.\n"));
+/* the driver of the stepper instead of the motor shield's (see StepDriver), before init() */
+void Proxy::setStepDriver(StepDriver *driver){
+  _driver = driver;
 }
 
 void Proxy::init()
 {
-  Serial.println(F("\tInitializing Proxy ..."));
+  LOG_INFOLN(F("\tInitializing Proxy ..."));
 
-  _AFMS.begin();
-  TWBR = ((F_CPU /400000l) - 16) / 2; // Change the i2c clock to 400KHz
-  _stepper.setMaxSpeed(10000.0);
-  //_stepper.setAcceleration(300.0);
-  //_stepper.setSpeed(100.0);
+  _driver->begin(_stepperPort);
+  _button.begin(_buttonPin, this);
+  _stepper.setMaxSpeed(STEP_TIMER_RUN_SPEED);   //acceleration is planned by _planner, see onStepTimer()
   
-  Serial.println(F("\tProxy initialized.\n"));
+  LOG_INFOLN(F("\tProxy initialized.\n"));
+}
+
+uint8_t Proxy::getId(){
+  return _id;
+}
+
+/* takes over the calibration, settings and position saved before the reset (see CalibrationStore).
+   false, and nothing changed, without a valid record: the axis needs calibrationStart() then. */
+bool Proxy::restoreCalibration(){
+  CalibrationData data;
+  if(!CalibrationStore::load(_id, data) || data.maxPosition <= 0){
+    LOG_INFOLN(F("[Calibration]--> No valid calibration saved."));
+    return false;
+  }
+  setRange(data.maxPosition);
+  STEPPER_LOCK();
+  _stepper.setCurrentPosition(data.position);
+  STEPPER_UNLOCK();
+  _stepperMode = data.stepperMode;
+  setCurrentSpeed(data.speed);
+  setAcceleration(data.acceleration);
+  setJerk(data.jerk);
+  setHoldDelay(data.holdDelay);
+  setReleaseDelay(data.releaseDelay);
+  setHoldCurrent(data.holdCurrent);
+  for(uint8_t m = 0; m < TIMING_MODES; m++){
+    for(uint8_t s = 0; s < TIMING_SPEED_COUNT; s++){
+      _timeModel.setStepTime(SINGLE + m, s, data.stepTime[m][s]);
+    }
+  }
+  _storeDirty = false;
+  _storeMoving = false;
+  LOG_INFO(F("[Calibration]--> Calibration restored, position "));
+  LOG_INFOLN(getCurrentPosition());
+  return true;
+}
+
+bool Proxy::isCalibrated(){
+  return _maxPosition > 0 && _calibrationPhase == CALIBRATION_PHASE_NONE;
 }
 
 void Proxy::calibrationStart(){
-  if(!_operating){
-    Serial.println(F("[Calibration]--> Proxy object calibration starts..."));
+  if(_calibrationPhase == CALIBRATION_PHASE_NONE){
+    if(_operating)
+      stopNow();    //commands also arrive while moving
+    LOG_INFOLN(F("[Calibration]--> Proxy object calibration starts..."));
+    _following = false;
     _calibrationPhase = CALIBRATION_PHASE_UP;
-    _maxPosition = 0;
-    _stepper.setSpeed(_currentSpeed);
-    _referenceSpeed = _currentSpeed;
+    setRange(0);
     startOperating();
   }
 }
 
-void Proxy::calibrationMaximumReached(){
+/* steps: the position at the moment the end stop closed (see ButtonEvent), the top from now on */
+void Proxy::calibrationMaximumReached(long steps){
   if(_operating){
-    _stepper.setSpeed(0);
-    _stepper.setCurrentPosition(0);
-    _calibrationPhase = CALIBRATION_PHASE_DOWN;
-    _stepper.setSpeed(-_currentSpeed);
-    Serial.println(F("[Calibration]--> Proxy object reached maximum position."));
+    STEPPER_LOCK();
+    _stepper.setCurrentPosition(_stepper.currentPosition() - steps);   //the steps made since are above the top
+    _calibrationPhase = CALIBRATION_PHASE_DOWN;   //the step timer now runs downwards
+    _planner.reset();                             //the weight rests at the top, it does not brake first
+    STEPPER_UNLOCK();
+    _button.ignoreRelease();
+    LOG_INFOLN(F("[Calibration]--> Proxy object reached maximum position."));
     _startTime = millis();
   }
 }
 
-void Proxy::calibrationMinimumReached(){
+/* steps: the position at the moment the end stop closed, the bottom from now on */
+void Proxy::calibrationMinimumReached(long steps){
   if(_operating){
     _endTime = millis();
-    _referenceTime = _endTime - _startTime;
-    _stepper.setSpeed(0);
-    _maxPosition = -_stepper.currentPosition();
-    _stepper.setCurrentPosition(0);
-    _stepper.moveTo(0);   //new
-    _calibrationPhase = CALIBRATION_PHASE_NONE;
-    stopOperating();
-    Serial.println(F("[Calibration]--> Proxy object is calibrated!"));
+    STEPPER_LOCK();
+    setRange(-steps);
+    _stepper.setCurrentPosition(_stepper.currentPosition() - steps);
+    _stepper.moveTo(_stepper.currentPosition());   //new
+    _planner.reset();
+    _timingCell = 0;
+    _timingStep = 0;
+    _timingMode = _stepperMode;
+    _calibrationPhase = CALIBRATION_PHASE_TIMING;   //the step timer finishes with the bursts and stops there
+    STEPPER_UNLOCK();
+    _storeDirty = true;
+    _button.ignoreRelease();    //the press on the end stop is the calibration's, not a user's
+    LOG_INFOLN(F("[Calibration]--> Proxy object is calibrated! Measuring step times ..."));
   }
 }
 
@@ -90,109 +179,398 @@ int Proxy::calibrating(){
   return _calibrationPhase;
 }
 
-/* pos in [0,1] after calibration */
-void Proxy::setTargetPosition(float pos)
+/* pos in [0,1] after calibration; scale < 1 slows this move down as a whole (see StepScheduler::moveTogether) */
+void Proxy::setTargetPosition(float pos, float scale)
+{
+  setTargetSteps(stepsFromPosition(pos), scale);
+}
+
+/* target in steps, 0 .. getRange() after calibration */
+void Proxy::setTargetSteps(long target, float scale)
 {
   //CW = HOCH (-)
   //CCW = RUNTER (+)
   
-   long target = pos * _maxPosition;
-   if(target != _stepper.currentPosition()){
-      _stepper.moveTo(target);
+   if(target != currentSteps() || _operating){   //a running move is retargeted, the step timer keeps going
+     _predictedTime = getExpectedTimeToSteps(target, scale);
+     _predictionPending = true;
+     _startTime = millis();   //before the step timer starts, slow steps may keep the loop away until the move is done
+     STEPPER_LOCK();
+     _waypoints.clear();          //a target of its own ends the waypoint queue and follow mode
+     _queueRunning = false;
+     _following = false;
+     _planner.setMaxVelocity(_currentSpeed);
+     _planner.setScale(scale);
+     _stepper.moveTo(target);
+     STEPPER_UNLOCK();
      startOperating();
-     Serial.print(F("Set target to "));
-     Serial.print(target);
-     Serial.print(F("\n"));
+     LOG_TRACE(F("Set target to "));
+     LOG_TRACE(target);
+     LOG_TRACE(F("\n"));
      if(_beep != NULL)
         _beep(100);
-     Serial.print(F("Expected time (ms) = "));
-     Serial.println(getExpectedTimeTo(pos));
-     _startTime = millis();
+     LOG_TRACE(F("Expected time (ms) = "));
+     LOG_TRACELN(_predictedTime);
    } 
 }
 
+/* maximum velocity in steps/s, a running move adapts with its next step (a waypoint with a speed of its own does not) */
 void Proxy::setCurrentSpeed(int velo){
-  _currentSpeed = velo;
+  _currentSpeed = constrain(velo, 1, STEP_TIMER_MAX_RATE);
+  STEPPER_LOCK();
+  if(!_queueRunning){
+    _planner.setMaxVelocity(_currentSpeed);
+  }
+  STEPPER_UNLOCK();
+  _storeDirty = true;
 }
 
 int Proxy::getCurrentSpeed(){
   return _currentSpeed;
 }
 
+/* in steps/s^2 */
+void Proxy::setAcceleration(float acceleration){
+  STEPPER_LOCK();
+  _planner.setAcceleration(acceleration);
+  STEPPER_UNLOCK();
+  _storeDirty = true;
+}
+
+float Proxy::getAcceleration(){
+  return _planner.getAcceleration();
+}
+
+/* in steps/s^3, 0 = trapezoidal profiles */
+void Proxy::setJerk(float jerk){
+  STEPPER_LOCK();
+  _planner.setJerk(jerk);
+  STEPPER_UNLOCK();
+  _storeDirty = true;
+}
+
+float Proxy::getJerk(){
+  return _planner.getJerk();
+}
+
 float Proxy::getCurrentPosition(){
-  return ((float)_stepper.currentPosition() / (float)_maxPosition);
+  return currentSteps() * _positionPerStep;
+}
+
+long Proxy::getCurrentSteps(){
+  return currentSteps();
+}
+
+/* a step position in [0,1] */
+float Proxy::getPosition(long steps){
+  return steps * _positionPerStep;
+}
+
+/* steps from position 0 to 1, 0 until calibrated */
+long Proxy::getRange(){
+  return _maxPosition;
+}
+
+/* the float positions of the protocol in steps, rounded to the nearest */
+long Proxy::stepsFromPosition(float pos){
+  return lround(pos * _maxPosition);
+}
+
+/* a Q16 fraction of the range in steps and back, without float math or a divide (see setRange()) */
+long Proxy::stepsFromQ16(long fraction){
+  return ((int64_t)fraction * _maxPosition + (1L << (POSITION_Q16_SHIFT - 1))) >> POSITION_Q16_SHIFT;
+}
+
+long Proxy::q16FromSteps(long steps){
+  return ((int64_t)steps * _q16PerStep + (1L << (POSITION_Q16_SHIFT - 1))) >> POSITION_Q16_SHIFT;
 }
 
+/* in [0,1] per second while moving to a target, negative towards 0 */
+float Proxy::getCurrentVelocity(){
+  if(!_operating || _calibrationPhase != CALIBRATION_PHASE_NONE || _maxPosition == 0){
+    return 0;
+  }
+  STEPPER_LOCK();
+  float velocity = _planner.getVelocity();
+  STEPPER_UNLOCK();
+  return velocity * _positionPerStep;
+}
+
+/* passing the target while braking for it does not count */
 bool Proxy::isTargetReached(){
-  return _stepper.distanceToGo() == 0;
+  STEPPER_LOCK();
+  bool reached = _stepper.distanceToGo() == 0 && _planner.getVelocity() == 0;
+  STEPPER_UNLOCK();
+  return reached;
+}
+
+/* in ms from standstill, with the step times measured for the current stepping mode */
+long Proxy::getExpectedTimeTo(float pos, float scale){
+  return getExpectedTimeToSteps(stepsFromPosition(pos), scale);
 }
 
-long Proxy::getExpectedTimeTo(float pos){
-  return (((float)_referenceSpeed / (float) _currentSpeed) * _referenceTime) * abs(pos - getCurrentPosition());
+long Proxy::getExpectedTimeToSteps(long target, float scale){
+  long steps = target - currentSteps();
+  return _timeModel.predict(steps, _currentSpeed * scale, _planner.getAcceleration() * scale, _planner.getJerk() * scale, _stepperMode);
 }
 
+/* TIMING_ERROR_LAST, TIMING_ERROR_MEAN or TIMING_ERROR_MAX of the predictions so far, in ms */
+long Proxy::getPredictionError(uint8_t which){
+  return _timeModel.getError(which);
+}
+
+/* debounced, -1 without a button */
 int Proxy::getCurrentButtonState(){
-  if(_buttonPin <= 0){
-    return -1;
-  }else{
-    return digitalRead(_buttonPin);
-  }
+  return _button.getState();
 }
 
-int Proxy::getButtonEvent(){
-  if(_buttonPin <= 0){
-    return BUTTON_EVENT_NONE;
-  }else{
-    int currentState = getCurrentButtonState();
-    if(_prevButtonState != currentState){
-      _prevButtonState = currentState;
-      if(currentState == LOW){
-        return BUTTON_EVENT_DOWN;
-      }else{
-        return BUTTON_EVENT_UP;
-      }
-    }else{
-      return BUTTON_EVENT_NONE;
-    }
+/* the next button change, with its time and the position of the axis when it happened */
+bool Proxy::getButtonEvent(ButtonEvent &event){
+  _button.update();
+  return _button.next(event);
+}
+
+/* an event is waiting, caught by the interrupt */
+bool Proxy::hasButtonEvent(){
+  return _button.pending();
+}
+
+/* the step position for an edge of the button, from its interrupt. false while the step timer ISR is counting
+   a step: the button gets the position from countStep() then. */
+bool Proxy::latchSteps(long &steps){
+  if(_counting){
+    return false;
   }
+  steps = _stepper.currentPosition();
+  return true;
 }
 
+/* without braking, for a move that ends regularly the planner has brought the weight to rest already */
 void Proxy::stopNow(){
+  STEPPER_LOCK();
   _stepper.moveTo(_stepper.currentPosition());
+  _planner.reset();
+  _planner.setScale(1);
+  _planner.setMaxVelocity(_currentSpeed);   //waypoints have their own
+  _waypoints.clear();
+  _queueRunning = false;
+  STEPPER_UNLOCK();
+  _predictionPending = false;
   _endTime = millis();
-  Serial.print(F("Measured time (ms) = "));
-  Serial.println(_endTime - _startTime);
+  LOG_TRACE(F("Measured time (ms) = "));
+  LOG_TRACELN(_endTime - _startTime);
   stopOperating();
 }
 
 void Proxy::savePower(){
   stopNow();
-  _adaStepper->release();
-  _powerOn = false;
+  setPowerState(POWER_RELEASED);
   if(_light)
     _light(-1);   //means lights off
-  Serial.println(F("Motor power off!"));
+  LOG_INFOLN(F("Motor power off!"));
+}
+
+/* POWER_FULL while moving and for the hold delay after, then POWER_HOLD until the release delay has passed too (see
+   go()), or POWER_RELEASED after savePower(). The next move starts at the stepping current again. */
+uint8_t Proxy::getPowerState(){
+  return _powerState;
+}
+
+/* ms at rest before the coils go down to the hold current, 0 = never */
+void Proxy::setHoldDelay(long delay){
+  _holdDelay = max(delay, 0L);
+  _storeDirty = true;
+}
+
+long Proxy::getHoldDelay(){
+  return _holdDelay;
+}
+
+/* ms at rest before the coils are released, 0 = never. The position is kept as counted: the weight must not turn the
+   motor by two full steps or more meanwhile (see setPowerState()). */
+void Proxy::setReleaseDelay(long delay){
+  _releaseDelay = max(delay, 0L);
+  _storeDirty = true;
+}
+
+long Proxy::getReleaseDelay(){
+  return _releaseDelay;
+}
+
+/* % of the stepping current, 1 .. 100; an axis holding already changes with it */
+void Proxy::setHoldCurrent(int percent){
+  _holdCurrent = constrain(percent, 1, 100);
+  _storeDirty = true;
+  if(_powerState == POWER_HOLD){
+    STEPPER_LOCK();
+    _driver->hold(_holdCurrent);
+    STEPPER_UNLOCK();
+  }
+}
+
+int Proxy::getHoldCurrent(){
+  return _holdCurrent;
+}
+
+/* the coils on the step the axis counts at the current of state. From POWER_RELEASED to a current, the rotor is pulled
+   back onto that step, the micro-move that makes up for a weight that turned it a little while released. */
+void Proxy::setPowerState(uint8_t state){
+  if(state == _powerState){
+    return;
+  }
+  STEPPER_LOCK();               //the shield is the step timer's while another axis is stepping
+  if(state == POWER_RELEASED){
+    _driver->release();
+  }else{
+    _driver->hold(state == POWER_HOLD ? _holdCurrent : 100);
+  }
+  STEPPER_UNLOCK();
+  _powerState = state;
 }
 
 void Proxy::setStepperMode(int mode){
   _stepperMode = mode;
+  _storeDirty = true;
+}
+
+/* appends a waypoint, the step timer moves through the queue without the loop in between. An axis at rest
+   starts with it right away, which is when the start times of the waypoints count from; a running move is
+   finished first. false if the queue is full or the axis is calibrating. */
+bool Proxy::addWaypoint(const Waypoint &waypoint){
+  if(_calibrationPhase != CALIBRATION_PHASE_NONE){
+    return false;
+  }
+  STEPPER_LOCK();
+  bool added = _waypoints.push(waypoint);
+  if(added){
+    _following = false;
+  }
+  if(added && !_queueRunning){
+    _queueRunning = true;
+    _waypointMoving = false;
+    _queueStart = millis();
+    _dwellUntil = _queueStart;
+  }
+  STEPPER_UNLOCK();
+  if(added){
+    _predictionPending = false;   //a running move no longer ends on its own
+    if(!_operating){
+      _startTime = millis();
+    }
+    startOperating();             //the step timer goes on if it is running
+  }
+  return added;
+}
+
+/* drops the waypoints not yet started, the axis still goes to the one it is on the way to */
+void Proxy::clearWaypoints(){
+  STEPPER_LOCK();
+  _waypoints.clear();
+  STEPPER_UNLOCK();
+}
+
+uint8_t Proxy::getWaypointCount(){
+  return _waypoints.count();
+}
+
+uint8_t Proxy::getWaypointSpace(){
+  return _waypoints.free();
+}
+
+/* follow mode: the axis tracks the newest setpoint (see setSetpoint()) within its velocity and acceleration limits
+   (see MotionPlanner::follow()), retargeted with the next step, without a prediction, a reply or feedback per setpoint. A target (command 1) or a waypoint
+   ends it. false if the axis is not calibrated. */
+bool Proxy::follow(bool on){
+  if(on && !isCalibrated()){
+    return false;
+  }
+  STEPPER_LOCK();
+  if(on && !_following){
+    _waypoints.clear();
+    _queueRunning = false;
+    _planner.setScale(1);
+    _planner.setMaxVelocity(_currentSpeed);
+    _followTarget = _stepper.targetPosition();
+    _followVelocity = 0;
+  }
+  _following = on;              //off: the axis finishes at the setpoint it heads for
+  STEPPER_UNLOCK();
+  return true;
 }
 
+bool Proxy::isFollowing(){
+  return _following;
+}
+
+/* target in steps (held within the range), velocity in steps/s: the setpoint moves on with it for up to
+   FOLLOW_MAX_EXTRAPOLATION ms, until the next one comes. Replaces the setpoint before, false outside follow mode. */
+bool Proxy::setSetpoint(long target, long velocity){
+  if(!_following){
+    return false;
+  }
+  STEPPER_LOCK();
+  _followTarget = constrain(target, 0, _maxPosition);
+  _followVelocity = velocity;
+  _followTime = millis();
+  _stepper.moveTo(_followTarget);
+  STEPPER_UNLOCK();
+  _predictionPending = false;
+  if(!_operating){
+    _startTime = _followTime;
+    startOperating();
+  }else{
+    startStepTimer();           //the step timer stops where the axis caught up with the setpoint before
+  }
+  return true;
+}
+
+/* the steps are made by the step timer (see onStepTimer), the loop only finishes a move */
 void Proxy::go(){
-  if(_calibrationPhase != CALIBRATION_PHASE_NONE){    //DIRECTIONAL MOVEMENT IN CALIBRATION
-    _stepper.runSpeed();
-  }else{                                              //TARGET BASED MOVEMENT IN NORMAL OPERATOIN
-    if(_stepper.distanceToGo() != 0){
-      _stepper.setSpeed(_stepper.distanceToGo() < 0 ? -_currentSpeed : _currentSpeed);
-      _stepper.runSpeedToPosition();
-      //_stepper.runToPosition();
-    }else if(_operating){
-      //_endTime = millis();
-      //Serial.print(F("Measured time (ms) = "));
-      //Serial.println(_endTime - _startTime);
-      //stopOperating();
-      stopNow();
+  if(_calibrationPhase == CALIBRATION_PHASE_NONE && _operating && !_queueRunning && !extrapolating() && isTargetReached()){
+    if(_predictionPending){
+      _timeModel.recordError(_predictedTime, _lastStepTime - _startTime);
+      LOG_TRACE(F("Prediction error (ms) = "));
+      LOG_TRACELN(_timeModel.getError(TIMING_ERROR_LAST));
     }
+    stopNow();
+  }
+  if(!_operating && _calibrationPhase == CALIBRATION_PHASE_NONE && _powerState != POWER_RELEASED){
+    unsigned long idle = millis() - _endTime;
+    if(_releaseDelay > 0 && idle >= (unsigned long)_releaseDelay){
+      setPowerState(POWER_RELEASED);
+      if(_light)
+        _light(-1);
+    }else if(_powerState == POWER_FULL && _holdDelay > 0 && idle >= (unsigned long)_holdDelay){
+      setPowerState(POWER_HOLD);
+    }
+  }
+  if((_storeDirty || _storeMoving) && !_operating && isCalibrated() && millis() - _endTime >= CALIBRATION_SAVE_DELAY){
+    saveCalibration();
+  }
+}
+
+/* writes calibration, settings and position at rest to EEPROM, a byte per call (see CalibrationStore) */
+void Proxy::saveCalibration(){
+  CalibrationData data;
+  memset(&data, 0, sizeof(data));   //padding on other targets, the checksum covers it
+  data.maxPosition = _maxPosition;
+  data.position = currentSteps();
+  data.stepperMode = _stepperMode;
+  data.speed = _currentSpeed;
+  data.acceleration = _planner.getAcceleration();
+  data.jerk = _planner.getJerk();
+  data.holdDelay = _holdDelay;
+  data.releaseDelay = _releaseDelay;
+  data.holdCurrent = _holdCurrent;
+  for(uint8_t m = 0; m < TIMING_MODES; m++){
+    for(uint8_t s = 0; s < TIMING_SPEED_COUNT; s++){
+      data.stepTime[m][s] = _timeModel.getStepTime(SINGLE + m, s);
+    }
+  }
+  if(CalibrationStore::save(_id, data)){
+    _storeDirty = false;
+    _storeMoving = false;
+    LOG_TRACELN(F("Calibration saved."));
   }
 }
 
@@ -202,36 +580,181 @@ bool Proxy::operating(){
 
 void Proxy::startOperating(){
   _operating = true;
-  _powerOn = true;
+  setPowerState(POWER_FULL);    //before the first step
   if(_light)
     _light(0);    //means always light up
+  startStepTimer();
+  if(!_storeMoving){            //the weight leaves the position on record
+    CalibrationStore::setMoving(_id);
+    _storeMoving = true;
+  }
   //Serial.println("\t\t--> Proxy operating true");
 }
 
 void Proxy::stopOperating(){
   _operating = false;
+  stopStepTimer();
   //Serial.println("\t\t--> Proxy operating false");
 }
 
-void Proxy::_forwardStep(){
-  Proxy::_activeProxy->_adaStepper->onestep(FORWARD, Proxy::_activeProxy->_stepperMode);
-  if(Proxy::_activeProxy->_stepperMode == MICROSTEP){   //16 micro steps = 1 normal step
-    for(int i=0; i< 15; i++){
-      Proxy::_activeProxy->_adaStepper->onestep(FORWARD, Proxy::_activeProxy->_stepperMode);
+long Proxy::currentSteps(){
+  STEPPER_LOCK();
+  long steps = _stepper.currentPosition();
+  STEPPER_UNLOCK();
+  return steps;
+}
+
+long Proxy::stepsToGo(){
+  STEPPER_LOCK();
+  long steps = _stepper.distanceToGo();
+  STEPPER_UNLOCK();
+  return steps;
+}
+
+/* the range the calibration measured, with the factors the conversions of positions multiply by, so that the
+   requests do not divide (it is done once here) */
+void Proxy::setRange(long steps){
+  _maxPosition = steps;
+  _positionPerStep = steps > 0 ? 1.0 / steps : 0;
+  _q16PerStep = steps > 1 ? (uint32_t)(((uint64_t)1 << 32) / steps) : 0;
+}
+
+/* the StepScheduler makes the steps on the shared step timer, see onStepTimer() */
+void Proxy::startStepTimer(){
+  if(StepScheduler::stepping(_id)){   //already stepping, e.g. on a new target
+    return;
+  }
+  _planner.reset();
+  StepScheduler::start(_id);
+}
+
+void Proxy::stopStepTimer(){
+  StepScheduler::stop(_id);
+}
+
+/* one step of this axis when it is due on the step timer: towards the target (or in calibration direction) at
+   the velocity the planner allows. Returns the rate (steps/s) to the next step, 0 once the axis stops.
+   Runs in the step timer ISR with interrupts enabled, as the I2C transfer to the motor shield needs them. */
+float Proxy::onStepTimer(){
+  if(_calibrationPhase == CALIBRATION_PHASE_TIMING){
+    return timingStep();
+  }
+  long stepsToGo;
+  if(_calibrationPhase != CALIBRATION_PHASE_NONE){   //towards the end stop, which is not known yet
+    stepsToGo = _calibrationPhase == CALIBRATION_PHASE_UP ? 0x3FFFFFFFL : -0x3FFFFFFFL;
+  }else{
+    stepsToGo = _stepper.distanceToGo();
+  }
+  float velocity;
+  if(_following && _calibrationPhase == CALIBRATION_PHASE_NONE){
+    bool moving = extrapolating();
+    if(moving){
+      _stepper.moveTo(followTarget());
     }
-  }else if(Proxy::_activeProxy->_stepperMode == INTERLEAVE){  //2 interleaved steps = 1 normal step
-      Proxy::_activeProxy->_adaStepper->onestep(FORWARD, Proxy::_activeProxy->_stepperMode);
+    velocity = _planner.follow(_stepper.distanceToGo(), moving ? _followVelocity : 0);
+  }else{
+    velocity = _planner.next(stepsToGo);
+  }
+  if(velocity == 0 && _queueRunning && _calibrationPhase == CALIBRATION_PHASE_NONE){
+    float wait = nextWaypoint();
+    velocity = wait > 0 ? 0 : _planner.next(_stepper.distanceToGo());
+    if(velocity == 0){          //resting, at the end of the queue, or already at the next waypoint
+      return wait > 0 || !_queueRunning ? wait : STEP_TIMER_MAX_RATE;
+    }
+  }
+  if(velocity == 0){
+    return extrapolating() ? FOLLOW_CHECK_RATE : 0;   //target reached, or caught up with a setpoint on the move
+  }
+  _stepper.setSpeed(velocity > 0 ? STEP_TIMER_RUN_SPEED : -STEP_TIMER_RUN_SPEED);   //timing is the timer's, AccelStepper only counts
+  countStep();
+  _lastStepTime = millis();
+  return fabs(velocity);
+}
+
+/* in the step timer ISR when the axis has come to rest with the queue running: rests at the waypoint reached
+   for its dwell, waits for the start time of the next one and then heads for it. Returns the rate (1/s) to be
+   called again at while waiting, 0 once on the way or when the queue has run empty (_queueRunning is cleared). */
+float Proxy::nextWaypoint(){
+  unsigned long now = millis();
+  if(_waypointMoving){          //arrived
+    _waypointMoving = false;
+    _dwellUntil = now + _waypointDwell;
+  }
+  long wait = (long)(_dwellUntil - now);
+  Waypoint waypoint;
+  bool next = _waypoints.peek(waypoint);
+  if(next && waypoint.startAt > 0){
+    wait = max(wait, (long)(_queueStart + waypoint.startAt - now));
+  }
+  if(wait > 0){
+    return 1000.0 / wait;       //longer waits than a second are checked again after one
+  }
+  if(!next){
+    _queueRunning = false;
+    return 0;
   }
+  _waypoints.pop();
+  _waypointMoving = true;
+  _waypointDwell = waypoint.dwell;
+  _planner.setScale(1);
+  _planner.setMaxVelocity(waypoint.speed > 0 ? waypoint.speed : _currentSpeed);
+  _stepper.moveTo(waypoint.position);
+  return 0;
 }
 
-void Proxy::_backwardStep(){
-  Proxy::_activeProxy->_adaStepper->onestep(BACKWARD, Proxy::_activeProxy->_stepperMode);
-  if(Proxy::_activeProxy->_stepperMode == MICROSTEP){
+/* the setpoint moved on with its velocity for the time since it came, within the range */
+long Proxy::followTarget(){
+  unsigned long elapsed = min(millis() - _followTime, (unsigned long)FOLLOW_MAX_EXTRAPOLATION);
+  long target = _followTarget + lround(_followVelocity * elapsed * 0.001);
+  return constrain(target, 0, _maxPosition);
+}
+
+/* the setpoint is still moving on, the axis must not stop at the target it has reached */
+bool Proxy::extrapolating(){
+  return _following && _followVelocity != 0 && millis() - _followTime < FOLLOW_MAX_EXTRAPOLATION;
+}
+
+/* one step of the calibration bursts: for every stepping mode and speed of the MoveTimeModel, half a burst up
+   from the bottom and back, timed from its first to its last step. Returns the rate to the next step, 0 once
+   all are measured. */
+float Proxy::timingStep(){
+  if(_timingCell >= TIMING_MODES * TIMING_SPEED_COUNT){
+    _stepperMode = _timingMode;
+    _calibrationPhase = CALIBRATION_PHASE_NONE;
+    return 0;
+  }
+  uint8_t mode = SINGLE + _timingCell / TIMING_SPEED_COUNT;
+  _stepperMode = mode;
+  if(_timingStep == 0){
+    _timingStart = micros();
+  }else if(_timingStep == TIMING_BURST_STEPS - 1){
+    _timeModel.setStepTime(mode, _timingCell % TIMING_SPEED_COUNT, (micros() - _timingStart) / (TIMING_BURST_STEPS - 1));
+  }
+  _stepper.setSpeed(_timingStep < TIMING_BURST_STEPS / 2 ? STEP_TIMER_RUN_SPEED : -STEP_TIMER_RUN_SPEED);
+  countStep();
+  if(++_timingStep == TIMING_BURST_STEPS){
+    _timingStep = 0;
+    _timingCell++;
+  }
+  return MoveTimeModel::speed(_timingCell % TIMING_SPEED_COUNT);
+}
+
+/* a step from the step timer ISR. The button interrupt may come while AccelStepper changes the position, which
+   is then latched right after. */
+void Proxy::countStep(){
+  _counting = true;
+  _stepper.runSpeed();
+  _counting = false;
+  _button.latch(_stepper.currentPosition());
+}
+
+void Proxy::step(uint8_t dir){
+  _driver->onestep(dir, _stepperMode);
+  if(_stepperMode == MICROSTEP){   //16 micro steps = 1 normal step
     for(int i=0; i< 15; i++){
-      Proxy::_activeProxy->_adaStepper->onestep(BACKWARD, Proxy::_activeProxy->_stepperMode);
+      _driver->onestep(dir, _stepperMode);
     }
-  }else if(Proxy::_activeProxy->_stepperMode == INTERLEAVE){
-      Proxy::_activeProxy->_adaStepper->onestep(BACKWARD, Proxy::_activeProxy->_stepperMode);
+  }else if(_stepperMode == INTERLEAVE){  //2 interleaved steps = 1 normal step
+      _driver->onestep(dir, _stepperMode);
   }
 }
-
@@ -9,8 +9,21 @@
 #define CALIBRATION_PHASE_NONE 0
 #define CALIBRATION_PHASE_UP 1
 #define CALIBRATION_PHASE_DOWN 2
+#define CALIBRATION_PHASE_TIMING 3   //step bursts at the bottom to measure the step times, see MoveTimeModel
 
 #define DEFAULT_SPEED 500
+#define POSITION_Q16_SHIFT 16        //Q16 fractions of the range: 1 << 16 = position 1
+#define FOLLOW_MAX_EXTRAPOLATION 100  //ms a setpoint is moved on with its velocity, the axis holds there until the next one
+#define FOLLOW_CHECK_RATE 100         //Hz the step timer checks the extrapolated setpoint at while the axis has caught up
+#define CALIBRATION_SAVE_DELAY 3000  //ms at rest before position and settings are saved, a burst of moves is saved once
+
+//POWER states of the coils, see getPowerState()
+#define POWER_FULL 0                  //the stepping current: moving, and at rest for the hold delay
+#define POWER_HOLD 1                  //at rest: the hold current (a percentage of the stepping current)
+#define POWER_RELEASED 2              //no current, the weight is not held
+#define POWER_HOLD_DELAY 2000         //ms at rest before the hold current, 0 = never
+#define POWER_RELEASE_DELAY 0         //ms at rest before the coils are released, 0 = never
+#define POWER_HOLD_CURRENT 50         //% of the stepping current, the heat goes with its square
 
 #include "Arduino.h"
 #include <AccelStepper.h>
@@ -18,45 +31,111 @@
 #include <Adafruit_MotorShield.h>
 #include "utility/Adafruit_MS_PWMServoDriver.h"
 #include "Button.h"
+#include "MotionPlanner.h"
+#include "MoveTimeModel.h"
+#include "StepOutput.h"
+#include "StepScheduler.h"
+#include "WaypointQueue.h"
+#include "CalibrationStore.h"
 
 class Proxy
 {
   public:
     Proxy(int stepsPerRevolution, int stepperPort, int stepperMode, int buttonPin = 0, void (*beep)(int)= NULL, void (*light)(int) = NULL);
+    void setStepDriver(StepDriver *driver);
     void init();
+    uint8_t getId();
+    bool restoreCalibration();
+    bool isCalibrated();
     void calibrationStart();
-    void calibrationMaximumReached();
-    void calibrationMinimumReached();
+    void calibrationMaximumReached(long steps);
+    void calibrationMinimumReached(long steps);
     int calibrating();
-    void setTargetPosition(float pos);
+    void setTargetPosition(float pos, float scale = 1);
+    void setTargetSteps(long target, float scale = 1);
     void setCurrentSpeed(int velo);
     int getCurrentSpeed();
+    void setAcceleration(float acceleration);
+    float getAcceleration();
+    void setJerk(float jerk);
+    float getJerk();
     void go();
     bool operating();
     float getCurrentPosition();
+    long getCurrentSteps();
+    float getPosition(long steps);
+    long getRange();
+    long stepsFromPosition(float pos);
+    long stepsFromQ16(long fraction);
+    long q16FromSteps(long steps);
+    float getCurrentVelocity();
     bool isTargetReached();
-    long getExpectedTimeTo(float pos);
+    long getExpectedTimeTo(float pos, float scale = 1);
+    long getExpectedTimeToSteps(long target, float scale = 1);
+    long getPredictionError(uint8_t which);
     int getCurrentButtonState();
-    int getButtonEvent();
+    bool getButtonEvent(ButtonEvent &event);
+    bool hasButtonEvent();
+    bool latchSteps(long &steps);
     void stopNow();
     void savePower();
+    uint8_t getPowerState();
+    void setHoldDelay(long delay);
+    long getHoldDelay();
+    void setReleaseDelay(long delay);
+    long getReleaseDelay();
+    void setHoldCurrent(int percent);
+    int getHoldCurrent();
     void setStepperMode(int mode);
+    bool addWaypoint(const Waypoint &waypoint);
+    void clearWaypoints();
+    uint8_t getWaypointCount();
+    uint8_t getWaypointSpace();
+    bool follow(bool on);
+    bool isFollowing();
+    bool setSetpoint(long target, long velocity = 0);
+    float onStepTimer();
     
   private:
+    uint8_t _id;                  //of the axis, see StepScheduler
     unsigned long _startTime, _endTime;
-    unsigned long _referenceTime;
-    int _referenceSpeed;
-    void (*_beep)(int);
+    volatile unsigned long _lastStepTime;
+    long _predictedTime;
+    bool _predictionPending;      //a move to a target is running, its duration is compared to _predictedTime
+    void (*_beep)(int);           //return at once, the patterns play from Feedback::update()
     void (*_light)(int);
-    int _stepperPort, _stepperMode;
+    int _stepperPort;
+    volatile int _stepperMode;
     bool _operating;
-    long _maxPosition;
-    int _currentSpeed;
-    int _calibrationPhase;
-    int _buttonPin, _prevButtonState;
-    bool _powerOn;
-    Adafruit_MotorShield _AFMS;
-    Adafruit_StepperMotor *_adaStepper;
+    long _maxPosition;            //steps from position 0 to 1, see setRange()
+    float _positionPerStep;       //1 / _maxPosition
+    uint32_t _q16PerStep;         //2^32 / _maxPosition
+    int _currentSpeed;            //maximum velocity of the planned moves, steps/s
+    MotionPlanner _planner;       //used by the step timer ISR, lock the stepper to change it
+    MoveTimeModel _timeModel;
+    WaypointQueue _waypoints;     //worked through by the step timer, see nextWaypoint()
+    volatile bool _queueRunning;
+    bool _waypointMoving;         //on the way to the waypoint taken last (step timer ISR only, as the fields below)
+    uint16_t _waypointDwell;
+    unsigned long _queueStart, _dwellUntil;
+    volatile bool _following;     //follow mode, the step timer heads for the setpoint (see setSetpoint())
+    long _followTarget;           //steps, the setpoint as it came
+    float _followVelocity;        //steps/s it moves on with
+    unsigned long _followTime;    //millis() it came at
+    uint8_t _timingCell, _timingStep;   //CALIBRATION_PHASE_TIMING: burst (mode and speed) and step within it
+    unsigned long _timingStart;
+    int _timingMode;              //the stepping mode to restore after the bursts
+    volatile int _calibrationPhase;
+    int _buttonPin;
+    Button _button;               //end stop and user button, see Button.h
+    volatile bool _counting;      //the step timer ISR is in AccelStepper::runSpeed(), see countStep()
+    uint8_t _powerState;          //POWER_*, set by the loop only
+    long _holdDelay, _releaseDelay;   //ms at rest, 0 = never
+    uint8_t _holdCurrent;         //%
+    bool _storeDirty;             //settings changed since they were saved, see CalibrationStore
+    bool _storeMoving;            //the saved record is not valid at the moment (moving, calibrating, never saved)
+    StepOutput _output;           //coil states go to the shield's PWM driver directly, see StepOutput.h
+    StepDriver *_driver;          //_output unless setStepDriver() was given another one
     AccelStepper _stepper;
     int _stepsPerTurn;            //28BYJ-48 data:
                                   //32 * 16 for the 12V edition (1/16 gearing) (define in Proxy constructor)
@@ -69,10 +148,22 @@ class Proxy
 
     void startOperating();
     void stopOperating();
+    void startStepTimer();
+    void stopStepTimer();
+    void setRange(long steps);
+    long currentSteps();
+    long stepsToGo();
+    float timingStep();
+    float nextWaypoint();
+    long followTarget();
+    bool extrapolating();
+    void countStep();
+    void saveCalibration();
+    void setPowerState(uint8_t state);
+    void step(uint8_t dir);
 
-    static Proxy *_activeProxy;
-    static void _forwardStep();
-    static void _backwardStep();
+    template <uint8_t ID> static void _forwardStep();
+    template <uint8_t ID> static void _backwardStep();
 };
 
 #endif
@@ -5,334 +5,879 @@
 
 #include "Arduino.h"
 #include "ProxyControlServer.h"
-
-#define PROTOCOL_PACKET_SIZE 5
-
-ProxyControlServer::ProxyControlServer() : _wifi(_serial1) {
-  _serial1.begin(9600);
+#include "ProxyTrace.h"
+#include "ProxyMemory.h"
+#include "TaskScheduler.h"
+#include "Log.h"
+
+ProxyControlServer::ProxyControlServer() : _defaultAxis(0), _transport(NULL), _replyCount(0), _replyMuxID(0), _batchReplies(false),
+  _datagrams(false), _passthroughRequest(-1), _passthroughMuxID(0), _nextSession(0), _buttonEventCount(0) {
+  for (uint8_t i = 0; i < PROTOCOL_MAX_CONNECTIONS; i++) {
+    closeSession(i);
+  }
+  for (uint8_t id = 0; id < STEP_SCHEDULER_MAX_AXES; id++) {
+    _stagedTarget[id] = STEP_SCHEDULER_NO_TARGET;
+    _telemetryMoving[id] = false;
+    _powerReported[id] = POWER_RELEASED;
+  }
 }
 
-void ProxyControlServer::init(bool connectToWifi, String ssid, String pw, int port, int timeout, Proxy* proxy, float versioninfo, void (*beep)(int), void (*light)(int)) {
+/* transport: reaches the clients (see ProxyTransport), proxy: the axis the clients address until they select another one
+   (see PROTOCOL_SELECT_AXIS) */
+void ProxyControlServer::init(ProxyTransport *transport, Proxy* proxy, float versioninfo, void (*beep)(int), void (*light)(int)) {
   if (proxy == NULL) {
-    Serial.print(F("ERROR: ProxyControlServer initialized with 'NULL' Proxy pointer!"));
-  }
-  _ssid = ssid;
-  _pw = pw;
-  _proxy = proxy;
-  _port = port;
-  _timeout = timeout;
-  _commandsReceived = 0;
+    LOG_ERROR(F("ERROR: ProxyControlServer initialized with 'NULL' Proxy pointer!"));
+  } else {
+    _defaultAxis = proxy->getId();
+  }
+  for (uint8_t i = 0; i < PROTOCOL_MAX_CONNECTIONS; i++) {
+    _sessions[i].axis = _defaultAxis;
+  }
+  _transport = transport;
+  _transport->setListener(this);
   _beep = beep;
   _light = light;
   _version = versioninfo;
+}
 
-  /* INIT WIFI */
-  bool initSuccess = true;
-  Serial.print(F("\tESP8266-WiFi Module AT Version:"));
-  Serial.println(_wifi.getVersion().c_str());
-
-  if (_wifi.setOprToStationSoftAP()) {
-    Serial.print(F("\tOperation Mode set to 'station + softap' ... OK\r\n"));
-    initSuccess &= true;
-  } else {
-    Serial.print(F("\tOperation Mode set to 'station + softap' ... ERROR\r\n"));
-    initSuccess &= false;
-    _beep(200);
-    delay(200);
-    _beep(200);
-    delay(200);
-    _beep(400);
-  }
-
-  if (connectToWifi) {
-    if (_wifi.joinAP(_ssid, _pw)) {
-      Serial.println(_ssid);
-      Serial.print(F("\tJoined WiFi Network ... SUCCESS\r\n"));
-      initSuccess &= true;
-    } else {
-      Serial.println(_ssid);
-      Serial.print(F("\tJoined WiFi Network ... ERROR\r\n"));
-      initSuccess &= false;
-    }
-  } else {
-    Serial.print(F("\tWiFi Network opened! Not joining external WiFi Network according to configuration!\r\n"));
-    initSuccess &= true;
-  }
-
-  Serial.print(F("\tIP: "));
-  Serial.println(_wifi.getLocalIP().c_str());
+/* has the transport serve the clients */
+bool ProxyControlServer::startServer() {
+  return _transport->start();
+}
 
+/* opens the datagram endpoint next to the server, if the transport has one (see PROTOCOL_UDP_PORT) */
+bool ProxyControlServer::startDatagrams(uint16_t port) {
+  _datagrams = _transport->startDatagrams(port);
+  return _datagrams;
+}
 
-  if (_wifi.enableMUX()) {
-    Serial.print(F("\tEnabled 'multi-client' Mode ... SUCCESS\r\n"));
-    initSuccess &= true;
-  } else {
-    Serial.print(F("\tEnabled 'multi-client' Mode ... ERROR\r\n"));
-    initSuccess &= false;
+/* takes what the clients have sent so far off the transport and handles the complete frames while the network task has
+   budget left (the rest waits in the decoders for the next call), after sending the button events queued.
+   Does not wait for data. Returns whether anything was handled. */
+bool ProxyControlServer::listenForCommands() {
+  sendButtonEvents();
+  unsigned long start = micros();
+  if (receivePending()) {
+    ProxyStats::record(STATS_RECEIVE_TIME, micros() - start);
   }
-
-  if (initSuccess) {
-    Serial.print(F("\t\t--> WiFi Module ready!\n\n"));
-  } else {
-    Serial.print(F("\t\t--> Error initializing WiFi Module!\n\n"));
+  bool handled = handleReceived();
+  if (_passthroughRequest > 0) {
+    startPassthrough(_passthroughMuxID, _passthroughRequest);
+  } else if (_passthroughRequest == 0) {
+    stopPassthrough();
   }
+  _passthroughRequest = -1;
+  return handled;
 }
 
-
-bool ProxyControlServer::startServer() {
-  bool startServerSuccess = true;
-  if (_wifi.startTCPServer(_port)) {
-    Serial.print(F("\tPort: "));
-    Serial.print(_port);
-    Serial.print(F("\n"));
-    Serial.print(F("\tStarting TCP Server ... SUCCESS\r\n"));
-    startServerSuccess &= true;
-  } else {
-    Serial.print(F("\tStarting TCP Server ... ERROR\r\n"));
-    startServerSuccess &= false;
+/* a byte a client sent: kept in the decoder of its session until the frame is complete */
+void ProxyControlServer::onReceived(uint8_t mux_id, uint8_t data) {
+  if (mux_id >= PROTOCOL_MAX_CONNECTIONS) {
+    LOG_ERRORLN(F("\t\t--> Data is not protocol conform!"));
+    return;
   }
+  if (!_sessions[mux_id].open) {
+    openSession(mux_id);
+  }
+  _lastMuxID = mux_id;
+  //packets may be split over or coalesced into messages, the decoder puts them back together
+  if (!_sessions[mux_id].decoder.push(&data, 1, millis())) {
+    LOG_ERRORLN(F("\t\t--> Incomplete data dropped!"));
+  }
+}
 
-  if (_wifi.setTCPServerTimeout(_timeout)) {
-    Serial.print(F("\tSet TCP Server Timeout to "));
-    Serial.print(_timeout);
-    Serial.print(F(" seconds ... SUCCESS\r\n"));
-    startServerSuccess &= true;
-  } else {
-    Serial.print(F("\tSet TCP Server Timeout to "));
-    Serial.print(_timeout);
-    Serial.print(F(" seconds ... ERROR\r\n"));
-    startServerSuccess &= false;
+/* the client on mux_id went away */
+void ProxyControlServer::onClosed(uint8_t mux_id) {
+  if (mux_id < PROTOCOL_MAX_CONNECTIONS) {
+    closeSession(mux_id);
   }
+}
 
-  if (startServerSuccess) {
-    Serial.println(F("\t\t--> Ready to receive remote commands!\n\n"));
-  } else {
-    Serial.println(F("\t\t--> Could not start TCP server correctly!\n\n"));
+/* takes everything the clients have sent so far off the transport, into the decoders. Returns whether data came. */
+bool ProxyControlServer::receivePending() {
+  if (!_transport->poll()) {
+    return false;
   }
+  LOG_TRACE(F("\tReceived data from remote ("));
+  LOG_TRACE(_lastMuxID);
+  LOG_TRACELN(F(")"));
+  return true;
 }
 
-bool ProxyControlServer::listenForCommands() {
-  uint8_t buffer[PROTOCOL_PACKET_SIZE] = {0};
-  uint8_t mux_id;
-  uint32_t len = _wifi.recv(&mux_id, buffer, sizeof(buffer), 100);   //do not use a long timeout here (maybe 100), as button presses will be checked at this frequency
-  if (len > 0) {
-    Serial.print(F("\tReceived data from remote ("));
-    Serial.print(mux_id);
-    Serial.print(F("):"));
-    _lastMuxID = mux_id;
-    //Serial.print(F("["));
-    //Serial.print(_wifi.getIPStatus().c_str());
-    //Serial.println(F("]"));
-
-    Serial.print(F("\t\t--> ["));
-    for (uint32_t i = 0; i < PROTOCOL_PACKET_SIZE; i++) {
-      Serial.print((char)buffer[i]);
+/* handles the complete frames in the decoders, the sessions in turns, while the running task has time left for a
+   frame whose replies are sent (SESSION_FRAME_TIME). At least one frame is handled; the next call goes on with the
+   session after the one that was cut short. */
+bool ProxyControlServer::handleReceived() {
+  bool handled = false;
+  for (uint8_t i = 0; i < PROTOCOL_MAX_CONNECTIONS; i++) {
+    uint8_t mux_id = (_nextSession + i) % PROTOCOL_MAX_CONNECTIONS;
+    ProtocolFrame frame;
+    while (_sessions[mux_id].open && _sessions[mux_id].decoder.next(frame)) {
+      if (isDatagram(mux_id) && !takeDatagram(_sessions[mux_id], frame)) {
+        continue;
+      }
+      handleFrame(mux_id, frame);
+      handled = true;
+      if (TaskScheduler::remaining() < SESSION_FRAME_TIME) {
+        _nextSession = (mux_id + 1) % PROTOCOL_MAX_CONNECTIONS;
+        ProxyStats::countMalformed(_sessions[mux_id].decoder.takeDroppedBytes());
+        return true;
+      }
     }
-    Serial.print(F("]\r\n"));
-
-    //correct protocol package
-    if (len == 5) {
-      uint8_t command = buffer[0];
-      float payload = *((float*)(&(buffer[1])));
-
-      Serial.print(F("\t\t--> ["));
-      Serial.print(command);
-      Serial.print(F(", "));
-      Serial.print(payload, 8);
-      Serial.print(F("]\r\n)"));
-
-      handleCommand(mux_id, command, payload);
-
-      //Serial.print(F("Server Status:["));
-      //Serial.print(_wifi.getIPStatus().c_str());
-      //Serial.println(F("]"));
+    ProxyStats::countMalformed(_sessions[mux_id].decoder.takeDroppedBytes());
+  }
+  return handled;
+}
 
-    } else {
-      Serial.println(F("\t\t--> Data is not protocol conform!"));
+/* v1 packets are handled one by one, the replies to a v2 frame go out together in one frame */
+void ProxyControlServer::handleFrame(uint8_t mux_id, ProtocolFrame &frame) {
+  if (frame.version == 2) {
+    _batchReplies = true;
+    _replyMuxID = mux_id;
+    _replyCount = 0;
+  }
+  for (uint8_t i = 0; i < frame.count; i++) {
+    LOG_TRACE(F("\t\t--> ["));
+    LOG_TRACE(frame.commands[i]);
+    LOG_TRACE(F(", "));
+    LOG_TRACE(frame.payloads[i], 8);
+    LOG_TRACE(F("]\r\n)"));
+
+    if (isDatagram(mux_id) && !protocolDatagramAllowed(frame.commands[i])) {
+      ProxyStats::countMalformed(1);      //reliable commands stay on TCP
+      continue;
     }
+    handleCommand(mux_id, frame.commands[i], frame.payloads[i]);
+  }
+  if (frame.version == 2) {
+    _batchReplies = false;
+    if (_replyCount > 0) {
+      uint8_t len = protocolWriteFrameHeader(_replyFrame, frame.sequenceId, _replyCount) + _replyCount * PROTOCOL_PACKET_SIZE;
+      if (send(mux_id, _replyFrame, len)) {
+        traceSent(mux_id, &_replyFrame[PROTOCOL_V2_HEADER_SIZE], _replyCount);
+      }
+    }
+  }
+}
+
+/* the datagram endpoint, not a TCP client */
+bool ProxyControlServer::isDatagram(uint8_t mux_id) {
+  return _datagrams && mux_id == PROTOCOL_UDP_MUX;
+}
 
-    Serial.print(F("\n\n"));
+/* a v2 frame newer than the last one taken, or any after PROTOCOL_UDP_RESYNC_TIME of silence (a new client);
+   a late datagram is dropped rather than undo what a newer one did */
+bool ProxyControlServer::takeDatagram(ProxySession &session, const ProtocolFrame &frame) {
+  unsigned long now = millis();
+  bool silent = now - session.lastDatagram >= PROTOCOL_UDP_RESYNC_TIME;
+  session.lastDatagram = now;
+  if (frame.version != 2) {
+    ProxyStats::countMalformed(PROTOCOL_PACKET_SIZE);
+    return false;
   }
+  if (session.synced && !silent && (int16_t)(frame.sequenceId - session.sequenceId) <= 0) {
+    return false;
+  }
+  session.synced = true;
+  session.sequenceId = frame.sequenceId;
+  return true;
 }
 
 /* handling the protocol */
 void ProxyControlServer::handleCommand(uint8_t mux_id, uint8_t command, float payload) {
+  Proxy* proxy = axis(mux_id);
+  if (proxy == NULL) {
+    LOG_ERRORLN(F("\t-> No axis to address!"));
+    return;
+  }
+  ProxyStats::countCommand(command);
+  ProxyTrace::record(TRACE_RECEIVED, mux_id, command, payload, micros());
 
   if (command == 0) { //client requested current position
-    Serial.print(F("\t-> Client requested current position ..."));
+    LOG_TRACE(F("\t-> Client requested current position ..."));
     if (_light != NULL)
       _light(5);
-    _commandsReceived++;
-    float retPayload = _proxy->getCurrentPosition();
+    float retPayload = proxy->getCurrentPosition();
     sendResponse(mux_id, command, retPayload);
-    Serial.println(F(" sent!"));
+    LOG_TRACELN(F(" sent!"));
 
   } else if (command == 1) { //client sends new target position
-    Serial.println(F("\t-> Client sends new target position!"));
+    LOG_TRACELN(F("\t-> Client sends new target position!"));
     if (_light != NULL)
       _light(2);
-    _commandsReceived++;
-    sendResponse(mux_id, command, _proxy->getExpectedTimeTo(payload));
-    _proxy->setTargetPosition(payload);
-    Serial.println(F("\t-> ACK sent!"));
+    sendResponse(mux_id, command, proxy->getExpectedTimeTo(payload));
+    proxy->setTargetPosition(payload);
+    LOG_TRACELN(F("\t-> ACK sent!"));
 
   } else if (command == 2) {
-    Serial.println(F("\t-> Client sends new speed ..."));
+    LOG_TRACELN(F("\t-> Client sends new speed ..."));
     if (_light != NULL)
       _light(2);
-    _commandsReceived++;
-    sendResponse(mux_id, command, *((float*)(&"OK")));
-    _proxy->setCurrentSpeed((int) payload);
-    Serial.println(F("\t-> ACK sent!"));
+    sendResponse(mux_id, command, protocolFromInt(PROTOCOL_ACK));
+    proxy->setCurrentSpeed((int) payload);
+    LOG_TRACELN(F("\t-> ACK sent!"));
 
   } else if (command == 3) {
-    Serial.println(F("\t-> Client requests isTargetReached ..."));
+    LOG_TRACELN(F("\t-> Client requests isTargetReached ..."));
     if (_light != NULL)
       _light(5);
-    _commandsReceived++;
-    float retPayload = _proxy->isTargetReached() ? 1 : 0;
+    float retPayload = proxy->isTargetReached() ? 1 : 0;
     sendResponse(mux_id, command, retPayload);
-    Serial.println(F(" sent!"));
+    LOG_TRACELN(F(" sent!"));
 
   } else if (command == 4) {
-    Serial.println(F("\t-> Client requests current speed ..."));
+    LOG_TRACELN(F("\t-> Client requests current speed ..."));
     if (_light != NULL)
       _light(5);
-    _commandsReceived++;
-    float retPayload = (float) _proxy->getCurrentSpeed();
+    float retPayload = (float) proxy->getCurrentSpeed();
     sendResponse(mux_id, command, retPayload);
-    Serial.println(F(" sent!"));
+    LOG_TRACELN(F(" sent!"));
 
   } else if (command == 5) {
-    Serial.println(F("\t-> Client requests recalibration ..."));
+    LOG_TRACELN(F("\t-> Client requests recalibration ..."));
     if (_light != NULL)
       _light(2);
     if (_beep != NULL) {
       _beep(200);
-      delay(400);
       _beep(200);
     }
-    _commandsReceived++;
-    sendResponse(mux_id, command, *((float*)(&"OK")));
-    _proxy->calibrationStart();
-    Serial.println(F("\t-> ACK sent!"));
+    sendResponse(mux_id, command, protocolFromInt(PROTOCOL_ACK));
+    proxy->calibrationStart();
+    LOG_TRACELN(F("\t-> ACK sent!"));
 
   } else if (command == 6) {
-    Serial.println(F("\t-> Client requests expected time ..."));
+    LOG_TRACELN(F("\t-> Client requests expected time ..."));
     if (_light != NULL)
       _light(5);
-    _commandsReceived++;
-    float retPayload = _proxy->getExpectedTimeTo(payload);
+    float retPayload = proxy->getExpectedTimeTo(payload);
     sendResponse(mux_id, command, retPayload);
-    Serial.println(F("\t-> Time sent!"));
+    LOG_TRACELN(F("\t-> Time sent!"));
 
   } else if (command == 9) {
-    Serial.println(F("\t-> Client requests power saving ..."));
+    LOG_TRACELN(F("\t-> Client requests power saving ..."));
     if (_light != NULL)
       _light(5);
-    _commandsReceived++;
-    _proxy->savePower();
-    sendResponse(mux_id, command, *((float*)(&"OK")));
-    Serial.println(F("\t-> Power Saving ACK sent!"));
+    proxy->savePower();
+    sendResponse(mux_id, command, protocolFromInt(PROTOCOL_ACK));
+    LOG_TRACELN(F("\t-> Power Saving ACK sent!"));
 
   } else if (command == 10) {  //see SDK Enumeration for COMMAND list
-    Serial.println(F("\t-> Client wants to disconnect ..."));
+    LOG_TRACELN(F("\t-> Client wants to disconnect ..."));
+    if (mux_id < PROTOCOL_MAX_CONNECTIONS) {
+      closeSession(mux_id);              //the next client on this mux starts with v1 again, on the default axis
+    }
+    if (_transport->isPassthrough()) {
+      _passthroughRequest = 0;
+    }
 
   } else if (command == 11) {
-    Serial.println(F("\t-> Client sends new stepping mode ..."));
+    LOG_TRACELN(F("\t-> Client sends new stepping mode ..."));
     if (_light != NULL)
       _light(2);
-    _commandsReceived++;
     switch ((int)payload) {            //for the mapping to the payload see SDK ENUMERATION
       case 0:
-        _proxy->setStepperMode(SINGLE);
-        Serial.println(F("\t-> Stepping Mode set to SINGLE"));
+        proxy->setStepperMode(SINGLE);
+        LOG_TRACELN(F("\t-> Stepping Mode set to SINGLE"));
         break;
       case 1:
-        _proxy->setStepperMode(DOUBLE);
-        Serial.println(F("\t-> Stepping Mode set to DOUBLE"));
+        proxy->setStepperMode(DOUBLE);
+        LOG_TRACELN(F("\t-> Stepping Mode set to DOUBLE"));
         break;
       case 2:
-        _proxy->setStepperMode(INTERLEAVE);
-        Serial.println(F("\t-> Stepping Mode set to INTERLEAVE"));
+        proxy->setStepperMode(INTERLEAVE);
+        LOG_TRACELN(F("\t-> Stepping Mode set to INTERLEAVE"));
         break;
       case 3:
-        _proxy->setStepperMode(MICROSTEP);
-        Serial.println(F("\t-> Stepping Mode set to MICROSTEP"));
+        proxy->setStepperMode(MICROSTEP);
+        LOG_TRACELN(F("\t-> Stepping Mode set to MICROSTEP"));
         break;
       default:
-        Serial.print(F("\t-> Stepping Mode UNKNOWN = "));
-        Serial.println(payload);
+        LOG_ERROR(F("\t-> Stepping Mode UNKNOWN = "));
+        LOG_ERRORLN(payload);
         break;
     }
-    sendResponse(mux_id, command, *((float*)(&"OK")));
-    Serial.println(F("\t-> ACK sent!"));
+    sendResponse(mux_id, command, protocolFromInt(PROTOCOL_ACK));
+    LOG_TRACELN(F("\t-> ACK sent!"));
     
   } else if (command == 12) {
-    Serial.println(F("\t-> Client requests VersionInfo ..."));
+    LOG_TRACELN(F("\t-> Client requests VersionInfo ..."));
     if (_light != NULL)
       _light(5);
-    _commandsReceived++;
     float retPayload = _version;
     sendResponse(mux_id, command, retPayload);
-    Serial.print(_version);
-    Serial.println(F(" sent!"));
+    LOG_TRACE(_version);
+    LOG_TRACELN(F(" sent!"));
+
+  } else if (command == PROTOCOL_VERSION_COMMAND) {
+    LOG_TRACELN(F("\t-> Client negotiates protocol version ..."));
+    uint8_t version = payload >= PROTOCOL_MAX_VERSION ? PROTOCOL_MAX_VERSION : 1;
+    sendResponse(mux_id, command, version);      //still in the format the client asked in
+    if (mux_id < PROTOCOL_MAX_CONNECTIONS)
+      _sessions[mux_id].decoder.setVersion(version);
+    LOG_TRACE(version);
+    LOG_TRACELN(F(" agreed!"));
+
+  } else if (command == PROTOCOL_TELEMETRY_SUBSCRIBE) {
+    LOG_TRACELN(F("\t-> Client subscribes to telemetry ..."));
+    uint8_t rate = (uint8_t) constrain(payload, 0, PROTOCOL_TELEMETRY_MAX_RATE);
+    if (mux_id < PROTOCOL_MAX_CONNECTIONS) {
+      _sessions[mux_id].telemetryInterval = rate > 0 ? 1000 / rate : 0;
+      _sessions[mux_id].lastTelemetry = millis();
+      _sessions[mux_id].telemetryAxis = proxy->getId();
+    } else {
+      rate = 0;
+    }
+    sendResponse(mux_id, command, rate);
+    LOG_TRACE(rate);
+    LOG_TRACELN(F(" Hz applied!"));
+
+  } else if (command == PROTOCOL_SET_ACCELERATION) {
+    LOG_TRACELN(F("\t-> Client sends new acceleration ..."));
+    if (_light != NULL)
+      _light(2);
+    proxy->setAcceleration(payload);
+    sendResponse(mux_id, command, proxy->getAcceleration());
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_SET_JERK) {
+    LOG_TRACELN(F("\t-> Client sends new jerk ..."));
+    if (_light != NULL)
+      _light(2);
+    proxy->setJerk(payload);
+    sendResponse(mux_id, command, proxy->getJerk());
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_PREDICTION_ERROR) {
+    LOG_TRACELN(F("\t-> Client requests prediction error ..."));
+    if (_light != NULL)
+      _light(5);
+    sendResponse(mux_id, command, proxy->getPredictionError((uint8_t)payload));
+    LOG_TRACELN(F(" sent!"));
+
+  } else if (command == PROTOCOL_SELECT_AXIS) {
+    LOG_TRACELN(F("\t-> Client selects axis ..."));
+    if (mux_id < PROTOCOL_MAX_CONNECTIONS && payload >= 0 && payload < StepScheduler::count()) {
+      _sessions[mux_id].axis = (uint8_t) payload;
+    }
+    sendResponse(mux_id, command, axis(mux_id)->getId());
+    LOG_TRACE(axis(mux_id)->getId());
+    LOG_TRACELN(F(" selected!"));
+
+  } else if (command == PROTOCOL_STAGE_TARGET) {
+    LOG_TRACELN(F("\t-> Client stages a target position ..."));
+    _stagedTarget[proxy->getId()] = proxy->stepsFromPosition(payload);
+    sendResponse(mux_id, command, payload);
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_MOVE_STAGED) {
+    LOG_TRACELN(F("\t-> Client starts the staged targets ..."));
+    if (_light != NULL)
+      _light(2);
+    long expected = StepScheduler::moveTogether(_stagedTarget);
+    for (uint8_t id = 0; id < STEP_SCHEDULER_MAX_AXES; id++) {
+      _stagedTarget[id] = STEP_SCHEDULER_NO_TARGET;
+    }
+    sendResponse(mux_id, command, expected);
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_WAYPOINT_SPEED || command == PROTOCOL_WAYPOINT_DWELL || command == PROTOCOL_WAYPOINT_START_AT) {
+    LOG_TRACELN(F("\t-> Client sets a waypoint field ..."));
+    float applied = 0;
+    if (mux_id < PROTOCOL_MAX_CONNECTIONS) {
+      Waypoint &waypoint = _sessions[mux_id].waypoint;
+      if (command == PROTOCOL_WAYPOINT_SPEED) {
+        applied = waypoint.speed = (uint16_t) constrain(payload, 0, STEP_TIMER_MAX_RATE);
+      } else if (command == PROTOCOL_WAYPOINT_DWELL) {
+        applied = waypoint.dwell = (uint16_t) constrain(payload, 0, 0xFFFF);
+      } else {
+        applied = waypoint.startAt = (unsigned long) max(payload, 0);
+      }
+    }
+    sendResponse(mux_id, command, applied);
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_WAYPOINT_APPEND) {
+    LOG_TRACELN(F("\t-> Client appends a waypoint ..."));
+    float queued = -1;
+    if (mux_id < PROTOCOL_MAX_CONNECTIONS) {
+      Waypoint &waypoint = _sessions[mux_id].waypoint;
+      waypoint.position = proxy->stepsFromPosition(payload);
+      if (proxy->addWaypoint(waypoint)) {
+        queued = proxy->getWaypointCount();
+      }
+      waypoint.speed = 0;
+      waypoint.dwell = 0;
+      waypoint.startAt = 0;
+    }
+    sendResponse(mux_id, command, queued);
+    LOG_TRACE(queued);
+    LOG_TRACELN(F(" queued!"));
+
+  } else if (command == PROTOCOL_WAYPOINT_CLEAR) {
+    LOG_TRACELN(F("\t-> Client clears the waypoints ..."));
+    proxy->clearWaypoints();
+    sendResponse(mux_id, command, proxy->getWaypointCount());
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_WAYPOINT_QUERY) {
+    LOG_TRACELN(F("\t-> Client requests the waypoint queue ..."));
+    sendResponse(mux_id, command, payload == 1 ? proxy->getWaypointSpace() : proxy->getWaypointCount());
+    LOG_TRACELN(F(" sent!"));
+
+  } else if (command == PROTOCOL_POWER_HOLD_DELAY) {
+    LOG_TRACELN(F("\t-> Client sends new hold delay ..."));
+    proxy->setHoldDelay(protocolToInt(payload));
+    sendResponse(mux_id, command, protocolFromInt(proxy->getHoldDelay()));
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_POWER_RELEASE_DELAY) {
+    LOG_TRACELN(F("\t-> Client sends new release delay ..."));
+    proxy->setReleaseDelay(protocolToInt(payload));
+    sendResponse(mux_id, command, protocolFromInt(proxy->getReleaseDelay()));
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_POWER_HOLD_CURRENT) {
+    LOG_TRACELN(F("\t-> Client sends new hold current ..."));
+    proxy->setHoldCurrent(protocolToInt(payload));
+    sendResponse(mux_id, command, protocolFromInt(proxy->getHoldCurrent()));
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_POWER_STATE) {
+    LOG_TRACELN(F("\t-> Client requests the power state ..."));
+    sendResponse(mux_id, command, protocolFromInt(proxy->getPowerState()));
+    LOG_TRACELN(F(" sent!"));
+
+  } else if (command == PROTOCOL_SUBSCRIBE_EVENTS) {
+    LOG_TRACELN(F("\t-> Client subscribes to events ..."));
+    uint8_t events = payload >= 0 ? ((uint8_t) payload) & PROTOCOL_EVENTS_ALL : 0;
+    if (mux_id < PROTOCOL_MAX_CONNECTIONS) {
+      _sessions[mux_id].events = events;
+    }
+    sendResponse(mux_id, command, events);
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_PASSTHROUGH) {
+    LOG_TRACELN(F("\t-> Client requests passthrough ..."));
+    long port = payload > 0 && payload < 65536 ? (long) payload : 0;
+    bool allowed = _transport->isPassthrough() ? port == 0 : port > 0 && getSessionCount() == 1;
+    sendResponse(mux_id, command, allowed ? port : -1);
+    if (allowed) {
+      _passthroughRequest = port;     //once the replies are out, see listenForCommands()
+      _passthroughMuxID = mux_id;
+    }
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_STATS) {
+    LOG_TRACELN(F("\t-> Client requests stats ..."));
+    sendStats(mux_id, payload);
+    LOG_TRACELN(F(" sent!"));
+
+  } else if (command == PROTOCOL_TRACE) {
+    LOG_TRACELN(F("\t-> Client switches the trace ..."));
+    if (payload == 1) {
+      ProxyTrace::start();
+    } else if (payload == 0) {
+      ProxyTrace::stop();
+    }
+    sendResponse(mux_id, command, protocolFromInt(ProxyTrace::count()));
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_TRACE_READ) {
+    LOG_TRACELN(F("\t-> Client reads the trace ..."));
+    sendTrace(mux_id);
+    LOG_TRACELN(F(" sent!"));
+
+  } else if (command == PROTOCOL_STEPS_POSITION || command == PROTOCOL_STEPS_POSITION_Q16) {
+    LOG_TRACELN(F("\t-> Client requests current position in steps ..."));
+    if (_light != NULL)
+      _light(5);
+    long steps = proxy->getCurrentSteps();
+    sendResponse(mux_id, command, protocolFromInt(command == PROTOCOL_STEPS_POSITION ? steps : proxy->q16FromSteps(steps)));
+    LOG_TRACELN(F(" sent!"));
+
+  } else if (command == PROTOCOL_STEPS_TARGET || command == PROTOCOL_STEPS_TARGET_Q16 || command == PROTOCOL_STEPS_EXPECTED_TIME) {
+    LOG_TRACELN(F("\t-> Client sends a target in steps ..."));
+    if (_light != NULL)
+      _light(command == PROTOCOL_STEPS_EXPECTED_TIME ? 5 : 2);
+    long target = protocolToInt(payload);
+    if (command == PROTOCOL_STEPS_TARGET_Q16) {
+      target = proxy->stepsFromQ16(target);
+    }
+    long status = checkTarget(proxy, target);
+    long expected = status < 0 ? status : proxy->getExpectedTimeToSteps(target);
+    sendResponse(mux_id, command, protocolFromInt(expected));
+    if (status == 0 && command != PROTOCOL_STEPS_EXPECTED_TIME) {
+      proxy->setTargetSteps(target);
+    }
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_STEPS_RANGE) {
+    LOG_TRACELN(F("\t-> Client requests the range in steps ..."));
+    sendResponse(mux_id, command, protocolFromInt(proxy->isCalibrated() ? proxy->getRange() : PROTOCOL_STATUS_NOT_CALIBRATED));
+    LOG_TRACELN(F(" sent!"));
+
+  } else if (command == PROTOCOL_FOLLOW) {
+    LOG_TRACELN(F("\t-> Client switches follow mode ..."));
+    bool on = payload != 0;
+    sendResponse(mux_id, command, proxy->follow(on) ? on : PROTOCOL_STATUS_NOT_CALIBRATED);
+    LOG_TRACELN(F("\t-> ACK sent!"));
+
+  } else if (command == PROTOCOL_FOLLOW_VELOCITY) {   //no reply, no feedback: these come with every frame the client renders
+    if (mux_id < PROTOCOL_MAX_CONNECTIONS) {
+      _sessions[mux_id].followVelocity = protocolToInt(payload);
+    }
+
+  } else if (command == PROTOCOL_FOLLOW_SETPOINT) {
+    long velocity = 0;
+    if (mux_id < PROTOCOL_MAX_CONNECTIONS) {
+      velocity = _sessions[mux_id].followVelocity;
+      _sessions[mux_id].followVelocity = 0;
+    }
+    proxy->setSetpoint(protocolToInt(payload), velocity);
+
+  } else if (command == PROTOCOL_MEMORY) {
+    LOG_TRACELN(F("\t-> Client requests the free memory ..."));
+    long bytes = PROTOCOL_STATUS_OUT_OF_RANGE;
+    if (payload == PROTOCOL_MEMORY_FREE) {
+      bytes = ProxyMemory::getFree();
+    } else if (payload == PROTOCOL_MEMORY_LOW_WATERMARK) {
+      bytes = ProxyMemory::getLowWatermark();
+    } else if (payload == PROTOCOL_MEMORY_HEAP) {
+      bytes = ProxyMemory::getHeapUsed();
+    }
+    sendResponse(mux_id, command, protocolFromInt(bytes));
+    LOG_TRACELN(F(" sent!"));
 
   }
 }
 
-  /* sends button changes */
-  void ProxyControlServer::sendButtonEvent(uint8_t mux_id, int buttonEvent, float payload) {
-    if (buttonEvent == BUTTON_EVENT_DOWN || buttonEvent == BUTTON_EVENT_UP) {
-      sendResponse(mux_id, 6 + buttonEvent, payload);
+  /* 0 if the axis can move to target (steps), a PROTOCOL_STATUS_* otherwise */
+  long ProxyControlServer::checkTarget(Proxy* proxy, long target) {
+    if (!proxy->isCalibrated()) {
+      return PROTOCOL_STATUS_NOT_CALIBRATED;
+    }
+    if (target < 0 || target > proxy->getRange()) {
+      return PROTOCOL_STATUS_OUT_OF_RANGE;
+    }
+    return 0;
+  }
+
+  /* a page of the counters, or the reset, see PROTOCOL_STATS */
+  void ProxyControlServer::sendStats(uint8_t mux_id, float payload) {
+    uint8_t commands[1 + STATS_PAGE_WORDS] = {PROTOCOL_STATS};
+    float payloads[1 + STATS_PAGE_WORDS] = {payload};
+    uint8_t count = 1;
+    uint32_t words[STATS_PAGE_WORDS];
+    if (payload == PROTOCOL_STATS_RESET) {
+      ProxyStats::reset();
+    } else if (payload >= 0 && payload < STATS_PAGE_COUNT && ProxyStats::getPage((uint8_t) payload, words)) {
+      for (uint8_t i = 0; i < STATS_PAGE_WORDS; i++) {
+        commands[count] = PROTOCOL_STATS_DATA;
+        payloads[count] = protocolFromInt(words[i]);
+        count++;
+      }
+    } else {
+      payloads[0] = -1;
+    }
+    if (_batchReplies && mux_id == _replyMuxID) {   //into the reply frame, as far as it has room
+      for (uint8_t i = 0; i < count; i++) {
+        sendResponse(mux_id, commands[i], payloads[i]);
+      }
+    } else {
+      sendPackets(mux_id, commands, payloads, count);
+    }
+  }
+
+  /* the oldest records of the trace, taken off it, see PROTOCOL_TRACE */
+  void ProxyControlServer::sendTrace(uint8_t mux_id) {
+    uint8_t commands[1 + 2 * TRACE_READ_RECORDS] = {PROTOCOL_TRACE_READ};
+    float payloads[1 + 2 * TRACE_READ_RECORDS];
+    uint8_t count = 1;
+    uint32_t words[2];
+    uint8_t records = 0;
+    while (records < TRACE_READ_RECORDS && ProxyTrace::take(words)) {
+      for (uint8_t i = 0; i < 2; i++) {
+        commands[count] = PROTOCOL_TRACE_DATA;
+        payloads[count] = protocolFromInt(words[i]);
+        count++;
+      }
+      records++;
+    }
+    payloads[0] = protocolFromInt(records);
+    if (_batchReplies && mux_id == _replyMuxID) {   //into the reply frame, as far as it has room
+      for (uint8_t i = 0; i < count; i++) {
+        sendResponse(mux_id, commands[i], payloads[i]);
+      }
+    } else {
+      sendPackets(mux_id, commands, payloads, count);
+    }
+  }
+
+  /* the packets of a write that went out, into the trace */
+  void ProxyControlServer::traceSent(uint8_t mux_id, const uint8_t *packets, uint8_t count) {
+    if (!ProxyTrace::recording()) {
+      return;
+    }
+    unsigned long now = micros();
+    for (uint8_t i = 0; i < count; i++) {
+      float payload;
+      memcpy(&payload, &packets[i * PROTOCOL_PACKET_SIZE + 1], sizeof(float));
+      ProxyTrace::record(TRACE_SENT, mux_id, packets[i * PROTOCOL_PACKET_SIZE], payload, now);
+    }
+  }
+
+  /* pushes a telemetry sample of its axis to every subscriber that is due, and MOVE_COMPLETED once that axis' move has ended;
+     the power state changes go out first */
+  void ProxyControlServer::sendTelemetry() {
+    sendPowerEvents();
+    bool moving[STEP_SCHEDULER_MAX_AXES], completed[STEP_SCHEDULER_MAX_AXES];
+    bool report = false;
+    for (uint8_t id = 0; id < StepScheduler::count(); id++) {
+      moving[id] = isMoving(id);
+      completed[id] = _telemetryMoving[id] && !moving[id];
+      _telemetryMoving[id] = moving[id];
+      report |= moving[id] || completed[id];
+    }
+    if (!report) {
+      return;
+    }
+
+    unsigned long now = millis();
+    for (uint8_t mux_id = 0; mux_id < PROTOCOL_MAX_CONNECTIONS; mux_id++) {
+      ProxySession &session = _sessions[mux_id];
+      uint8_t id = session.telemetryAxis;
+      if (!session.open || session.telemetryInterval == 0 || id >= StepScheduler::count()) {
+        continue;
+      }
+      Proxy* proxy = StepScheduler::get(id);
+      if (completed[id]) {
+        uint8_t command = PROTOCOL_EVENT_MOVE_COMPLETED;
+        float position = proxy->getCurrentPosition();
+        sendPackets(mux_id, &command, &position, 1);
+      } else if (moving[id] && now - session.lastTelemetry >= session.telemetryInterval) {
+        session.lastTelemetry = now;
+        uint8_t commands[3] = {PROTOCOL_TELEMETRY_POSITION, PROTOCOL_TELEMETRY_VELOCITY, PROTOCOL_TELEMETRY_TARGET_REACHED};
+        float payloads[3] = {proxy->getCurrentPosition(), proxy->getCurrentVelocity(), proxy->isTargetReached() ? 1.0f : 0.0f};
+        sendPackets(mux_id, commands, payloads, 3);
+      }
+    }
+  }
+
+  /* the axis the client on mux_id addresses, NULL without any */
+  Proxy* ProxyControlServer::axis(uint8_t mux_id) {
+    return StepScheduler::get(mux_id < PROTOCOL_MAX_CONNECTIONS ? _sessions[mux_id].axis : _defaultAxis);
+  }
+
+  /* a calibration run is not a move the clients asked for, it is not reported */
+  bool ProxyControlServer::isMoving(uint8_t id) {
+    Proxy* proxy = StepScheduler::get(id);
+    return proxy != NULL && proxy->operating() && proxy->calibrating() == CALIBRATION_PHASE_NONE;
+  }
+
+  /* POWER_STATE to the clients subscribed to PROTOCOL_EVENTS_POWER on an axis whose power state changed */
+  void ProxyControlServer::sendPowerEvents() {
+    for (uint8_t id = 0; id < StepScheduler::count(); id++) {
+      uint8_t state = StepScheduler::get(id)->getPowerState();
+      if (state == _powerReported[id]) {
+        continue;
+      }
+      _powerReported[id] = state;
+      uint8_t command = PROTOCOL_POWER_STATE;
+      float payload = protocolFromInt(state);
+      for (uint8_t mux_id = 0; mux_id < PROTOCOL_MAX_CONNECTIONS; mux_id++) {
+        if (_sessions[mux_id].open && (_sessions[mux_id].events & PROTOCOL_EVENTS_POWER) && _sessions[mux_id].axis == id) {
+          sendPackets(mux_id, &command, &payload, 1);
+        }
+      }
+    }
+  }
+
+  /* keeps a button change for the next listenForCommands(), which sends it; a full queue drops it */
+  void ProxyControlServer::queueButtonEvent(const ButtonEvent &event, float position) {
+    if (_buttonEventCount >= BUTTON_QUEUE_SIZE) {
+      return;
+    }
+    _buttonEvents[_buttonEventCount] = event;
+    _buttonPositions[_buttonEventCount] = position;
+    _buttonEventCount++;
+  }
+
+  /* the button changes queued, oldest first */
+  void ProxyControlServer::sendButtonEvents() {
+    for (uint8_t i = 0; i < _buttonEventCount; i++) {
+      sendButtonEvent(_buttonEvents[i], _buttonPositions[i]);
+    }
+    _buttonEventCount = 0;
+  }
+
+  /* sends button changes to every client subscribed to them, with the time of the change to those that asked for it */
+  void ProxyControlServer::sendButtonEvent(const ButtonEvent &event, float position) {
+    if (event.type != BUTTON_EVENT_DOWN && event.type != BUTTON_EVENT_UP) {
+      return;
+    }
+    uint8_t commands[2] = {(uint8_t)(6 + event.type), PROTOCOL_EVENT_TIME};
+    float payloads[2] = {position, protocolFromInt(event.time)};
+    ProxyTrace::record(TRACE_BUTTON, 0, commands[0], position, event.time);
+    for (uint8_t mux_id = 0; mux_id < PROTOCOL_MAX_CONNECTIONS; mux_id++) {
+      if (_sessions[mux_id].open && (_sessions[mux_id].events & PROTOCOL_EVENTS_BUTTON)) {
+        sendPackets(mux_id, commands, payloads, (_sessions[mux_id].events & PROTOCOL_EVENTS_BUTTON_TIME) ? 2 : 1);
+      }
     }
   }
 
   void ProxyControlServer::sendResponse(uint8_t mux_id, uint8_t command, float payload) {
-    //prepare buffer to send
-    uint8_t buffer[PROTOCOL_PACKET_SIZE] = {0};
-    buffer[0] = command;
-    uint8_t* payloadBuffer = (uint8_t*)(&payload);
-    for (int i = 0; i < 4; i++) {
-      buffer[i + 1] = payloadBuffer[i];
-      Serial.print(payloadBuffer[i]);
+    if (_batchReplies && mux_id == _replyMuxID) {   //goes out with the other replies to the v2 frame, see handleFrame()
+      if (_replyCount < PROTOCOL_V2_MAX_COMMANDS) {
+        protocolWritePacket(&_replyFrame[PROTOCOL_V2_HEADER_SIZE + _replyCount * PROTOCOL_PACKET_SIZE], command, payload);
+        _replyCount++;
+      }
+      return;
     }
 
-    Serial.print(F("\t\tBuffer prepared for sending: ["));
+#if LOG_LEVEL >= LOG_LEVEL_TRACE    //per-packet self-test, only worth its serial time when tracing
+    uint8_t packet[PROTOCOL_PACKET_SIZE];
+    protocolWritePacket(packet, command, payload);
+    LOG_TRACE(F("\t\tBuffer prepared for sending: ["));
     for (uint32_t i = 0; i < PROTOCOL_PACKET_SIZE; i++) {
-      Serial.print((char)buffer[i]);
-    }
-    Serial.print(F("]\r\n"));
-    Serial.println(F("\tTesting buffer ..."));
-    uint8_t testCommand = buffer[0];
-    float testPayload = *((float*)(&(buffer[1])));
-    Serial.print(F("\t\t--> ["));
-    Serial.print(testCommand);
-    Serial.print(F(", "));
-    Serial.print(testPayload, 8);
-    Serial.print(F("]\r\n)"));
-    if (testCommand == command && testPayload == payload) {
-      Serial.println(F("\t\t--> Test passed!"));
+      LOG_TRACE((char)packet[i]);
+    }
+    LOG_TRACE(F("]\r\n"));
+    LOG_TRACELN(F("\tTesting buffer ..."));
+    uint8_t testCommand = packet[0];
+    float testPayload;
+    memcpy(&testPayload, &packet[1], sizeof(float));
+    LOG_TRACE(F("\t\t--> ["));
+    LOG_TRACE(testCommand);
+    LOG_TRACE(F(", "));
+    LOG_TRACE(testPayload, 8);
+    LOG_TRACE(F("]\r\n)"));
+    if (testCommand == command && protocolToInt(testPayload) == protocolToInt(payload)) {   //bytes, payloads may be ints
+      LOG_TRACELN(F("\t\t--> Test passed!"));
     } else {
-      Serial.println(F("\t\t--> Test not passed!"));
+      LOG_TRACELN(F("\t\t--> Test not passed!"));
     }
+#endif
 
-    if (_wifi.send(mux_id, buffer, sizeof(buffer))) {
-      Serial.print(F("\t\t--> Data sent!"));
-    } else {
-      Serial.print(F("\t\t--> ERROR sending data!"));
+    sendPackets(mux_id, &command, &payload, 1);
+  }
+
+  /* sends up to PROTOCOL_V2_MAX_COMMANDS packets in one write, framed once the client agreed on v2 */
+  bool ProxyControlServer::sendPackets(uint8_t mux_id, const uint8_t *commands, const float *payloads, uint8_t count) {
+    uint8_t buffer[PROTOCOL_V2_MAX_FRAME_SIZE] = {0};
+    uint8_t len = 0;
+    if (count > PROTOCOL_V2_MAX_COMMANDS) {
+      count = PROTOCOL_V2_MAX_COMMANDS;
+    }
+    if (isDatagram(mux_id)) {         //always framed, numbered for the client to see what was lost
+      _sessions[mux_id].pushSequenceId = _sessions[mux_id].pushSequenceId == 0xFFFF ? 1 : _sessions[mux_id].pushSequenceId + 1;
+      len = protocolWriteFrameHeader(buffer, _sessions[mux_id].pushSequenceId, count);
+    } else if (mux_id < PROTOCOL_MAX_CONNECTIONS && _sessions[mux_id].decoder.getVersion() == 2) {
+      len = protocolWriteFrameHeader(buffer, 0, count);
+    }
+    for (uint8_t i = 0; i < count; i++) {
+      len += protocolWritePacket(&buffer[len], commands[i], payloads[i]);
+    }
+    if (!send(mux_id, buffer, len)) {
+      return false;
     }
+    traceSent(mux_id, &buffer[len - count * PROTOCOL_PACKET_SIZE], count);
+    return true;
   }
 
-  bool ProxyControlServer::closeServer() {
-    if (_wifi.stopTCPServer()) {
-      Serial.println(F("\t\t--> Stopping TCP Server ... SUCCESS"));
-    } else {
-      Serial.println(F("\t\t--> Stopping TCP Server ... ERROR"));
+  /* one write to a client; a client the transport cannot reach is gone, its session is closed */
+  bool ProxyControlServer::send(uint8_t mux_id, const uint8_t *buffer, uint8_t len) {
+    unsigned long start = micros();
+    bool sent = _transport->send(mux_id, buffer, len);
+    ProxyStats::record(STATS_SEND_TIME, micros() - start);
+    if (sent) {
+      return true;
+    }
+    LOG_ERROR(F("\t\t--> ERROR sending data, connection closed: "));
+    LOG_ERRORLN(mux_id);
+    if (mux_id < PROTOCOL_MAX_CONNECTIONS) {
+      closeSession(mux_id);
+    }
+    return false;
+  }
+
+  /* a client that starts talking on mux_id, subscribed to the button events as clients before subscriptions */
+  void ProxyControlServer::openSession(uint8_t mux_id) {
+    ProxySession &session = _sessions[mux_id];
+    session.open = true;
+    session.events = isDatagram(mux_id) ? 0 : PROTOCOL_EVENTS_BUTTON;   //events are not to be lost, they go over TCP
+    LOG_TRACE(F("\t\t--> Session opened: "));
+    LOG_TRACELN(mux_id);
+  }
+
+  /* forgets the client on mux_id: nothing is sent to it until it talks again, then as a new client */
+  void ProxyControlServer::closeSession(uint8_t mux_id) {
+    ProxySession &session = _sessions[mux_id];
+    session.open = false;
+    session.events = 0;
+    session.axis = _defaultAxis;
+    session.telemetryAxis = _defaultAxis;
+    session.telemetryInterval = 0;
+    session.lastTelemetry = 0;
+    session.waypoint.speed = 0;
+    session.waypoint.dwell = 0;
+    session.waypoint.startAt = 0;
+    session.followVelocity = 0;
+    session.synced = false;
+    session.sequenceId = 0;
+    session.pushSequenceId = 0;
+    session.lastDatagram = 0;
+    ProxyStats::countMalformed(session.decoder.takeDroppedBytes());
+    session.decoder.reset();
+  }
+
+  /* the transport connects to the server of the client on mux_id (see ProxyTransport), the session moves to mux 0
+     and the bytes go through from then on. The transport serves again if it cannot connect. */
+  bool ProxyControlServer::startPassthrough(uint8_t mux_id, uint16_t port) {
+    ProxySession session = _sessions[mux_id];
+    uint8_t result = _transport->startPassthrough(mux_id, port);
+    if (result == TRANSPORT_PASSTHROUGH_REFUSED) {
+      LOG_ERRORLN(F("\t\t--> Passthrough refused, not the only client!"));
+      sendResponse(mux_id, PROTOCOL_PASSTHROUGH, -1);
+      return false;
+    }
+    for (uint8_t i = 0; i < PROTOCOL_MAX_CONNECTIONS; i++) {
+      closeSession(i);
+    }
+    if (result != TRANSPORT_PASSTHROUGH_STARTED) {
+      LOG_ERRORLN(F("\t\t--> Passthrough failed, back to the TCP server!"));
+      return false;
     }
+    _sessions[0] = session;
+    _sessions[0].open = true;
+    return true;
+  }
+
+  /* back to the server for several clients */
+  void ProxyControlServer::stopPassthrough() {
+    if (!_transport->isPassthrough()) {
+      return;
+    }
+    _transport->stopPassthrough();
+    closeSession(0);
+  }
+
+  bool ProxyControlServer::isPassthrough() {
+    return _transport->isPassthrough();
+  }
+
+  bool ProxyControlServer::closeServer() {
+    return _transport->stop();
   }
 
   uint8_t ProxyControlServer::getLastMuxID() {
     return _lastMuxID;
   }
 
+  uint8_t ProxyControlServer::getSessionCount() {
+    uint8_t count = 0;
+    for (uint8_t mux_id = 0; mux_id < PROTOCOL_MAX_CONNECTIONS; mux_id++) {
+      count += _sessions[mux_id].open ? 1 : 0;
+    }
+    return count;
+  }
+
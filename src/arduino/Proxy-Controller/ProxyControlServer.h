@@ -5,51 +5,91 @@
 #ifndef ProxyControlServer_h
 #define ProxyControlServer_h
 
-//TARGET PLATFORM
-#define PLATFORM_UNO
-//#define PLATFORM_MEGA     //un-comment only the target platform
-
-#ifdef PLATFORM_UNO
-  #define SOFT_SERIAL_RX 7
-  #define SOFT_SERIAL_TX 8
-  //go to the ESP8266.h file in the libraries folder and un-comment "#define ESP8266_USE_SOFTWARE_SERIAL"
-#endif
-
 #include "Arduino.h"
 #include "Proxy.h"
-#include "ESP8266.h"
-#ifdef PLATFORM_UNO
-  #include <SoftwareSerial.h>
-#endif
+#include "ProxyProtocol.h"
+#include "ProxyStats.h"
+#include "ProxyTransport.h"
 
 
-class ProxyControlServer {
+#define SESSION_FRAME_TIME 20000        //us a frame whose replies are sent may take (an AT+CIPSEND round trip), see handleReceived()
+
+/* one client connection (ESP8266 mux id), opened by the first data the client sends */
+struct ProxySession {
+  bool open;
+  uint8_t events;                       //pushed events subscribed to, PROTOCOL_EVENTS_*
+  uint8_t axis;                         //selected by the client, see PROTOCOL_SELECT_AXIS
+  uint8_t telemetryAxis;
+  uint16_t telemetryInterval;           //ms, 0 = not subscribed
+  unsigned long lastTelemetry;
+  Waypoint waypoint;                    //fields for the next PROTOCOL_WAYPOINT_APPEND
+  long followVelocity;                  //steps/s for the next PROTOCOL_FOLLOW_SETPOINT
+  bool synced;                          //datagram endpoint: sequenceId is the last frame taken, see PROTOCOL_UDP_PORT
+  uint16_t sequenceId;
+  uint16_t pushSequenceId;              //datagram endpoint: of the last frame pushed unasked
+  unsigned long lastDatagram;           //ms
+  ProtocolDecoder decoder;              //packets may be split over or coalesced into reads
+};
+
+class ProxyControlServer : public TransportListener {
   public:
     ProxyControlServer();
-    void init(bool connectToWifi, String ssid, String pw, int port, int timeout, Proxy* proxy, float versioninfo, void (*beep)(int) = NULL, void (*light)(int) = NULL);
+    void init(ProxyTransport *transport, Proxy* proxy, float versioninfo, void (*beep)(int) = NULL, void (*light)(int) = NULL);
     bool startServer();
+    bool startDatagrams(uint16_t port);
     bool listenForCommands();
+    void sendTelemetry();
     bool closeServer();
     void sendResponse(uint8_t mux_id, uint8_t command, float payload);
-    void sendButtonEvent(uint8_t mux_id, int buttonEvent, float payload);
+    void queueButtonEvent(const ButtonEvent &event, float position);
     uint8_t getLastMuxID();
+    uint8_t getSessionCount();
+    bool isPassthrough();
+    void onReceived(uint8_t mux_id, uint8_t data);
+    void onClosed(uint8_t mux_id);
 
   private:
-    String _ssid, _pw;
     float _version;
-    Proxy* _proxy;
-    int _port, _timeout;
-    int _commandsReceived;
+    uint8_t _defaultAxis;
     uint8_t _lastMuxID;
-    #ifdef PLATFORM_UNO
-      SoftwareSerial _serial1 = SoftwareSerial(SOFT_SERIAL_RX, SOFT_SERIAL_TX);
-    #else
-      HardwareSerial _serial1 = Serial1;
-    #endif
-    ESP8266 _wifi;
-    void (*_beep)(int);
+    ProxyTransport *_transport;
+    void (*_beep)(int);           //return at once, the patterns play from Feedback::update()
     void (*_light)(int);
+    ProxySession _sessions[PROTOCOL_MAX_CONNECTIONS];
+    uint8_t _replyFrame[PROTOCOL_V2_MAX_FRAME_SIZE];   //replies to the v2 frame being handled
+    uint8_t _replyCount, _replyMuxID;
+    bool _batchReplies;
+    bool _datagrams;                      //the transport serves the datagram endpoint on PROTOCOL_UDP_MUX
+    long _stagedTarget[STEP_SCHEDULER_MAX_AXES];               //steps, STEP_SCHEDULER_NO_TARGET = none, see PROTOCOL_STAGE_TARGET
+    bool _telemetryMoving[STEP_SCHEDULER_MAX_AXES];
+    uint8_t _powerReported[STEP_SCHEDULER_MAX_AXES];           //POWER_* last pushed with PROTOCOL_EVENTS_POWER
+    long _passthroughRequest;             //port to connect to, 0 = back to the server, -1 = none (see PROTOCOL_PASSTHROUGH)
+    uint8_t _passthroughMuxID;            //the client that asked
+    uint8_t _nextSession;                 //whose frames are handled first, see handleReceived()
+    ButtonEvent _buttonEvents[BUTTON_QUEUE_SIZE];   //to be sent by listenForCommands()
+    float _buttonPositions[BUTTON_QUEUE_SIZE];
+    uint8_t _buttonEventCount;
 
+    void handleFrame(uint8_t mux_id, ProtocolFrame &frame);
+    bool isDatagram(uint8_t mux_id);
+    bool takeDatagram(ProxySession &session, const ProtocolFrame &frame);
     void handleCommand(uint8_t mux_id, uint8_t command, float payload);  
+    void sendStats(uint8_t mux_id, float payload);
+    void sendTrace(uint8_t mux_id);
+    void traceSent(uint8_t mux_id, const uint8_t *packets, uint8_t count);
+    long checkTarget(Proxy* proxy, long target);
+    bool sendPackets(uint8_t mux_id, const uint8_t *commands, const float *payloads, uint8_t count);
+    bool send(uint8_t mux_id, const uint8_t *buffer, uint8_t len);
+    bool receivePending();
+    bool handleReceived();
+    bool startPassthrough(uint8_t mux_id, uint16_t port);
+    void stopPassthrough();
+    void openSession(uint8_t mux_id);
+    void closeSession(uint8_t mux_id);
+    Proxy* axis(uint8_t mux_id);
+    bool isMoving(uint8_t id);
+    void sendButtonEvents();
+    void sendButtonEvent(const ButtonEvent &event, float position);
+    void sendPowerEvents();
 };
 #endif
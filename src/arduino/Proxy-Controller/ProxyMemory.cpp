@@ -0,0 +1,55 @@
+/*
+  ProxyMemory.cpp - Free SRAM of the controller and its low watermark, read by the clients with PROTOCOL_MEMORY.
+*/
+
+#include "Arduino.h"
+#include "ProxyMemory.h"
+
+#ifdef __AVR__
+extern char __heap_start;         //from the linker: the end of the static data
+extern char *__brkval;            //from malloc(): the end of the heap, 0 before the first allocation
+
+static char *heapEnd() {
+  return __brkval != 0 ? __brkval : &__heap_start;
+}
+#endif
+
+/* first thing in setup(), before the stack gets deep */
+void ProxyMemory::begin() {
+#ifdef __AVR__
+  for (char *p = heapEnd(); p < (char *)SP - MEMORY_STACK_GUARD; p++) {
+    *p = MEMORY_PAINT;
+  }
+#endif
+}
+
+/* bytes between the heap and the stack now */
+uint16_t ProxyMemory::getFree() {
+#ifdef __AVR__
+  return (char *)SP - heapEnd();
+#else
+  return 0;
+#endif
+}
+
+/* bytes between the heap and the deepest the stack got since begin() */
+uint16_t ProxyMemory::getLowWatermark() {
+#ifdef __AVR__
+  uint16_t free = 0;
+  for (char *p = heapEnd(); p < (char *)SP && *p == (char)MEMORY_PAINT; p++) {
+    free++;
+  }
+  return free;
+#else
+  return 0;
+#endif
+}
+
+/* bytes taken by malloc() (String, new), 0 as long as nothing was allocated */
+uint16_t ProxyMemory::getHeapUsed() {
+#ifdef __AVR__
+  return __brkval != 0 ? __brkval - &__heap_start : 0;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,28 @@
+/*
+  ProxyMemory.h - Free SRAM of the controller and its low watermark, read by the clients with PROTOCOL_MEMORY.
+
+  The UNO has 2 KB of SRAM for the static data, the heap and the stack. begin() paints the free space between the end
+  of the heap and the stack with MEMORY_PAINT; the stack grows down into it and overwrites the paint as deep as it ever
+  got (interrupts included), so the paint still found above the heap is the least free memory since the start. The
+  firmware allocates nothing on the heap after setup(), getHeapUsed() shows if that still holds.
+  On the host (no AVR memory map) all three read 0.
+*/
+
+#ifndef ProxyMemory_h
+#define ProxyMemory_h
+
+#include "Arduino.h"
+
+#define MEMORY_PAINT 0xA5
+#define MEMORY_STACK_GUARD 64     //bytes below the stack pointer left unpainted, room for the frame of an interrupt
+
+class ProxyMemory
+{
+  public:
+    static void begin();
+    static uint16_t getFree();
+    static uint16_t getLowWatermark();
+    static uint16_t getHeapUsed();
+};
+
+#endif
@@ -0,0 +1,156 @@
+/*
+  ProxyProtocol.cpp - Framing of the WiFi protocol between the ProxyControlServer and its clients.
+*/
+
+#include "Arduino.h"
+#include "ProxyProtocol.h"
+
+ProtocolDecoder::ProtocolDecoder() {
+  reset();
+}
+
+void ProtocolDecoder::reset() {
+  _head = 0;
+  _count = 0;
+  _lastReceived = 0;
+  _version = 1;
+  _droppedBytes = 0;
+}
+
+/* appends received bytes; the rest of a packet split over several segments must follow within PROTOCOL_PARTIAL_TIMEOUT */
+bool ProtocolDecoder::push(const uint8_t *data, uint32_t len, unsigned long now) {
+  bool complete = true;
+  if (_count > 0 && now - _lastReceived > PROTOCOL_PARTIAL_TIMEOUT) {
+    _droppedBytes += _count;
+    drop(_count);
+    complete = false;
+  }
+  _lastReceived = now;
+  for (uint32_t i = 0; i < len; i++) {
+    if (_count == PROTOCOL_RX_BUFFER_SIZE) {   //more than a frame pending: the stream is broken, start over
+      _droppedBytes += _count;
+      drop(_count);
+      complete = false;
+    }
+    _buffer[(_head + _count) % PROTOCOL_RX_BUFFER_SIZE] = data[i];
+    _count++;
+  }
+  return complete;
+}
+
+/* takes the next complete v1 packet or v2 frame off the buffer */
+bool ProtocolDecoder::next(ProtocolFrame &frame) {
+  while (_count > 0) {
+    if (peek(0) != PROTOCOL_V2_MAGIC) {        //v1 packet
+      if (_count < PROTOCOL_PACKET_SIZE) {
+        return false;
+      }
+      frame.version = 1;
+      frame.sequenceId = 0;
+      frame.count = 1;
+      frame.commands[0] = peek(0);
+      uint8_t payload[4];
+      for (uint8_t i = 0; i < 4; i++) {
+        payload[i] = peek(1 + i);
+      }
+      memcpy(&frame.payloads[0], payload, sizeof(float));
+      drop(PROTOCOL_PACKET_SIZE);
+      return true;
+    }
+
+    if (_count < 3) {
+      return false;
+    }
+    uint8_t length = peek(2);
+    uint8_t count = (length - 2) / PROTOCOL_PACKET_SIZE;
+    if (peek(1) != 2 || length < 2 + PROTOCOL_PACKET_SIZE || (length - 2) % PROTOCOL_PACKET_SIZE != 0 || count > PROTOCOL_V2_MAX_COMMANDS) {
+      _droppedBytes++;                          //no frame header, resynchronise on the next byte
+      drop(1);
+      continue;
+    }
+    if (_count < 3 + length) {
+      return false;
+    }
+    frame.version = 2;
+    frame.sequenceId = peek(3) | (peek(4) << 8);
+    frame.count = count;
+    for (uint8_t c = 0; c < count; c++) {
+      uint8_t offset = PROTOCOL_V2_HEADER_SIZE + c * PROTOCOL_PACKET_SIZE;
+      uint8_t payload[4];
+      for (uint8_t i = 0; i < 4; i++) {
+        payload[i] = peek(offset + 1 + i);
+      }
+      frame.commands[c] = peek(offset);
+      memcpy(&frame.payloads[c], payload, sizeof(float));
+    }
+    drop(3 + length);
+    return true;
+  }
+  return false;
+}
+
+uint8_t ProtocolDecoder::getVersion() {
+  return _version;
+}
+
+void ProtocolDecoder::setVersion(uint8_t version) {
+  _version = version;
+}
+
+/* the bytes given up since the last call */
+uint16_t ProtocolDecoder::takeDroppedBytes() {
+  uint16_t dropped = _droppedBytes;
+  _droppedBytes = 0;
+  return dropped;
+}
+
+uint8_t ProtocolDecoder::peek(uint8_t index) {
+  return _buffer[(_head + index) % PROTOCOL_RX_BUFFER_SIZE];
+}
+
+void ProtocolDecoder::drop(uint8_t n) {
+  _head = (_head + n) % PROTOCOL_RX_BUFFER_SIZE;
+  _count -= n;
+}
+
+float protocolFromInt(int32_t value) {
+  float payload;
+  memcpy(&payload, &value, sizeof(float));
+  return payload;
+}
+
+int32_t protocolToInt(float payload) {
+  int32_t value;
+  memcpy(&value, &payload, sizeof(int32_t));
+  return value;
+}
+
+bool protocolDatagramAllowed(uint8_t command) {
+  switch (command) {
+    case 0:                                 //REQUEST_POSITION
+    case PROTOCOL_STEPS_POSITION:
+    case PROTOCOL_STEPS_POSITION_Q16:
+    case PROTOCOL_SELECT_AXIS:
+    case PROTOCOL_TELEMETRY_SUBSCRIBE:
+    case PROTOCOL_FOLLOW_VELOCITY:
+    case PROTOCOL_FOLLOW_SETPOINT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+uint8_t protocolWritePacket(uint8_t *buffer, uint8_t command, float payload) {
+  buffer[0] = command;
+  memcpy(&buffer[1], &payload, sizeof(float));
+  return PROTOCOL_PACKET_SIZE;
+}
+
+uint8_t protocolWriteFrameHeader(uint8_t *buffer, uint16_t sequenceId, uint8_t count) {
+  buffer[0] = PROTOCOL_V2_MAGIC;
+  buffer[1] = 2;
+  buffer[2] = 2 + count * PROTOCOL_PACKET_SIZE;
+  buffer[3] = sequenceId & 0xFF;
+  buffer[4] = sequenceId >> 8;
+  return PROTOCOL_V2_HEADER_SIZE;
+}
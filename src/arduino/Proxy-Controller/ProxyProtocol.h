@@ -0,0 +1,224 @@
+/*
+  ProxyProtocol.h - Framing of the WiFi protocol between the ProxyControlServer and its clients.
+
+  v1 (COMMANDS): one command per packet, 5 bytes
+    [command][payload: float, little endian]
+
+  v2: several commands per frame, replies are batched into one frame carrying the same sequence id
+    [0xA5][version = 2][length][sequence id: uint16, little endian]{[command][payload: float]} x 1..PROTOCOL_V2_MAX_COMMANDS
+    length counts the bytes after the length byte (2 + 5 per command).
+    Sequence id 0 is used by the server for unsolicited frames (button events), so clients start at 1.
+
+  Both formats are accepted on every connection and told apart by the first byte (v1 commands are < 0x80).
+  A client negotiates with command PROTOCOL_VERSION_COMMAND (payload = wanted version, reply = agreed
+  version); the agreed version is then also used for the messages the server sends unasked.
+*/
+
+#ifndef ProxyProtocol_h
+#define ProxyProtocol_h
+
+#include "Arduino.h"
+
+#define PROTOCOL_PACKET_SIZE 5                //v1 packet, and one command inside a v2 frame
+#define PROTOCOL_V2_MAGIC 0xA5
+#define PROTOCOL_V2_HEADER_SIZE 5             //magic, version, length, sequence id
+#define PROTOCOL_V2_MAX_COMMANDS 5
+#define PROTOCOL_V2_MAX_FRAME_SIZE (PROTOCOL_V2_HEADER_SIZE + PROTOCOL_V2_MAX_COMMANDS * PROTOCOL_PACKET_SIZE)
+#define PROTOCOL_VERSION_COMMAND 13
+#define PROTOCOL_MAX_VERSION 2
+
+//TELEMETRY: subscribe with the wanted rate in Hz (0 = off), the reply carries the rate applied.
+//While the weight moves, each sample is pushed as POSITION, VELOCITY and TARGET_REACHED in one write
+//(one frame for v2 clients), followed by MOVE_COMPLETED with the final position when the move ends.
+#define PROTOCOL_TELEMETRY_SUBSCRIBE 14
+#define PROTOCOL_TELEMETRY_POSITION 15        //[0,1]
+#define PROTOCOL_TELEMETRY_VELOCITY 16        //[0,1] per second, negative towards 0
+#define PROTOCOL_TELEMETRY_TARGET_REACHED 17  //0 or 1
+#define PROTOCOL_EVENT_MOVE_COMPLETED 18      //final position
+#define PROTOCOL_TELEMETRY_MAX_RATE 20        //Hz, every push is a full AT+CIPSEND round trip
+
+//MOTION LIMITS: the payload is the new limit, the reply carries the limit applied.
+//The maximum velocity is set with command 2 (SEND_NEW_SPEED) in steps/s.
+#define PROTOCOL_SET_ACCELERATION 19          //steps/s^2
+#define PROTOCOL_SET_JERK 20                  //steps/s^3, 0 = trapezoidal profiles
+
+//PREDICTION_ERROR: how far the expected times (replies to commands 1 and 6) were off, in ms.
+//payload 0 = last move (signed, positive = took longer), 1 = mean absolute, 2 = maximum absolute
+#define PROTOCOL_PREDICTION_ERROR 21
+
+//AXES: a controller may drive several weight axes (see StepScheduler). Every command addresses the axis last
+//selected on its connection, axis 0 until then; SELECT_AXIS replies with the axis selected. Telemetry reports
+//the axis that was selected when subscribing. STAGE_TARGET keeps a target position for the selected axis
+//(reply: the target), MOVE_STAGED starts all staged targets at once, planned to arrive together
+//(reply: the expected time in ms).
+#define PROTOCOL_SELECT_AXIS 22
+#define PROTOCOL_STAGE_TARGET 23
+#define PROTOCOL_MOVE_STAGED 24
+
+//EVENTS: every connected client is sent the button events (commands 7 and 8) until it subscribes to a different
+//set. payload = the events wanted as a bit mask of PROTOCOL_EVENTS_*, the reply carries the mask applied.
+//The payload of a button event is the position of the axis when the button changed. With EVENTS_BUTTON_TIME, the
+//event is followed by EVENT_TIME in the same write, whose 4 payload bytes are the uint32 micros() of the change
+//on the controller (little endian, not a float), for the time between events. EVENTS_POWER pushes POWER_STATE whenever the
+//power state of the axis selected on the connection changes (see POWER).
+#define PROTOCOL_SUBSCRIBE_EVENTS 25
+#define PROTOCOL_EVENTS_BUTTON 0x01
+#define PROTOCOL_EVENTS_BUTTON_TIME 0x02
+#define PROTOCOL_EVENTS_POWER 0x04
+#define PROTOCOL_EVENTS_ALL (PROTOCOL_EVENTS_BUTTON | PROTOCOL_EVENTS_BUTTON_TIME | PROTOCOL_EVENTS_POWER)
+#define PROTOCOL_EVENT_TIME 35
+
+//WAYPOINTS: a queue of targets the selected axis moves through back to back (see WaypointQueue), no round trip
+//in between. SPEED (steps/s, 0 = the axis' speed), DWELL (ms) and START_AT (ms after the queue started, 0 = right
+//after the waypoint before) set the fields of the next waypoint appended on the connection, they return to these
+//defaults with every APPEND. APPEND adds a waypoint at the position in the payload and replies with the number
+//queued, -1 if the queue is full. An axis at rest starts with the first waypoint appended, which is when the start
+//times count from; a running move is finished first. A new target (command 1) or a button press ends the queue.
+//CLEAR drops the waypoints not yet started (reply: 0), QUERY replies with the number queued (payload 0) or the
+//free slots (payload 1).
+#define PROTOCOL_WAYPOINT_SPEED 26
+#define PROTOCOL_WAYPOINT_DWELL 27
+#define PROTOCOL_WAYPOINT_START_AT 28
+#define PROTOCOL_WAYPOINT_APPEND 29
+#define PROTOCOL_WAYPOINT_CLEAR 30
+#define PROTOCOL_WAYPOINT_QUERY 31
+
+//PASSTHROUGH: single-client fast path. The only client connected opens a TCP server of its own and sends its port;
+//the controller replies with the port (-1 if refused: other clients are connected), closes the connection and has
+//the module connect to the client's server in passthrough, where the bytes go through both ways without an
+//AT+CIPSEND round trip per reply (the module sends what it got every 20 ms). The session (protocol version, axis,
+//subscriptions) carries over. If the module cannot connect, the controller is a TCP server again and the client
+//connects as a new one.
+//Payload 0 or DISCONNECT (10) goes back to the TCP server for several clients, the client connects again then.
+#define PROTOCOL_PASSTHROUGH 32
+
+//STATS: performance counters (see ProxyStats.h). payload = page 0 .. STATS_PAGE_COUNT - 1, the reply is STATS with the
+//page (-1: no such page) followed by STATS_PAGE_WORDS packets STATS_DATA, whose 4 payload bytes are a uint32 each
+//(little endian, not a float). Payload -1 resets the counters (reply: STATS -1 alone).
+//Times are in us; page 0 = ms since the reset, commands handled, malformed bytes and packets, missed step deadlines.
+//STATS_TASK_PAGE on: the budget overruns and the longest run of the tasks of the main loop (see TaskScheduler.h).
+#define PROTOCOL_STATS 33
+#define PROTOCOL_STATS_DATA 34
+#define PROTOCOL_STATS_RESET -1
+
+//STEPS: integer counterparts of commands 0, 1 and 6, in absolute steps (0 and RANGE are the positions 0 and 1) or in Q16
+//fractions of the range (65536 = 1.0). Their payloads are int32 (little endian, not a float), so positions are exact on any rail
+//length and the controller needs no float math to take them. POSITION and POSITION_Q16 reply with the current position,
+//TARGET and TARGET_Q16 start a move like command 1 and EXPECTED_TIME replies like command 6: with the expected time in
+//ms, or a PROTOCOL_STATUS_* (the axis is not calibrated, or the target is outside [0, RANGE]) without moving.
+//RANGE replies with the steps from 0 to 1.0, PROTOCOL_STATUS_NOT_CALIBRATED before the calibration is done.
+#define PROTOCOL_STEPS_POSITION 36
+#define PROTOCOL_STEPS_TARGET 37
+#define PROTOCOL_STEPS_EXPECTED_TIME 38
+#define PROTOCOL_STEPS_RANGE 39
+#define PROTOCOL_STEPS_POSITION_Q16 40
+#define PROTOCOL_STEPS_TARGET_Q16 41
+#define PROTOCOL_Q16_ONE 65536L
+
+//FOLLOW: for clients that stream targets, e.g. one per rendered frame. FOLLOW with payload 1 puts the selected axis into
+//follow mode, 0 ends it (reply: 1 or 0 as applied, PROTOCOL_STATUS_NOT_CALIBRATED if the axis is not calibrated).
+//SETPOINT (int32 steps, held within [0, RANGE]) is not answered: the axis heads for the newest setpoint with its speed
+//and acceleration limits, a setpoint that comes before the axis got to the one before replaces it (latest wins), the
+//move is not planned anew. VELOCITY (int32 steps/s, not answered) is the velocity hint for the next SETPOINT on the
+//connection: the axis then heads for where the setpoint has moved on to, for up to FOLLOW_MAX_EXTRAPOLATION ms after
+//it came, so send both in one write or frame. A target (command 1) or a waypoint ends follow mode.
+#define PROTOCOL_FOLLOW 42
+#define PROTOCOL_FOLLOW_SETPOINT 43
+#define PROTOCOL_FOLLOW_VELOCITY 44
+
+//TRACE: recording of the traffic for the replay on the host (see ProxyTrace.h). Payload 1 drops the trace and starts
+//recording, 0 stops, any other value leaves it as it is; the reply carries the records held (int32). TRACE_READ takes the
+//oldest records off the trace: the reply is TRACE_READ with the number of records that follow (int32, up to
+//TRACE_READ_RECORDS), then two TRACE_DATA packets per record, whose 4 payload bytes are a uint32 each (little endian,
+//not a float): the us since the record before | kind << 16 | command << 24 (kind: TRACE_* << 4 | mux id), then the
+//payload of the command. A TRACE_TIME record sets the time to its payload (micros() of the controller) instead.
+#define PROTOCOL_TRACE 45
+#define PROTOCOL_TRACE_READ 46
+#define PROTOCOL_TRACE_DATA 47
+
+//MEMORY: SRAM of the controller (see ProxyMemory.h), the reply carries the bytes (int32) or PROTOCOL_STATUS_OUT_OF_RANGE for
+//another payload. payload 0 = free now, 1 = least free since the start (low watermark), 2 = taken by the heap (0 unless
+//something was allocated). All three are 0 on the host build.
+#define PROTOCOL_MEMORY 48
+#define PROTOCOL_MEMORY_FREE 0
+#define PROTOCOL_MEMORY_LOW_WATERMARK 1
+#define PROTOCOL_MEMORY_HEAP 2
+
+//POWER: the coils of the selected axis are at the stepping current while it moves and for HOLD_DELAY ms at rest after, then
+//at HOLD_CURRENT % of it, and released (the weight is not held) once at rest for RELEASE_DELAY ms. The next move starts at
+//the stepping current again, a released axis pulls the rotor back onto the step it counts first. The delays (int32 ms,
+//0 = never) and the hold current (int32 %, 1 .. 100) are set with their commands, the reply carries the value applied; they
+//are saved with the calibration. POWER_STATE replies with the state (int32): 0 = full, 1 = hold, 2 = released (POWER_* in
+//Proxy.h), and is pushed with EVENTS_POWER. Command 9 (SAVE_POWER) releases the axis at once.
+#define PROTOCOL_POWER_HOLD_DELAY 49
+#define PROTOCOL_POWER_RELEASE_DELAY 50
+#define PROTOCOL_POWER_HOLD_CURRENT 51
+#define PROTOCOL_POWER_STATE 52
+
+//DATAGRAMS: an optional UDP endpoint on PROTOCOL_UDP_PORT next to the TCP server, for streamed setpoints and telemetry, where
+//a late packet is worth less than a lost one (no retransmission, no head-of-line blocking). It is one more session, on mux
+//PROTOCOL_UDP_MUX (the TCP server takes one client less while it is open), talking to whoever sent the last datagram. Every
+//datagram is one v2 frame, v1 packets are dropped; a frame whose sequence id is not newer than the last one taken (a late
+//or repeated datagram) is dropped, unless the endpoint was silent for PROTOCOL_UDP_RESYNC_TIME ms. Only the commands of
+//protocolDatagramAllowed() are handled: the position requests (0, 36, 40), SELECT_AXIS, TELEMETRY_SUBSCRIBE, and the
+//unanswered FOLLOW_VELOCITY and FOLLOW_SETPOINT; everything else (calibration, stepping mode, FOLLOW itself, ...) stays on
+//TCP. Replies carry the sequence id of their frame, the telemetry pushed to the endpoint a sequence id of its own counting up
+//from 1, so the client sees what was lost. There is no endpoint while in passthrough.
+#define PROTOCOL_UDP_PORT 8091
+#define PROTOCOL_UDP_MUX (PROTOCOL_MAX_CONNECTIONS - 1)
+#define PROTOCOL_UDP_RESYNC_TIME 1000
+
+//STATUS of the int32 replies, negative so they never collide with a time or a range
+#define PROTOCOL_STATUS_NOT_CALIBRATED -1
+#define PROTOCOL_STATUS_OUT_OF_RANGE -2
+
+//ACK: the payload of the replies to commands 2, 5, 9 and 11, the bytes 'O', 'K', 0, 0
+#define PROTOCOL_ACK 0x00004B4FUL
+
+#define PROTOCOL_MAX_CONNECTIONS 5            //ESP8266 multi-client mode: mux ids 0..4
+#define PROTOCOL_RX_BUFFER_SIZE 32            //per connection, holds one complete v2 frame
+#define PROTOCOL_PARTIAL_TIMEOUT 250          //ms until the rest of a split packet is given up
+
+/* one received v1 packet or v2 frame */
+struct ProtocolFrame {
+  uint8_t version;
+  uint16_t sequenceId;
+  uint8_t count;
+  uint8_t commands[PROTOCOL_V2_MAX_COMMANDS];
+  float payloads[PROTOCOL_V2_MAX_COMMANDS];
+};
+
+/* incremental parser for the byte stream of one client connection */
+class ProtocolDecoder {
+  public:
+    ProtocolDecoder();
+    void reset();
+    bool push(const uint8_t *data, uint32_t len, unsigned long now);
+    bool next(ProtocolFrame &frame);
+    uint8_t getVersion();
+    void setVersion(uint8_t version);
+    uint16_t takeDroppedBytes();
+
+  private:
+    uint8_t _buffer[PROTOCOL_RX_BUFFER_SIZE];
+    uint8_t _head, _count;
+    unsigned long _lastReceived;
+    uint8_t _version;
+    uint16_t _droppedBytes;
+
+    uint8_t peek(uint8_t index);
+    void drop(uint8_t n);
+};
+
+/* the 4 payload bytes as an int32 and back, for the commands whose payload is not a float */
+float protocolFromInt(int32_t value);
+int32_t protocolToInt(float payload);
+
+/* whether the command is handled when it comes as a datagram, see PROTOCOL_UDP_PORT */
+bool protocolDatagramAllowed(uint8_t command);
+
+/* serialises packets and frames into buffer, returns the number of bytes written */
+uint8_t protocolWritePacket(uint8_t *buffer, uint8_t command, float payload);
+uint8_t protocolWriteFrameHeader(uint8_t *buffer, uint16_t sequenceId, uint8_t count);
+
+#endif
@@ -0,0 +1,129 @@
+/*
+  ProxyStats.cpp - Performance counters of the controller, read by the clients with PROTOCOL_STATS.
+*/
+
+#include "Arduino.h"
+#include "ProxyStats.h"
+
+StatsHistogram ProxyStats::_timings[STATS_TIMINGS];
+uint16_t ProxyStats::_commands[STATS_COMMANDS];
+uint32_t ProxyStats::_malformed = 0;
+uint32_t ProxyStats::_missedSteps = 0;
+uint16_t ProxyStats::_taskOverruns[STATS_TASKS];
+uint32_t ProxyStats::_taskLongest[STATS_TASKS];
+unsigned long ProxyStats::_resetTime = 0;
+
+static uint32_t saturatingAdd(uint32_t a, uint32_t b) {
+  return a + b < a ? 0xFFFFFFFF : a + b;
+}
+
+void ProxyStats::record(uint8_t timing, uint32_t us) {
+  if (timing >= STATS_TIMINGS) {
+    return;
+  }
+  StatsHistogram &h = _timings[timing];
+  if (h.count == 0 || us < h.min) {
+    h.min = us;
+  }
+  if (us > h.max) {
+    h.max = us;
+  }
+  h.count = saturatingAdd(h.count, 1);
+  h.sum = saturatingAdd(h.sum, us);
+  uint8_t bucket = 0;
+  for (uint32_t rest = us >> STATS_BUCKET_FIRST; rest > 0 && bucket < STATS_BUCKETS - 1; rest >>= 2) {
+    bucket++;
+  }
+  if (h.buckets[bucket] < 0xFFFF) {
+    h.buckets[bucket]++;
+  }
+}
+
+void ProxyStats::countCommand(uint8_t command) {
+  if (command >= STATS_COMMANDS) {
+    countMalformed(1);
+  } else if (_commands[command] < 0xFFFF) {
+    _commands[command]++;
+  }
+}
+
+void ProxyStats::countMalformed(uint16_t bytes) {
+  _malformed = saturatingAdd(_malformed, bytes);
+}
+
+void ProxyStats::countMissedStep() {
+  _missedSteps = saturatingAdd(_missedSteps, 1);
+}
+
+/* one run of a task, overrun: it took longer than its budget */
+void ProxyStats::recordTask(uint8_t task, uint32_t us, bool overrun) {
+  if (task >= STATS_TASKS) {
+    return;
+  }
+  if (overrun && _taskOverruns[task] < 0xFFFF) {
+    _taskOverruns[task]++;
+  }
+  if (us > _taskLongest[task]) {
+    _taskLongest[task] = us;
+  }
+}
+
+void ProxyStats::reset() {
+  noInterrupts();
+  memset(_timings, 0, sizeof(_timings));
+  memset(_commands, 0, sizeof(_commands));
+  _malformed = 0;
+  _missedSteps = 0;
+  memset(_taskOverruns, 0, sizeof(_taskOverruns));
+  memset(_taskLongest, 0, sizeof(_taskLongest));
+  interrupts();
+  _resetTime = millis();
+}
+
+/* fills words with page 0 .. STATS_PAGE_COUNT - 1, false for any other:
+   0: ms since the reset, commands counted, malformed, missed steps
+   1 + 2 * timing: count, sum, min, max of the timing
+   2 + 2 * timing: its buckets, two per word (the lower one in the low half)
+   1 + 2 * STATS_TIMINGS on: the count per command id, two per word
+   STATS_TASK_PAGE: the overruns per task, two per word, then the longest run of every task (us) a word each */
+bool ProxyStats::getPage(uint8_t page, uint32_t *words) {
+  if (page >= STATS_PAGE_COUNT) {
+    return false;
+  }
+  noInterrupts();
+  if (page == 0) {
+    uint32_t commands = 0;
+    for (uint8_t i = 0; i < STATS_COMMANDS; i++) {
+      commands += _commands[i];
+    }
+    words[0] = millis() - _resetTime;
+    words[1] = commands;
+    words[2] = _malformed;
+    words[3] = _missedSteps;
+  } else if (page <= 2 * STATS_TIMINGS) {
+    StatsHistogram &h = _timings[(page - 1) / 2];
+    if (page % 2 == 1) {
+      words[0] = h.count;
+      words[1] = h.sum;
+      words[2] = h.min;
+      words[3] = h.max;
+    } else {
+      for (uint8_t i = 0; i < STATS_PAGE_WORDS; i++) {
+        words[i] = h.buckets[2 * i] | ((uint32_t) h.buckets[2 * i + 1] << 16);
+      }
+    }
+  } else if (page == STATS_TASK_PAGE) {
+    for (uint8_t i = 0; i < STATS_PAGE_WORDS; i++) {
+      words[i] = _taskOverruns[2 * i] | ((uint32_t) _taskOverruns[2 * i + 1] << 16);
+    }
+  } else if (page > STATS_TASK_PAGE) {
+    memcpy(words, &_taskLongest[(page - STATS_TASK_PAGE - 1) * STATS_PAGE_WORDS], STATS_PAGE_WORDS * sizeof(uint32_t));
+  } else {
+    uint8_t first = (page - 1 - 2 * STATS_TIMINGS) * 2 * STATS_PAGE_WORDS;
+    for (uint8_t i = 0; i < STATS_PAGE_WORDS; i++) {
+      words[i] = _commands[first + 2 * i] | ((uint32_t) _commands[first + 2 * i + 1] << 16);
+    }
+  }
+  interrupts();
+  return true;
+}
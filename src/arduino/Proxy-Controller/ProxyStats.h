@@ -0,0 +1,61 @@
+/*
+  ProxyStats.h - Performance counters of the controller, read by the clients with PROTOCOL_STATS.
+
+  Every timing is kept as a histogram: count, sum, minimum and maximum in us, and the count per bucket. The buckets
+  grow by a factor of 4 from STATS_BUCKET_FIRST on (< 64 us, < 256 us, < 1 ms, ... , >= 262 ms), so that a sample
+  costs a few shifts. Counts and sums stop at their maximum instead of wrapping, reset between measurements.
+  Of every task of the main loop (see TaskScheduler) the runs over its budget and its longest run are kept.
+  The step timer ISR records the step timing, the rest is recorded by the main loop; readers and reset() copy and
+  clear with interrupts off.
+  The counters are read as pages of STATS_PAGE_WORDS words (see PROTOCOL_STATS for the layout).
+*/
+
+#ifndef ProxyStats_h
+#define ProxyStats_h
+
+#include "Arduino.h"
+
+//TIMINGS (histograms)
+#define STATS_LOOP_PERIOD 0       //from one loop() to the next
+#define STATS_STEP_LATENESS 1     //how late a step is made against its deadline on the step timer
+#define STATS_RECEIVE_TIME 2      //reading the module's output in listenForCommands()
+#define STATS_SEND_TIME 3         //one write to a client (AT+CIPSEND round trip)
+#define STATS_TIMINGS 4
+
+#define STATS_BUCKETS 8
+#define STATS_BUCKET_FIRST 6      //log2 of the upper end of the first bucket (us)
+#define STATS_COMMANDS 56         //command ids counted, higher ones count as malformed (a multiple of 2 * STATS_PAGE_WORDS)
+#define STATS_PAGE_WORDS 4
+#define STATS_TASKS 8            //tasks kept, in the order TaskScheduler runs them
+#define STATS_TASK_PAGE (1 + 2 * STATS_TIMINGS + STATS_COMMANDS / (2 * STATS_PAGE_WORDS))
+#define STATS_PAGE_COUNT (STATS_TASK_PAGE + 1 + STATS_TASKS / STATS_PAGE_WORDS)
+
+struct StatsHistogram {
+  uint32_t count;
+  uint32_t sum;                   //us
+  uint32_t min, max;              //us
+  uint16_t buckets[STATS_BUCKETS];
+};
+
+class ProxyStats
+{
+  public:
+    static void record(uint8_t timing, uint32_t us);
+    static void countCommand(uint8_t command);
+    static void countMalformed(uint16_t bytes);
+    static void countMissedStep();
+    static void recordTask(uint8_t task, uint32_t us, bool overrun);
+    static void reset();
+    static bool getPage(uint8_t page, uint32_t *words);
+
+  private:
+    static StatsHistogram _timings[STATS_TIMINGS];
+    static uint16_t _commands[STATS_COMMANDS];
+    static uint32_t _malformed;   //bytes dropped by the protocol decoders, packets with unknown commands or not taken as datagrams
+    static uint32_t _missedSteps; //steps made after the deadline of the step following them had passed
+    static uint16_t _taskOverruns[STATS_TASKS];
+    static uint32_t _taskLongest[STATS_TASKS];  //us
+    static unsigned long _resetTime;
+};
+
+#endif
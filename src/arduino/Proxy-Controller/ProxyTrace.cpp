@@ -0,0 +1,84 @@
+/*
+  ProxyTrace.cpp - Trace of the controller's traffic, recorded on request and read by the clients with PROTOCOL_TRACE_READ.
+*/
+
+#include "Arduino.h"
+#include "ProxyTrace.h"
+#include "ProxyProtocol.h"
+
+TraceRecord ProxyTrace::_records[TRACE_CAPACITY];
+uint8_t ProxyTrace::_head = 0;
+uint8_t ProxyTrace::_count = 0;
+bool ProxyTrace::_recording = false;
+bool ProxyTrace::_synced = false;
+uint8_t ProxyTrace::_lost = 0;
+unsigned long ProxyTrace::_lastTime = 0;
+
+/* drops what was recorded before */
+void ProxyTrace::start() {
+  _head = 0;
+  _count = 0;
+  _lost = 0;
+  _synced = false;
+  _recording = true;
+}
+
+/* the records stay until they are read */
+void ProxyTrace::stop() {
+  _recording = false;
+}
+
+bool ProxyTrace::recording() {
+  return _recording;
+}
+
+/* time: micros() of the event. A record that does not fit is lost, counted by the TRACE_TIME record that comes next */
+void ProxyTrace::record(uint8_t kind, uint8_t mux_id, uint8_t command, float payload, unsigned long time) {
+  if (!_recording || (command >= PROTOCOL_TRACE && command <= PROTOCOL_TRACE_DATA)) {
+    return;
+  }
+  unsigned long delta = time - _lastTime;   //a button edge may be older than the record before, the gap is huge then
+  bool synced = _synced && delta <= 0xFFFF;
+  if (_count + (synced ? 1 : 2) > TRACE_CAPACITY) {
+    if (_lost < 0xFF) {
+      _lost++;
+    }
+    _synced = false;
+    return;
+  }
+  if (!synced) {
+    store(TRACE_TIME, 0, _lost, protocolFromInt(time), 0);
+    _lost = 0;
+    delta = 0;
+  }
+  store(kind, mux_id, command, payload, delta);
+  _lastTime = time;
+  _synced = true;
+}
+
+uint8_t ProxyTrace::count() {
+  return _count;
+}
+
+/* takes the oldest record off the ring as two words, false if there is none:
+   delta | kind << 16 | command << 24 (kind: TRACE_* << 4 | mux id), then the payload's bytes */
+bool ProxyTrace::take(uint32_t *words) {
+  if (_count == 0) {
+    return false;
+  }
+  TraceRecord &r = _records[_head];
+  words[0] = r.delta | ((uint32_t) r.kind << 16) | ((uint32_t) r.command << 24);
+  words[1] = protocolToInt(r.payload);
+  _head = (_head + 1) % TRACE_CAPACITY;
+  _count--;
+  return true;
+}
+
+void ProxyTrace::store(uint8_t kind, uint8_t mux_id, uint8_t command, float payload, uint16_t delta) {
+  TraceRecord &r = _records[(_head + _count) % TRACE_CAPACITY];
+  r.delta = delta;
+  r.kind = (kind << 4) | (mux_id & 0x0F);
+  r.command = command;
+  r.payload = payload;
+  _count++;
+}
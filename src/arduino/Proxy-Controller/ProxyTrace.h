@@ -0,0 +1,56 @@
+/*
+  ProxyTrace.h - Trace of the controller's traffic, recorded on request and read by the clients with PROTOCOL_TRACE_READ.
+
+  While recording, every command handled, every packet sent and every button event is kept as a record of 8 bytes in
+  a RAM ring of TRACE_CAPACITY records, for the replay on the host (see src/sim/replay). A record's time is the us
+  since the record before it; a TRACE_TIME record with the full micros() comes first, and wherever the gap does not fit
+  into 16 bits or records were lost to a full ring. The trace commands and their replies are not recorded, so a client
+  can read while recording goes on. Recording is done by the main loop only.
+  The records are read as two words each (see PROTOCOL_TRACE for the layout).
+*/
+
+#ifndef ProxyTrace_h
+#define ProxyTrace_h
+
+#include "Arduino.h"
+
+//KINDS of records
+#define TRACE_TIME 0              //payload: micros() (uint32), command: the records lost before it (at most 255)
+#define TRACE_RECEIVED 1          //a command handled
+#define TRACE_SENT 2              //a packet written to a client (reply, telemetry or event)
+#define TRACE_BUTTON 3            //a button event of the first axis, command 7 or 8, payload: position, at the time of the edge
+
+#ifndef TRACE_CAPACITY
+  #define TRACE_CAPACITY 32       //records, 8 bytes each, at most 255
+#endif
+#define TRACE_READ_RECORDS 2      //per PROTOCOL_TRACE_READ, two words each
+
+struct TraceRecord {
+  uint16_t delta;                 //us since the record before
+  uint8_t kind;                   //TRACE_* in the high nibble, the mux id in the low one
+  uint8_t command;
+  float payload;
+};
+
+class ProxyTrace
+{
+  public:
+    static void start();
+    static void stop();
+    static bool recording();
+    static void record(uint8_t kind, uint8_t mux_id, uint8_t command, float payload, unsigned long time);
+    static uint8_t count();
+    static bool take(uint32_t *words);
+
+  private:
+    static TraceRecord _records[TRACE_CAPACITY];
+    static uint8_t _head, _count;
+    static bool _recording;
+    static bool _synced;          //the last record stored is where the next one counts its time from
+    static uint8_t _lost;
+    static unsigned long _lastTime;
+
+    static void store(uint8_t kind, uint8_t mux_id, uint8_t command, float payload, uint16_t delta);
+};
+
+#endif
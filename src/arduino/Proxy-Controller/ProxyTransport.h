@@ -0,0 +1,48 @@
+/*
+  ProxyTransport.h - How the ProxyControlServer reaches its clients, the network part of the hardware abstraction.
+
+  A transport serves up to PROTOCOL_MAX_CONNECTIONS clients, each addressed by its mux id, and hands what they send
+  to its listener (the server) byte by byte: from poll(), and from send() while it waits for the link. EspTransport
+  drives the ESP8266 on the serial port; the host build serves a TCP socket (see src/sim/host). Passthrough (see
+  PROTOCOL_PASSTHROUGH) and the datagram endpoint (see PROTOCOL_UDP_PORT), whose datagrams come and go as mux
+  PROTOCOL_UDP_MUX, are offered by the transports that have them.
+  The other parts of the abstraction are StepDriver for the steppers, and the Arduino core (micros(), millis(),
+  digitalRead(), ...) for clock and GPIO, which the host build implements in src/sim/stubs.
+*/
+
+#ifndef ProxyTransport_h
+#define ProxyTransport_h
+
+#include "Arduino.h"
+
+//what startPassthrough() did
+#define TRANSPORT_PASSTHROUGH_REFUSED 0   //nothing changed, the clients stay connected
+#define TRANSPORT_PASSTHROUGH_FAILED 1    //the connections are closed, the transport serves again
+#define TRANSPORT_PASSTHROUGH_STARTED 2   //the client is connected as mux 0
+
+class TransportListener
+{
+  public:
+    virtual void onReceived(uint8_t mux_id, uint8_t data) = 0;
+    virtual void onClosed(uint8_t mux_id) = 0;
+};
+
+class ProxyTransport
+{
+  public:
+    ProxyTransport() : _listener(NULL) {}
+    void setListener(TransportListener *listener) { _listener = listener; }
+    virtual bool start() = 0;                 //serves the clients
+    virtual bool stop() = 0;
+    virtual bool poll() = 0;                  //hands what came so far to the listener, true if client data came
+    virtual bool send(uint8_t mux_id, const uint8_t *buffer, uint8_t len) = 0;   //false: the client is gone
+    virtual uint8_t startPassthrough(uint8_t mux_id, uint16_t port) { return TRANSPORT_PASSTHROUGH_REFUSED; }
+    virtual void stopPassthrough() {}
+    virtual bool isPassthrough() { return false; }
+    virtual bool startDatagrams(uint16_t port) { return false; }   //also after passthrough, until the transport stops
+
+  protected:
+    TransportListener *_listener;
+};
+
+#endif
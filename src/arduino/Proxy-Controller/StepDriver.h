@@ -0,0 +1,22 @@
+/*
+  StepDriver.h - A stepper driver as the Proxy sees it, the stepper part of the hardware abstraction (see ProxyTransport.h).
+
+  onestep() is called from the step timer ISR and has to return within a step period. StepOutput drives the
+  steppers on the Adafruit Motor Shield v2; a board with other drivers passes its own to Proxy::setStepDriver().
+*/
+
+#ifndef StepDriver_h
+#define StepDriver_h
+
+#include "Arduino.h"
+
+class StepDriver
+{
+  public:
+    virtual void begin(uint8_t port) = 0;                     //port of the motor, as numbered by the driver
+    virtual void onestep(uint8_t dir, uint8_t style) = 0;     //FORWARD or BACKWARD, SINGLE .. MICROSTEP (AFMotor.h)
+    virtual void release() = 0;                               //coils off
+    virtual void hold(uint8_t percent) = 0;                   //coils of the present step at percent of the stepping current
+};
+
+#endif
@@ -0,0 +1,130 @@
+/*
+  StepOutput.cpp - Writes the coil states of a stepper on the Adafruit Motor Shield v2 straight to its PCA9685.
+*/
+
+#include "Arduino.h"
+#include "StepOutput.h"
+#include <Wire.h>
+#include <Adafruit_MotorShield.h>
+#include "utility/Adafruit_MS_PWMServoDriver.h"
+
+//latch bits, as in Adafruit_StepperMotor::onestep()
+#define LATCH_AIN2 0x1
+#define LATCH_BIN1 0x2
+#define LATCH_AIN1 0x4
+#define LATCH_BIN2 0x8
+
+//{PWMA, PWMB, latch} for every microstep phase, the sine curve of Adafruit_StepperMotor::onestep()
+static const uint8_t MICROSTEP_TABLE[4 * MICROSTEPS][3] PROGMEM = {
+  {255, 0, 0x3}, {253, 25, 0x3}, {250, 50, 0x3}, {244, 74, 0x3}, {236, 98, 0x3}, {225, 120, 0x3}, {212, 141, 0x3}, {197, 162, 0x3},
+  {180, 180, 0x3}, {162, 197, 0x3}, {141, 212, 0x3}, {120, 225, 0x3}, {98, 236, 0x3}, {74, 244, 0x3}, {50, 250, 0x3}, {25, 253, 0x3},
+  {0, 255, 0x6}, {25, 253, 0x6}, {50, 250, 0x6}, {74, 244, 0x6}, {98, 236, 0x6}, {120, 225, 0x6}, {141, 212, 0x6}, {162, 197, 0x6},
+  {180, 180, 0x6}, {197, 162, 0x6}, {212, 141, 0x6}, {225, 120, 0x6}, {236, 98, 0x6}, {244, 74, 0x6}, {250, 50, 0x6}, {253, 25, 0x6},
+  {255, 0, 0xC}, {253, 25, 0xC}, {250, 50, 0xC}, {244, 74, 0xC}, {236, 98, 0xC}, {225, 120, 0xC}, {212, 141, 0xC}, {197, 162, 0xC},
+  {180, 180, 0xC}, {162, 197, 0xC}, {141, 212, 0xC}, {120, 225, 0xC}, {98, 236, 0xC}, {74, 244, 0xC}, {50, 250, 0xC}, {25, 253, 0xC},
+  {0, 255, 0x9}, {25, 253, 0x9}, {50, 250, 0x9}, {74, 244, 0x9}, {98, 236, 0x9}, {120, 225, 0x9}, {141, 212, 0x9}, {162, 197, 0x9},
+  {180, 180, 0x9}, {197, 162, 0x9}, {212, 141, 0x9}, {225, 120, 0x9}, {236, 98, 0x9}, {244, 74, 0x9}, {250, 50, 0x9}, {253, 25, 0x9},
+};
+
+//latch for every half step phase (SINGLE, DOUBLE, INTERLEAVE run at full PWM)
+static const uint8_t HALFSTEP_LATCH[8] PROGMEM = {0x1, 0x3, 0x2, 0x6, 0x4, 0xC, 0x8, 0x9};
+
+bool StepOutput::_shieldStarted = false;
+
+StepOutput::StepOutput() {
+  _address = STEP_OUTPUT_ADDRESS;
+  _firstRegister = LED0_ON_L;
+  _phase = 0;
+  _style = SINGLE;
+  for (uint8_t i = 0; i < STEP_OUTPUT_REGISTERS; i++) {
+    _registers[i] = 0;
+  }
+}
+
+/* port 1 (M1, M2) or 2 (M3, M4) */
+void StepOutput::begin(uint8_t port) {
+  if (!_shieldStarted) {               //once for all ports
+    Adafruit_MotorShield shield(STEP_OUTPUT_ADDRESS);
+    shield.begin();                     //PWM frequency, auto-increment, all channels off
+    Wire.setClock(STEP_OUTPUT_I2C_CLOCK);
+    _shieldStarted = true;
+  }
+  _firstRegister = LED0_ON_L + 4 * (port == 1 ? 8 : 2);
+}
+
+/* same phase sequence as Adafruit_StepperMotor::onestep() */
+void StepOutput::onestep(uint8_t dir, uint8_t style) {
+  int8_t sign = dir == FORWARD ? 1 : -1;
+  if (style == MICROSTEP) {
+    _phase += sign;
+  } else if (style == INTERLEAVE) {
+    _phase += sign * (MICROSTEPS / 2);
+  } else {
+    bool odd = (_phase / (MICROSTEPS / 2)) % 2;
+    bool half = style == SINGLE ? odd : !odd;    //SINGLE rests on one coil, DOUBLE on two
+    _phase += sign * (half ? MICROSTEPS / 2 : MICROSTEPS);
+  }
+  _phase %= 4 * MICROSTEPS;                      //wraps below 0 as well, 4 * MICROSTEPS divides 256
+  _style = style;
+  energize(256);
+}
+
+/* coils without current */
+void StepOutput::release() {
+  output(0, 0, 0);
+}
+
+/* the coils of the step the motor is on, at percent (up to 100) of the current onestep() drives them with; energizes
+   them again after release() */
+void StepOutput::hold(uint8_t percent) {
+  energize(min(percent, 100) * 256 / 100);
+}
+
+/* the coil states of _phase in _style, the PWM of both coils times scale / 256 (a shift, this runs in the step ISR) */
+void StepOutput::energize(uint16_t scale) {
+  if (_style == MICROSTEP) {
+    output((pgm_read_byte(&MICROSTEP_TABLE[_phase][0]) * scale) >> 8, (pgm_read_byte(&MICROSTEP_TABLE[_phase][1]) * scale) >> 8,
+           pgm_read_byte(&MICROSTEP_TABLE[_phase][2]));
+  } else {
+    uint8_t pwm = (255 * scale) >> 8;
+    output(pwm, pwm, pgm_read_byte(&HALFSTEP_LATCH[_phase / (MICROSTEPS / 2)]));
+  }
+}
+
+void StepOutput::output(uint8_t pwmA, uint8_t pwmB, uint8_t latch) {
+  uint8_t registers[STEP_OUTPUT_REGISTERS] = {0};   //per channel: ON_L, ON_H, OFF_L, OFF_H
+  uint8_t pins[4] = {LATCH_AIN2, LATCH_AIN1, LATCH_BIN1, LATCH_BIN2};
+  registers[0 * 4 + 2] = (pwmA * 16) & 0xFF;       //PWM: on at 0, off at pwm * 16 of 4096
+  registers[0 * 4 + 3] = (pwmA * 16) >> 8;
+  for (uint8_t i = 0; i < 4; i++) {
+    registers[(1 + i) * 4 + 1] = (latch & pins[i]) ? 0x10 : 0;   //full on bit
+  }
+  registers[5 * 4 + 2] = (pwmB * 16) & 0xFF;
+  registers[5 * 4 + 3] = (pwmB * 16) >> 8;
+  write(registers);
+}
+
+/* sends the changed bytes, neighbouring ones merged into one auto-increment transaction */
+void StepOutput::write(const uint8_t *registers) {
+  uint8_t i = 0;
+  while (i < STEP_OUTPUT_REGISTERS) {
+    if (registers[i] == _registers[i]) {
+      i++;
+      continue;
+    }
+    uint8_t first = i, last = i;
+    for (uint8_t j = i + 1; j < STEP_OUTPUT_REGISTERS && j <= last + STEP_OUTPUT_MERGE_GAP + 1; j++) {
+      if (registers[j] != _registers[j]) {
+        last = j;
+      }
+    }
+    Wire.beginTransmission(_address);
+    Wire.write(_firstRegister + first);
+    for (uint8_t j = first; j <= last; j++) {
+      Wire.write(registers[j]);
+      _registers[j] = registers[j];
+    }
+    Wire.endTransmission();
+    i = last + 1;
+  }
+}
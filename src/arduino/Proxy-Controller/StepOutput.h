@@ -0,0 +1,46 @@
+/*
+  StepOutput.h - Writes the coil states of a stepper on the Adafruit Motor Shield v2 straight to its PCA9685.
+
+  Adafruit_StepperMotor::onestep() sends the six PWM channels of a motor one by one, six I2C transactions for
+  every (micro)step. StepOutput looks the coil state up in precomputed tables, keeps a copy of the channel
+  registers and only sends the bytes that changed, in as few auto-increment transactions as pay off
+  (one, or two when both PWM channels at either end of the block change).
+  The first begin() starts the shield (auto-increment on, all channels cleared) and sets the I2C clock to 400 kHz.
+  hold() scales the PWM of both coils on the step the motor is on, for a lower holding current at rest.
+*/
+
+#ifndef StepOutput_h
+#define StepOutput_h
+
+#include "Arduino.h"
+#include "StepDriver.h"
+
+#define STEP_OUTPUT_CHANNELS 6          //PWMA, AIN2, AIN1, BIN1, BIN2, PWMB: consecutive on both motor ports
+#define STEP_OUTPUT_REGISTERS (STEP_OUTPUT_CHANNELS * 4)
+#define STEP_OUTPUT_MERGE_GAP 2         //unchanged bytes worth sending to save a transaction (start, address, stop)
+#define STEP_OUTPUT_ADDRESS 0x60        //I2C address of the shield (default)
+#define STEP_OUTPUT_I2C_CLOCK 400000L   //Hz
+
+class StepOutput : public StepDriver
+{
+  public:
+    StepOutput();
+    void begin(uint8_t port);
+    void onestep(uint8_t dir, uint8_t style);
+    void release();
+    void hold(uint8_t percent);
+
+  private:
+    static bool _shieldStarted;         //one shield drives the steppers on both ports
+    uint8_t _address;
+    uint8_t _firstRegister;
+    uint8_t _phase;                     //0 .. 4 * MICROSTEPS - 1, as Adafruit_StepperMotor::currentstep
+    uint8_t _style;                     //of the last onestep(), hold() keeps its coil states
+    uint8_t _registers[STEP_OUTPUT_REGISTERS];
+
+    void energize(uint16_t scale);
+    void output(uint8_t pwmA, uint8_t pwmB, uint8_t latch);
+    void write(const uint8_t *registers);
+};
+
+#endif
@@ -0,0 +1,210 @@
+/*
+  StepScheduler.cpp - Shares the step timer (Timer1) between the Proxy instances of one controller.
+*/
+
+#include "Arduino.h"
+#include "StepScheduler.h"
+#include "Proxy.h"
+#include "ProxyStats.h"
+
+#define STEP_TIMER_CTC _BV(WGM12)
+#define STEP_TIMER_CLOCK (_BV(CS11) | _BV(CS10))   //clk/64
+#define SCHEDULER_MIN_SCALE 0.01                   //slowest a coordinated move makes an axis, of its own limits
+#define SCHEDULER_SCALE_ITERATIONS 12
+#define STEP_TIMER_US_PER_TICK (1000000L / STEP_TIMER_TICKS_PER_SECOND)
+
+Proxy *StepScheduler::_axes[STEP_SCHEDULER_MAX_AXES];
+uint8_t StepScheduler::_count = 0;
+volatile bool StepScheduler::_stepping[STEP_SCHEDULER_MAX_AXES];
+long StepScheduler::_wait[STEP_SCHEDULER_MAX_AXES];
+long StepScheduler::_period = 1;
+
+ISR(TIMER1_COMPA_vect){
+  StepScheduler::onTimer();
+}
+
+/* returns the id of the new axis, STEP_SCHEDULER_MAX_AXES if there is no room left */
+uint8_t StepScheduler::add(Proxy *proxy){
+  if(_count >= STEP_SCHEDULER_MAX_AXES){
+    return STEP_SCHEDULER_MAX_AXES;
+  }
+  _axes[_count] = proxy;
+  _stepping[_count] = false;
+  _wait[_count] = 0;
+  return _count++;
+}
+
+uint8_t StepScheduler::count(){
+  return _count;
+}
+
+Proxy *StepScheduler::get(uint8_t id){
+  return id < _count ? _axes[id] : NULL;
+}
+
+bool StepScheduler::stepping(uint8_t id){
+  return id < _count && _stepping[id];
+}
+
+/* the axis makes its first step soon (at STEP_TIMER_MAX_RATE), its planner sets the pace from then on */
+void StepScheduler::start(uint8_t id){
+  if(id >= _count || _stepping[id]){
+    return;
+  }
+  long first = ticks(STEP_TIMER_MAX_RATE);
+  noInterrupts();
+  if(TCCR1B & STEP_TIMER_CLOCK){    //other axes are stepping: fit in between their deadlines
+    if(TIFR1 & _BV(OCF1A)){
+      _wait[id] = _period + first;  //the pending compare match counts its period off first
+    }else{
+      _wait[id] = TCNT1 + first;
+      if(_wait[id] < _period){
+        _period = _wait[id];
+        OCR1A = _period - 1;
+      }
+    }
+    _stepping[id] = true;
+    interrupts();
+    return;
+  }
+  TCCR1A = 0;
+  TCCR1B = STEP_TIMER_CTC;
+  TCNT1 = 0;
+  _period = first;
+  OCR1A = _period - 1;
+  _wait[id] = first;
+  _stepping[id] = true;
+  TIFR1 = _BV(OCF1A);
+  interrupts();
+  STEPPER_UNLOCK();
+  TCCR1B = STEP_TIMER_CTC | STEP_TIMER_CLOCK;
+}
+
+/* the timer stops with the last axis, and stays locked until the next start */
+void StepScheduler::stop(uint8_t id){
+  if(id >= _count){
+    return;
+  }
+  noInterrupts();
+  _stepping[id] = false;
+  bool any = false;
+  for(uint8_t i = 0; i < _count; i++){
+    any |= _stepping[i];
+  }
+  if(!any){
+    TCCR1B = STEP_TIMER_CTC;
+    STEPPER_LOCK();
+  }
+  interrupts();
+}
+
+/* starts a move on every axis with a target in steps (indexed by id, STEP_SCHEDULER_NO_TARGET = the axis stays where it is), each with its
+   velocity, acceleration and jerk scaled down so that it takes as long as the slowest one. Returns that time in ms. */
+long StepScheduler::moveTogether(const long *targets){
+  long time = 0;
+  for(uint8_t id = 0; id < _count; id++){
+    if(targets[id] != STEP_SCHEDULER_NO_TARGET){
+      time = max(time, _axes[id]->getExpectedTimeToSteps(targets[id]));
+    }
+  }
+  float scales[STEP_SCHEDULER_MAX_AXES];
+  for(uint8_t id = 0; id < _count; id++){
+    if(targets[id] != STEP_SCHEDULER_NO_TARGET){
+      scales[id] = scaleFor(_axes[id], targets[id], time);
+    }
+  }
+  for(uint8_t id = 0; id < _count; id++){   //planned first, so that the starts are close together
+    if(targets[id] != STEP_SCHEDULER_NO_TARGET){
+      _axes[id]->setTargetSteps(targets[id], scales[id]);
+    }
+  }
+  return time;
+}
+
+/* the largest scale of the axis' limits at which its move to target takes time (ms) or longer, by bisection */
+float StepScheduler::scaleFor(Proxy *proxy, long target, long time){
+  if(proxy->getExpectedTimeToSteps(target) >= time){
+    return 1;
+  }
+  float low = SCHEDULER_MIN_SCALE, high = 1;
+  for(uint8_t i = 0; i < SCHEDULER_SCALE_ITERATIONS; i++){
+    float scale = (low + high) / 2;
+    if(proxy->getExpectedTimeToSteps(target, scale) >= time){
+      low = scale;
+    }else{
+      high = scale;
+    }
+  }
+  return low;
+}
+
+/* Timer1 compare match: makes the steps that are due, the most overdue first, and sets the timer to the next
+   deadline. Runs with interrupts enabled, as the I2C transfers to the motor shield need them. */
+void StepScheduler::onTimer(){
+  STEPPER_LOCK();   //no nesting while a step is on the bus
+  OCR1A = 0xFFFF;   //no compare match either, TCNT1 counts the time spent from this match on
+  bool onTop = TCNT1 == _period - 1;   //TCNT1 stays on TOP for the tick after the match
+  sei();
+  for(uint8_t id = 0; id < _count; id++){
+    if(_stepping[id]){
+      _wait[id] -= _period;
+    }
+  }
+  while(true){
+    uint8_t due = _count;
+    for(uint8_t id = 0; id < _count; id++){
+      if(_stepping[id] && _wait[id] <= 0 && (due == _count || _wait[id] < _wait[due])){
+        due = id;
+      }
+    }
+    if(due == _count){
+      break;
+    }
+    long elapsed = TCNT1;
+    if(onTop && elapsed == _period - 1){
+      elapsed = 0;
+    }
+    ProxyStats::record(STATS_STEP_LATENESS, (elapsed - _wait[due]) * STEP_TIMER_US_PER_TICK);
+    float rate = _axes[due]->onStepTimer();
+    if(rate == 0){
+      _stepping[due] = false;     //target reached or calibration bursts done
+    }else{
+      _wait[due] += ticks(rate);
+      if(_wait[due] < 1){         //a late step shortens the wait for the next one, by one interval at most
+        _wait[due] = 1;
+        ProxyStats::countMissedStep();
+      }
+    }
+  }
+  long next = 0;
+  for(uint8_t id = 0; id < _count; id++){
+    if(_stepping[id] && (next == 0 || _wait[id] < next)){
+      next = _wait[id];
+    }
+  }
+  if(next == 0){
+    TCCR1B = STEP_TIMER_CTC;      //no axis left, stays locked until the next start
+    return;
+  }
+  program(next, onTop);
+  cli();
+  STEPPER_UNLOCK();
+}
+
+long StepScheduler::ticks(float rate){
+  return STEP_TIMER_TICKS_PER_SECOND / constrain(rate, 1, STEP_TIMER_MAX_RATE);
+}
+
+/* time until the next compare match, counted from the last one (longer waits take several periods). A deadline
+   that has passed while the steps were made (slow I2C steps) gets the next compare match the counter can still make.
+   onTop: TCNT1 was still on TOP when the ISR started, and has not been cleared yet if it still reads as much. */
+void StepScheduler::program(long ticks, bool onTop){
+  noInterrupts();
+  long elapsed = TCNT1;
+  if(onTop && elapsed == _period - 1){
+    elapsed = 0;
+  }
+  _period = constrain(ticks, elapsed + 3, 65536L);
+  OCR1A = _period - 1;
+  interrupts();
+}
@@ -0,0 +1,55 @@
+/*
+  StepScheduler.h - Shares the step timer (Timer1) between the Proxy instances of one controller.
+
+  Every Proxy registers on construction and is addressed by its id from then on (the order of construction).
+  The timer runs while at least one axis is stepping. On every compare match the steps that are due are made,
+  the most overdue first, and the timer is set to the next deadline of any axis, so axes at different step
+  rates interleave on the one timer and the one I2C bus to the motor shield.
+  moveTogether() plans the moves of several axes to take the same time, so that they arrive together.
+*/
+
+#ifndef StepScheduler_h
+#define StepScheduler_h
+
+#include "Arduino.h"
+#include <limits.h>
+
+#define STEP_SCHEDULER_MAX_AXES 2                  //stepper ports on the Adafruit Motor Shield v2
+#define STEP_SCHEDULER_NO_TARGET LONG_MIN          //an axis moveTogether() leaves alone
+
+//STEP TIMER (Timer1 in CTC mode, one compare match per deadline)
+#define STEP_TIMER_TICKS_PER_SECOND (F_CPU / 64)   //prescaler 64 -> 4 us per tick
+#define STEP_TIMER_MAX_RATE 5000                   //steps per second
+#define STEP_TIMER_RUN_SPEED 1000000.0             //AccelStepper speed while the timer steps, so that runSpeed() steps on every call
+
+//keep the step ISR away from the steppers while the main loop uses them (all other interrupts stay enabled)
+#define STEPPER_LOCK() (TIMSK1 &= ~_BV(OCIE1A))
+#define STEPPER_UNLOCK() (TIMSK1 |= _BV(OCIE1A))
+
+class Proxy;
+
+class StepScheduler
+{
+  public:
+    static uint8_t add(Proxy *proxy);
+    static uint8_t count();
+    static Proxy *get(uint8_t id);
+    static void start(uint8_t id);
+    static void stop(uint8_t id);
+    static bool stepping(uint8_t id);
+    static long moveTogether(const long *targets);
+    static void onTimer();
+
+  private:
+    static Proxy *_axes[STEP_SCHEDULER_MAX_AXES];
+    static uint8_t _count;
+    static volatile bool _stepping[STEP_SCHEDULER_MAX_AXES];
+    static long _wait[STEP_SCHEDULER_MAX_AXES];   //ticks from the last compare match to the axis' next step
+    static long _period;                          //ticks from the last compare match to the next one
+
+    static long ticks(float rate);
+    static void program(long ticks, bool onTop);
+    static float scaleFor(Proxy *proxy, long target, long time);
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*
+  TaskScheduler.cpp - Runs the parts of the main loop as cooperative tasks, each with a period and a time budget.
+*/
+
+#include "Arduino.h"
+#include "TaskScheduler.h"
+
+Task TaskScheduler::_tasks[TASK_SCHEDULER_MAX_TASKS];
+uint8_t TaskScheduler::_count = 0;
+uint8_t TaskScheduler::_running = TASK_SCHEDULER_MAX_TASKS;
+unsigned long TaskScheduler::_started = 0;
+
+/* period and budget in us, returns the id of the new task (its place in the order), TASK_SCHEDULER_MAX_TASKS if there
+   is no room left. The task is due at once. */
+uint8_t TaskScheduler::add(void (*run)(), unsigned long period, unsigned long budget){
+  if(_count >= TASK_SCHEDULER_MAX_TASKS){
+    return TASK_SCHEDULER_MAX_TASKS;
+  }
+  Task &task = _tasks[_count];
+  task.run = run;
+  task.period = period;
+  task.budget = budget;
+  task.due = micros();
+  return _count++;
+}
+
+uint8_t TaskScheduler::count(){
+  return _count;
+}
+
+/* one pass: runs the tasks that are due, then waits until the next one is */
+void TaskScheduler::run(){
+  for(uint8_t id = 0; id < _count; id++){
+    Task &task = _tasks[id];
+    unsigned long now = micros();
+    if((long)(now - task.due) < 0){
+      continue;
+    }
+    _running = id;
+    _started = now;
+    task.run();
+    unsigned long elapsed = micros() - _started;
+    _running = TASK_SCHEDULER_MAX_TASKS;
+    ProxyStats::recordTask(id, elapsed, elapsed > task.budget);
+    task.due = now - task.due >= task.period ? now + task.period : task.due + task.period;
+  }
+
+  unsigned long next = _tasks[0].due;
+  for(uint8_t id = 1; id < _count; id++){
+    if((long)(_tasks[id].due - next) < 0){
+      next = _tasks[id].due;
+    }
+  }
+  while(_count > 0 && (long)(micros() - next) < 0){
+  }
+}
+
+/* us the running task has left of its budget, TASK_SCHEDULER_UNLIMITED when no task runs */
+unsigned long TaskScheduler::remaining(){
+  if(_running >= _count){
+    return TASK_SCHEDULER_UNLIMITED;
+  }
+  unsigned long elapsed = micros() - _started;
+  return elapsed < _tasks[_running].budget ? _tasks[_running].budget - elapsed : 0;
+}
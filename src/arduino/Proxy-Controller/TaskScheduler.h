@@ -0,0 +1,43 @@
+/*
+  TaskScheduler.h - Runs the parts of the main loop as cooperative tasks, each with a period and a time budget.
+
+  loop() calls run(), which runs the tasks that are due in the order they were added and then waits for the next
+  one to be due. A task is due again a period after it was last due; one that comes more than a period late starts
+  its periods anew rather than running several times to catch up. A run should stay within the task's budget, a
+  task with more work checks remaining() and leaves the rest to its next run. Runs that take longer than the budget
+  are counted as overruns (see the task pages of ProxyStats). Steps are made by the step timer (see StepScheduler),
+  no task waits for them.
+*/
+
+#ifndef TaskScheduler_h
+#define TaskScheduler_h
+
+#include "Arduino.h"
+#include "ProxyStats.h"
+
+#define TASK_SCHEDULER_MAX_TASKS STATS_TASKS  //each has its counters in ProxyStats
+#define TASK_SCHEDULER_UNLIMITED 0xFFFFFFFFUL  //remaining() outside of a task
+
+struct Task {
+  void (*run)();
+  unsigned long period;                     //us
+  unsigned long budget;                     //us per run
+  unsigned long due;                        //micros()
+};
+
+class TaskScheduler
+{
+  public:
+    static uint8_t add(void (*run)(), unsigned long period, unsigned long budget);
+    static uint8_t count();
+    static void run();
+    static unsigned long remaining();
+
+  private:
+    static Task _tasks[TASK_SCHEDULER_MAX_TASKS];
+    static uint8_t _count;
+    static uint8_t _running;                //the task in its run, TASK_SCHEDULER_MAX_TASKS = none
+    static unsigned long _started;          //micros() when it started
+};
+
+#endif
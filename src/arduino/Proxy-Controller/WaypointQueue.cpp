@@ -0,0 +1,49 @@
+/*
+  WaypointQueue.cpp - Fixed-size ring buffer of the waypoints an axis moves through back to back.
+*/
+
+#include "Arduino.h"
+#include "WaypointQueue.h"
+
+WaypointQueue::WaypointQueue() {
+  _head = 0;
+  _tail = 0;
+}
+
+/* false if the queue is full */
+bool WaypointQueue::push(const Waypoint &waypoint) {
+  uint8_t next = (_tail + 1) % WAYPOINT_QUEUE_SIZE;
+  if (next == _head) {
+    return false;
+  }
+  _waypoints[_tail] = waypoint;
+  _tail = next;                         //only now visible to the ISR
+  return true;
+}
+
+/* the next waypoint, without taking it off the queue. false if the queue is empty */
+bool WaypointQueue::peek(Waypoint &waypoint) {
+  if (_head == _tail) {
+    return false;
+  }
+  waypoint = _waypoints[_head];
+  return true;
+}
+
+void WaypointQueue::pop() {
+  if (_head != _tail) {
+    _head = (_head + 1) % WAYPOINT_QUEUE_SIZE;
+  }
+}
+
+void WaypointQueue::clear() {
+  _head = _tail;
+}
+
+uint8_t WaypointQueue::count() {
+  return (_tail + WAYPOINT_QUEUE_SIZE - _head) % WAYPOINT_QUEUE_SIZE;
+}
+
+uint8_t WaypointQueue::free() {
+  return WAYPOINT_QUEUE_SIZE - 1 - count();
+}
@@ -0,0 +1,40 @@
+/*
+  WaypointQueue.h - Fixed-size ring buffer of the waypoints an axis moves through back to back.
+
+  A waypoint is a target position with the maximum velocity to get there, the time to rest once it is
+  reached and, optionally, the earliest time its move may start, counted from the start of the queue.
+  The step timer ISR takes the waypoints off the queue (see Proxy::nextWaypoint()), the main loop adds
+  them; both sides change only their own index, the main loop locks the stepper to clear.
+*/
+
+#ifndef WaypointQueue_h
+#define WaypointQueue_h
+
+#include "Arduino.h"
+
+#define WAYPOINT_QUEUE_SIZE 8           //one slot stays empty, 7 waypoints
+
+struct Waypoint {
+  long position;                        //steps, see Proxy::stepsFromPosition()
+  uint16_t speed;                       //steps/s, 0 = the axis' speed
+  uint16_t dwell;                       //ms to rest at the position before the next waypoint
+  unsigned long startAt;                //ms after the queue started, 0 = right after the waypoint before
+};
+
+class WaypointQueue
+{
+  public:
+    WaypointQueue();
+    bool push(const Waypoint &waypoint);
+    bool peek(Waypoint &waypoint);
+    void pop();
+    void clear();
+    uint8_t count();
+    uint8_t free();
+
+  private:
+    Waypoint _waypoints[WAYPOINT_QUEUE_SIZE];
+    volatile uint8_t _head, _tail;      //taken from _head, added at _tail
+};
+
+#endif
@@ -0,0 +1,7 @@
+/*
+  Firmware.cpp - Builds the Proxy-Controller sketch (setup(), loop() and its globals) for the host.
+*/
+
+#define secondMotorPort 1      //the bench drives both stepper ports of the shield
+
+#include "Proxy-Controller.ino"
@@ -0,0 +1,173 @@
+/*
+  Rig.cpp - Drives the firmware's setup()/loop() on the simulation like the bench rig would.
+*/
+
+#include "Rig.h"
+#include "Arduino.h"
+#include "Proxy.h"
+#include "ProxyProtocol.h"
+
+#include <string.h>
+
+namespace sim {
+
+  Rig::Rig(int buttonPin, int secondButtonPin) : _buttonPins{buttonPin, secondButtonPin} {
+    esp().onSend = [this](const EspModule::Packet &p) {
+      /* a client sees a byte stream; split it into v1 packets and v2 frames, a rest waits for the next packet */
+      std::vector<uint8_t> &data = _streams[p.mux % EspModule::MAX_CONNECTIONS];
+      data.insert(data.end(), p.data.begin(), p.data.end());
+      size_t i = 0;
+      while (i + PROTOCOL_PACKET_SIZE <= data.size()) {
+        Reply r;
+        r.time = p.time;
+        r.mux = p.mux;
+        if (data[i] == PROTOCOL_V2_MAGIC) {
+          size_t end = i + 3 + data[i + 2];
+          if (end > data.size()) {
+            break;
+          }
+          r.version = 2;
+          r.sequenceId = data[i + 3] | (data[i + 4] << 8);
+          for (i += PROTOCOL_V2_HEADER_SIZE; i + PROTOCOL_PACKET_SIZE <= end; i += PROTOCOL_PACKET_SIZE) {
+            r.command = data[i];
+            memcpy(&r.payload, &data[i + 1], sizeof(float));
+            _replies.push_back(r);
+          }
+          i = end;
+        } else {
+          r.version = 1;
+          r.sequenceId = 0;
+          r.command = data[i];
+          memcpy(&r.payload, &data[i + 1], sizeof(float));
+          _replies.push_back(r);
+          i += PROTOCOL_PACKET_SIZE;
+        }
+      }
+      data.erase(data.begin(), data.begin() + i);
+    };
+  }
+
+  void Rig::boot() {
+    for (int pin : _buttonPins) {
+      if (pin > 0) {
+        setPin(pin, LOW);
+      }
+    }
+    setup();
+  }
+
+  void Rig::loopOnce() {
+    uint64_t start = now();
+    loop();
+    spend(costs.loopOverheadNs);
+    _loopPeriods.push_back(now() - start);
+  }
+
+  void Rig::runFor(uint64_t ns) {
+    uint64_t end = now() + ns;
+    while (now() < end) {
+      loopOnce();
+    }
+  }
+
+  bool Rig::runUntil(std::function<bool()> done, uint64_t timeoutNs) {
+    uint64_t end = now() + timeoutNs;
+    while (!done()) {
+      if (now() >= end) {
+        return false;
+      }
+      loopOnce();
+    }
+    return true;
+  }
+
+  void Rig::pressButton(uint64_t holdNs, uint8_t axis, int bounces) {
+    const uint64_t BOUNCE_NS = 300000;     //contact open or closed between bounces
+    int pin = _buttonPins[axis];
+    setPin(pin, HIGH);
+    uint64_t t = now();
+    for (int i = 0; i < 2 * bounces; i++) {
+      schedule(t + (i + 1) * BOUNCE_NS, [pin, i]() { setPin(pin, i % 2 == 0 ? LOW : HIGH); });
+    }
+    t += holdNs;
+    schedule(t, [pin]() { setPin(pin, LOW); });
+    for (int i = 0; i < 2 * bounces; i++) {
+      schedule(t + (i + 1) * BOUNCE_NS, [pin, i]() { setPin(pin, i % 2 == 0 ? HIGH : LOW); });
+    }
+  }
+
+  bool Rig::calibrate(uint64_t upNs, uint64_t downNs, uint8_t axis) {
+    Proxy *proxy = StepScheduler::get(axis);
+    if (proxy == NULL || !runUntil([proxy]() { return proxy->calibrating() == CALIBRATION_PHASE_UP; }, 1000000000ULL)) {
+      return false;     //axes after the first start when the one before has finished
+    }
+    runFor(upNs);
+    pressButton(150000000ULL, axis);
+    if (!runUntil([proxy]() { return proxy->calibrating() == CALIBRATION_PHASE_DOWN; }, 5000000000ULL)) {
+      return false;
+    }
+    runFor(downNs);
+    pressButton(150000000ULL, axis);
+    return runUntil([proxy]() { return proxy->calibrating() == CALIBRATION_PHASE_NONE; }, 5000000000ULL);
+  }
+
+  bool Rig::connect(uint8_t mux) {
+    _streams[mux % EspModule::MAX_CONNECTIONS].clear();
+    return esp().clientConnect(mux);
+  }
+
+  void Rig::disconnect(uint8_t mux) {
+    esp().clientClose(mux);
+  }
+
+  void Rig::listen(uint8_t mux, uint16_t port) {
+    _streams[mux % EspModule::MAX_CONNECTIONS].clear();
+    esp().clientListen(mux, port);
+  }
+
+  void Rig::sendCommand(uint8_t mux, uint8_t command, float payload) {
+    uint8_t packet[5];
+    packet[0] = command;
+    memcpy(&packet[1], &payload, sizeof(float));
+    esp().clientSend(mux, packet, sizeof(packet));
+  }
+
+  void Rig::sendCommands(uint8_t mux, const std::vector<Command> &commands) {
+    std::vector<uint8_t> data(commands.size() * PROTOCOL_PACKET_SIZE);
+    for (size_t i = 0; i < commands.size(); i++) {
+      protocolWritePacket(&data[i * PROTOCOL_PACKET_SIZE], commands[i].command, commands[i].payload);
+    }
+    esp().clientSend(mux, data.data(), data.size());
+  }
+
+  void Rig::sendFrame(uint8_t mux, uint16_t sequenceId, const std::vector<Command> &commands) {
+    std::vector<uint8_t> data(PROTOCOL_V2_HEADER_SIZE + commands.size() * PROTOCOL_PACKET_SIZE);
+    protocolWriteFrameHeader(data.data(), sequenceId, commands.size());
+    for (size_t i = 0; i < commands.size(); i++) {
+      protocolWritePacket(&data[PROTOCOL_V2_HEADER_SIZE + i * PROTOCOL_PACKET_SIZE], commands[i].command, commands[i].payload);
+    }
+    esp().clientSend(mux, data.data(), data.size());
+  }
+
+  bool Rig::sendDatagram(uint16_t sequenceId, const std::vector<Command> &commands) {
+    std::vector<uint8_t> data(PROTOCOL_V2_HEADER_SIZE + commands.size() * PROTOCOL_PACKET_SIZE);
+    protocolWriteFrameHeader(data.data(), sequenceId, commands.size());
+    for (size_t i = 0; i < commands.size(); i++) {
+      protocolWritePacket(&data[PROTOCOL_V2_HEADER_SIZE + i * PROTOCOL_PACKET_SIZE], commands[i].command, commands[i].payload);
+    }
+    return esp().clientSendDatagram(PROTOCOL_UDP_PORT, data.data(), data.size());
+  }
+
+  void Rig::sendCommandAt(uint64_t t, uint8_t mux, uint8_t command, float payload) {
+    schedule(t, [this, mux, command, payload]() { sendCommand(mux, command, payload); });
+  }
+
+  double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+      return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+  }
+}
@@ -0,0 +1,81 @@
+/*
+  Rig.h - Drives the firmware's setup()/loop() on the simulation like the bench rig would:
+  presses the button, connects WiFi clients and collects what the device sends back.
+*/
+
+#ifndef Rig_h
+#define Rig_h
+
+#include "Sim.h"
+#include "EspModule.h"
+
+#include <functional>
+#include <vector>
+
+namespace sim {
+
+  /* one command's reply as received by a client (from a v1 packet or out of a v2 frame) */
+  struct Reply {
+    uint64_t time;
+    uint8_t mux;
+    uint8_t version;
+    uint16_t sequenceId;
+    uint8_t command;
+    float payload;
+  };
+
+  /* one command as sent by a client */
+  struct Command {
+    uint8_t command;
+    float payload;
+  };
+
+  class Rig {
+    public:
+      /* buttonPin: the end stop of axis 0 and the user button, secondButtonPin: the end stop of axis 1 */
+      Rig(int buttonPin, int secondButtonPin = 0);
+
+      void boot();
+      void loopOnce();
+      void runFor(uint64_t ns);
+      bool runUntil(std::function<bool()> done, uint64_t timeoutNs);
+
+      /* holds the button of an axis down for 'holdNs' starting now; the contact bounces 'bounces' times at either end */
+      void pressButton(uint64_t holdNs = 150000000ULL, uint8_t axis = 0, int bounces = 0);
+      /* walks the initial calibration of an axis: top end after upNs, bottom end after downNs */
+      bool calibrate(uint64_t upNs, uint64_t downNs, uint8_t axis = 0);
+
+      bool connect(uint8_t mux);
+      /* the client goes away without telling the device (no disconnect command) */
+      void disconnect(uint8_t mux);
+      /* the client opens a server of its own, for the device to connect to (see PROTOCOL_PASSTHROUGH) */
+      void listen(uint8_t mux, uint16_t port);
+      void sendCommand(uint8_t mux, uint8_t command, float payload);
+      void sendCommandAt(uint64_t t, uint8_t mux, uint8_t command, float payload);
+      /* several v1 packets in one network write */
+      void sendCommands(uint8_t mux, const std::vector<Command> &commands);
+      /* one v2 frame (see ProxyProtocol.h) */
+      void sendFrame(uint8_t mux, uint16_t sequenceId, const std::vector<Command> &commands);
+      /* one v2 frame as a datagram to the UDP endpoint (PROTOCOL_UDP_PORT), its replies come as mux PROTOCOL_UDP_MUX */
+      bool sendDatagram(uint16_t sequenceId, const std::vector<Command> &commands);
+
+      /* packets received by clients since the last clearReplies() */
+      const std::vector<Reply> &replies() const { return _replies; }
+      void clearReplies() { _replies.clear(); }
+
+      /* durations of every loop() call since the last clearLoopPeriods() */
+      const std::vector<uint64_t> &loopPeriods() const { return _loopPeriods; }
+      void clearLoopPeriods() { _loopPeriods.clear(); }
+
+    private:
+      int _buttonPins[2];
+      std::vector<Reply> _replies;
+      std::vector<uint8_t> _streams[EspModule::MAX_CONNECTIONS];   //received, not yet a complete packet or frame
+      std::vector<uint64_t> _loopPeriods;
+  };
+
+  /* percentile of an unsorted sample (p in [0,1]) */
+  double percentile(std::vector<double> values, double p);
+}
+
+#endif
@@ -0,0 +1,1321 @@
+/*
+  ProxyBench.cpp - Loop-latency benchmark for the Proxy-Controller firmware on the simulated rig.
+
+  Reports the loop() period, step-timing jitter while moving, the latency of retargeting a
+  running move, the duration of a move under different motion limits, the accuracy of the
+  predicted move times, the step rate every stepping mode reaches, the step timing of two axes
+  sharing the step timer and how closely a coordinated move of both ends together, per protocol
+  command the latency from the client's write to the reply and to the first motor step, where targets in steps end
+  up when sent as float positions or as integers, how closely the weight follows a target streamed per frame, the cost of a speed/target/status sequence sent one by
+  one, coalesced into one write, or as one v2 frame, and how pushed telemetry compares
+  with polling for noticing the end of a move, a script of moves sent one by one against
+  queued as waypoints, how button events reach several clients, short and bouncing presses and how exactly
+  an event dates and places a press
+  and what a client that went away costs the loop, and the round trips of a single client over the
+  TCP server against passthrough, the counters the device kept meanwhile as a client reads them, and the coil
+  current and start of a move in each power state at rest.
+  With --eeprom FILE the EEPROM is kept in FILE, so a second run starts with the saved calibration.
+  All times are virtual (see stubs/Sim.h for the cost model), so runs are reproducible.
+*/
+
+#include "Rig.h"
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "Proxy.h"
+#include "ProxyControlServer.h"
+#include "ProxyProtocol.h"
+#include "ProxyStats.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern Proxy proxy;
+extern ProxyControlServer server;
+
+#define BUTTON_PIN 2          //buttonPin in Proxy-Controller.ino
+#define SECOND_BUTTON_PIN 5   //secondButtonPin
+#define LED_PIN 3             //LEDPin
+#define CLIENT 0
+#define MONITOR 1         //a second client that only listens in
+#define CLIENT_PORT 8091  //of the client's own server, for passthrough
+#define CALIBRATION_UP_NS 200000000ULL      //until the button is pressed at the top
+#define CALIBRATION_DOWN_NS 2000000000ULL   //full range, at DEFAULT_SPEED
+
+namespace {
+
+  struct Opcode {
+    uint8_t command;
+    float payload;
+    const char *name;
+  };
+
+  const Opcode OPCODES[] = {
+    {0, 0, "CHECK_CURRENT_POSITION"},
+    {1, 0, "SEND_NEW_TARGET_POSITION"},   //payload alternates, see run()
+    {2, DEFAULT_SPEED, "SEND_NEW_SPEED"},
+    {3, 0, "CHECK_IS_TARGET_REACHED"},
+    {4, 0, "CHECK_CURRENT_SPEED"},
+    {5, 0, "RECALIBRATE"},
+    {6, 0.5, "CHECK_EXPECTED_TIME"},
+    {9, 0, "SEND_SAVE_POWER"},
+    {10, 0, "DISCONNECT"},
+    {11, 1, "STEPPING_MODE"},
+    {12, 0, "VERSION_INFO"},
+  };
+
+  struct Options {
+    int reps;
+    unsigned seed;
+    bool echo;
+    const char *eeprom;
+  };
+
+  double ms(uint64_t ns) {
+    return ns / 1e6;
+  }
+
+  void printStats(const char *label, const std::vector<double> &v, const char *unit) {
+    if (v.empty()) {
+      printf("  %-28s %8s\n", label, "-");
+      return;
+    }
+    double sum = 0;
+    for (size_t i = 0; i < v.size(); i++) {
+      sum += v[i];
+    }
+    printf("  %-28s n=%-5u mean=%9.3f p50=%9.3f p95=%9.3f p99=%9.3f max=%9.3f %s\n", label, (unsigned)v.size(),
+           sum / v.size(), sim::percentile(v, 0.5), sim::percentile(v, 0.95), sim::percentile(v, 0.99),
+           sim::percentile(v, 1.0), unit);
+  }
+
+  void waitIdle(sim::Rig &rig) {
+    rig.runUntil([]() { return !proxy.operating() && proxy.calibrating() == CALIBRATION_PHASE_NONE; }, 60000000000ULL);
+  }
+
+  void waitAllIdle(sim::Rig &rig) {
+    rig.runUntil([]() {
+      for (uint8_t id = 0; id < StepScheduler::count(); id++) {
+        if (StepScheduler::get(id)->operating()) {
+          return false;
+        }
+      }
+      return true;
+    }, 60000000000ULL);
+  }
+
+  /* times of the first and the last motor event of a port in [from, to), 0 without any */
+  uint64_t firstStep(uint64_t from, uint64_t to, uint8_t port) {
+    for (const sim::MotorEvent &event : sim::motorEvents()) {
+      if (event.time >= from && event.time < to && event.port == port) {
+        return event.time;
+      }
+    }
+    return 0;
+  }
+
+  uint64_t lastStep(uint64_t from, uint64_t to, uint8_t port) {
+    uint64_t last = 0;
+    for (const sim::MotorEvent &event : sim::motorEvents()) {
+      if (event.time >= from && event.time < to && event.port == port) {
+        last = event.time;
+      }
+    }
+    return last;
+  }
+
+  /* step intervals (us) of the motor events in [from, to), of one motor port or all (0) */
+  std::vector<double> stepIntervals(uint64_t from, uint64_t to, uint8_t port = 0) {
+    std::vector<double> intervals;
+    const std::vector<sim::MotorEvent> &events = sim::motorEvents();
+    uint64_t last = 0;
+    for (size_t i = 0; i < events.size(); i++) {
+      if (events[i].time < from || events[i].time >= to || (port != 0 && events[i].port != port)) {
+        continue;
+      }
+      if (last != 0) {
+        intervals.push_back((events[i].time - last) / 1e3);
+      }
+      last = events[i].time;
+    }
+    return intervals;
+  }
+
+  void benchLoopPeriod(sim::Rig &rig) {
+    printf("\n[loop period]\n");
+    rig.clearLoopPeriods();
+    rig.runFor(3000000000ULL);
+    std::vector<double> idle;
+    for (size_t i = 0; i < rig.loopPeriods().size(); i++) {
+      idle.push_back(ms(rig.loopPeriods()[i]));
+    }
+    printStats("idle", idle, "ms");
+
+    rig.sendCommand(CLIENT, 1, 1.0);
+    rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+    rig.clearLoopPeriods();
+    waitIdle(rig);
+    std::vector<double> moving;
+    for (size_t i = 0; i < rig.loopPeriods().size(); i++) {
+      moving.push_back(ms(rig.loopPeriods()[i]));
+    }
+    printStats("moving", moving, "ms");
+  }
+
+  void benchStepJitter(sim::Rig &rig) {
+    printf("\n[step timing at %d steps/s, ideal interval %.1f us]\n", proxy.getCurrentSpeed(), 1e6 / proxy.getCurrentSpeed());
+    rig.sendCommand(CLIENT, 1, 0.0);
+    rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+    uint64_t from = sim::now();
+    waitIdle(rig);
+    std::vector<double> intervals = stepIntervals(from, sim::now());
+    /* only the cruise phase, the ramps are planned to differ */
+    size_t ramp = (size_t)ceil((double)proxy.getCurrentSpeed() * proxy.getCurrentSpeed() / (2 * proxy.getAcceleration())) + 1;
+    if (proxy.getJerk() == 0 && intervals.size() > 2 * ramp) {
+      intervals = std::vector<double>(intervals.begin() + ramp, intervals.end() - ramp);
+    }
+    std::vector<double> jitter;
+    const double ideal = 1e6 / proxy.getCurrentSpeed();
+    for (size_t i = 0; i < intervals.size(); i++) {
+      jitter.push_back(fabs(intervals[i] - ideal));
+    }
+    printStats("step interval", intervals, "us");
+    printStats("|interval - ideal|", jitter, "us");
+    if (!intervals.empty()) {
+      double sum = 0;
+      for (size_t i = 0; i < intervals.size(); i++) {
+        sum += intervals[i];
+      }
+      printf("  %-28s %.1f steps/s\n", "achieved rate", 1e6 * intervals.size() / sum);
+    }
+  }
+
+  /* reverses a running move halfway and measures when the motor follows */
+  void benchRetarget(sim::Rig &rig, const Options &options) {
+    printf("\n[retarget while moving, %d repetitions]\n", options.reps);
+    std::vector<double> replyLatency, reverseLatency, intervals;
+    int ignored = 0;
+    waitIdle(rig);
+    rig.sendCommand(CLIENT, 1, 0.1);
+    rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+    waitIdle(rig);
+    for (int r = 0; r < options.reps; r++) {
+      rig.sendCommand(CLIENT, 1, 0.9);
+      rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+      uint64_t from = sim::now();
+      rig.runFor(300000000ULL + (uint64_t)(rand() % 100) * 1000000ULL);
+      uint64_t sent = sim::now();
+      rig.clearReplies();
+      size_t firstEvent = sim::motorEvents().size();
+      rig.sendCommand(CLIENT, 1, 0.1);
+      waitIdle(rig);
+      if (!rig.replies().empty()) {
+        replyLatency.push_back(ms(rig.replies()[0].time - sent));
+      }
+      const std::vector<sim::MotorEvent> &events = sim::motorEvents();
+      bool reversed = false;
+      for (size_t i = firstEvent; i < events.size(); i++) {
+        if (events[i].dir != events[firstEvent > 0 ? firstEvent - 1 : 0].dir) {
+          reverseLatency.push_back(ms(events[i].time - sent));
+          std::vector<double> before = stepIntervals(from, events[i].time);
+          intervals.insert(intervals.end(), before.begin(), before.end());
+          reversed = true;
+          break;
+        }
+      }
+      if (!reversed) {
+        ignored++;
+      }
+    }
+    printStats("command -> reply", replyLatency, "ms");
+    printStats("command -> reversed step", reverseLatency, "ms");
+    printStats("step interval until then", intervals, "us");
+    if (ignored > 0) {
+      printf("    %d of %d new targets were ignored until the move ended\n", ignored, options.reps);
+    }
+  }
+
+  void benchOpcodes(sim::Rig &rig, const Options &options) {
+    printf("\n[command latency, %d repetitions per opcode]\n", options.reps);
+    std::vector<double> flashes;       //LED blinks, the feedback to every command (not the light of a calibration)
+    uint64_t lightOn = 0;
+    sim::watchPin(LED_PIN, [&flashes, &lightOn](int level) {
+      if (level == HIGH) {
+        lightOn = sim::now();
+      } else if (lightOn != 0 && ms(sim::now() - lightOn) < 1000) {
+        flashes.push_back(ms(sim::now() - lightOn));
+      }
+    });
+    bool towardsEnd = true;
+    for (size_t o = 0; o < sizeof(OPCODES) / sizeof(OPCODES[0]); o++) {
+      const Opcode &op = OPCODES[o];
+      std::vector<double> replyLatency, stepLatency;
+      int lost = 0;
+      for (int r = 0; r < options.reps; r++) {
+        waitIdle(rig);
+        float payload = op.payload;
+        if (op.command == 1) {
+          payload = towardsEnd ? 0.8 : 0.2;
+          towardsEnd = !towardsEnd;
+        }
+        /* random phase against the loop so the server's receive window is sampled evenly */
+        uint64_t sent = sim::now() + (uint64_t)(rand() % 150) * 1000000ULL;
+        rig.clearReplies();
+        rig.sendCommandAt(sent, CLIENT, op.command, payload);
+        size_t firstEvent = sim::motorEvents().size();
+        rig.runUntil([&]() {
+          for (size_t i = 0; i < rig.replies().size(); i++) {
+            if (rig.replies()[i].command == op.command) {
+              return true;
+            }
+          }
+          return false;
+        }, 3000000000ULL);
+        bool replied = false;
+        for (size_t i = 0; i < rig.replies().size(); i++) {
+          if (rig.replies()[i].command == op.command) {
+            replyLatency.push_back(ms(rig.replies()[i].time - sent));
+            replied = true;
+            break;
+          }
+        }
+        if (!replied && op.command != 10) {
+          lost++;
+        }
+        rig.runFor(20000000ULL);
+        const std::vector<sim::MotorEvent> &events = sim::motorEvents();
+        for (size_t i = firstEvent; i < events.size(); i++) {
+          if (events[i].time >= sent) {
+            stepLatency.push_back(ms(events[i].time - sent));
+            break;
+          }
+        }
+        if (proxy.calibrating() != CALIBRATION_PHASE_NONE) {
+          rig.calibrate(CALIBRATION_UP_NS, CALIBRATION_DOWN_NS);
+        }
+      }
+      printf("  %2u %-26s\n", op.command, op.name);
+      printStats("  command -> reply", replyLatency, "ms");
+      printStats("  command -> first step", stepLatency, "ms");
+      if (lost > 0) {
+        printf("    %d of %d commands got no reply\n", lost, options.reps);
+      }
+    }
+    sim::watchPin(LED_PIN, NULL);
+    printStats("LED blink", flashes, "ms");
+  }
+
+  /* runs until 'count' replies arrived, returns the time of the last one relative to 'from' */
+  bool awaitReplies(sim::Rig &rig, size_t count, uint64_t from, double &latency) {
+    if (!rig.runUntil([&]() { return rig.replies().size() >= count; }, 3000000000ULL)) {
+      return false;
+    }
+    latency = ms(rig.replies()[count - 1].time - from);
+    return true;
+  }
+
+  /* targets picked in steps, sent as the float position of command 1, as the int32 steps of PROTOCOL_STEPS_TARGET and
+     as the Q16 fraction of PROTOCOL_STEPS_TARGET_Q16: the reply latency, and where the axis ends up against the target */
+  void benchFixedPoint(sim::Rig &rig, const Options &options) {
+    const char *LABELS[] = {"float position (1)", "int32 steps (37)", "Q16 fraction (41)"};
+    printf("\n[targets in steps over the float and the integer commands, %d repetitions]\n", options.reps);
+    waitIdle(rig);
+    rig.clearReplies();
+    rig.sendCommand(CLIENT, PROTOCOL_STEPS_RANGE, 0);
+    double latency;
+    long range = awaitReplies(rig, 1, sim::now(), latency) ? protocolToInt(rig.replies()[0].payload) : 0;
+    if (range <= 0) {
+      printf("  no range, the axis is not calibrated\n");
+      return;
+    }
+    printf("  %-28s %ld steps\n", "range", range);
+    for (int format = 0; format < 3; format++) {
+      std::vector<double> replyLatency;
+      int exact = 0;
+      long worst = 0;
+      for (int r = 0; r < options.reps; r++) {
+        long target = range / 10 + rand() % (range * 8 / 10);
+        waitIdle(rig);
+        rig.clearReplies();
+        uint64_t sent = sim::now();
+        if (format == 0) {
+          rig.sendCommand(CLIENT, 1, (float)target / range);
+        } else if (format == 1) {
+          rig.sendCommand(CLIENT, PROTOCOL_STEPS_TARGET, protocolFromInt(target));
+        } else {
+          rig.sendCommand(CLIENT, PROTOCOL_STEPS_TARGET_Q16, protocolFromInt((target * PROTOCOL_Q16_ONE + range / 2) / range));
+        }
+        if (awaitReplies(rig, 1, sent, latency)) {
+          replyLatency.push_back(latency);
+        }
+        rig.runUntil([]() { return proxy.operating(); }, 1000000000ULL);
+        waitIdle(rig);
+        long error = labs(proxy.getCurrentSteps() - target);
+        exact += error == 0 ? 1 : 0;
+        if (error > worst) {
+          worst = error;
+        }
+      }
+      printf("  %s\n", LABELS[format]);
+      printStats("  command -> reply", replyLatency, "ms");
+      printf("    %d of %d on the target step, at most %ld steps off\n", exact, options.reps, worst);
+    }
+  }
+
+  /* a client streaming where it wants the weight once per rendered frame (FOLLOW_FPS, a sine over the middle of the
+     range): as targets (command 1, the next one once the reply to the one before has come: the device cannot keep up
+     with a reply per frame, and the bytes that overflow its serial buffer turn into stray commands), as setpoints in
+     follow mode, and as setpoints with a velocity hint. How far the axis is from where the client wants it at every
+     frame, and the replies the client gets for it. */
+  void benchFollow(sim::Rig &rig) {
+    const int FOLLOW_FPS = 90;
+    const double PERIOD_S = 2;
+    const int FRAMES = 2 * PERIOD_S * FOLLOW_FPS;
+    const int SETTLE_FRAMES = FOLLOW_FPS / 2;   //not counted, the axis starts at rest
+    const uint64_t FRAME_NS = 1000000000ULL / FOLLOW_FPS;
+    const char *LABELS[] = {"targets (1), once answered", "setpoints (43)", "setpoints + velocity (44)"};
+    printf("\n[a target per frame at %d Hz, sine of %.0f s]\n", FOLLOW_FPS, PERIOD_S);
+    waitIdle(rig);
+    long range = proxy.getRange();
+    double center = range / 2, amplitude = range / 10;
+    printf("  %-28s %.0f +- %.0f steps, at most %.0f steps/s\n", "reference", center, amplitude, amplitude * 2 * M_PI / PERIOD_S);
+    for (int format = 0; format < 3; format++) {
+      double latency;
+      rig.sendCommand(CLIENT, PROTOCOL_STEPS_TARGET, protocolFromInt(lround(center)));
+      rig.runUntil([]() { return proxy.operating(); }, 1000000000ULL);
+      waitIdle(rig);
+      rig.clearReplies();
+      if (format > 0) {
+        rig.sendCommand(CLIENT, PROTOCOL_FOLLOW, 1);
+        if (!awaitReplies(rig, 1, sim::now(), latency) || rig.replies()[0].payload != 1) {
+          printf("  %-28s follow mode refused\n", LABELS[format]);
+          continue;
+        }
+        rig.clearReplies();
+      }
+      std::vector<double> error;
+      size_t sent = 0;
+      uint32_t before[STATS_PAGE_WORDS], after[STATS_PAGE_WORDS];
+      ProxyStats::getPage(0, before);
+      uint64_t start = sim::now() + FRAME_NS;
+      for (int f = 0; f < FRAMES; f++) {
+        double phase = 2 * M_PI * f / (PERIOD_S * FOLLOW_FPS);
+        long target = lround(center + amplitude * sin(phase));
+        long velocity = lround(amplitude * 2 * M_PI / PERIOD_S * cos(phase));
+        sim::schedule(start + f * FRAME_NS, [&rig, &error, &sent, format, f, target, velocity, range, SETTLE_FRAMES]() {
+          if (f >= SETTLE_FRAMES) {
+            error.push_back(labs(proxy.getCurrentSteps() - target));
+          }
+          if (format == 0) {
+            if (rig.replies().size() == sent) {
+              rig.sendCommand(CLIENT, 1, (float)target / range);
+              sent++;
+            }
+          } else if (format == 1) {
+            rig.sendCommand(CLIENT, PROTOCOL_FOLLOW_SETPOINT, protocolFromInt(target));
+          } else {
+            rig.sendCommands(CLIENT, {{PROTOCOL_FOLLOW_VELOCITY, protocolFromInt(velocity)}, {PROTOCOL_FOLLOW_SETPOINT, protocolFromInt(target)}});
+          }
+        });
+      }
+      rig.runFor(start + FRAMES * FRAME_NS - sim::now());
+      ProxyStats::getPage(0, after);
+      size_t replies = rig.replies().size();
+      if (format > 0) {
+        rig.sendCommand(CLIENT, PROTOCOL_FOLLOW, 0);
+        awaitReplies(rig, replies + 1, sim::now(), latency);
+      }
+      waitIdle(rig);
+      printf("  %s\n", LABELS[format]);
+      printStats("  |position - wanted|", error, "steps");
+      printf("    %u commands handled for %d frames, %u replies, %u malformed bytes\n", after[1] - before[1], FRAMES,
+             (unsigned)replies, after[2] - before[2]);
+    }
+  }
+
+  /* the setpoint stream of benchFollow over a WiFi that loses DATAGRAM_LOSS of the packets and delays them by up to
+     DATAGRAM_JITTER_NS, as v2 frames: as datagrams, where a lost one is only gone and one overtaken by a newer one is
+     dropped by its sequence id, and over TCP, where a lost segment holds back all after it until it is sent again and
+     they come at once, more than the serial buffer takes. Last, the stray commands out of an overrun buffer may
+     change anything. */
+  void benchDatagrams(sim::Rig &rig) {
+    const int FOLLOW_FPS = 90;
+    const double PERIOD_S = 2;
+    const int FRAMES = 2 * PERIOD_S * FOLLOW_FPS;
+    const int SETTLE_FRAMES = FOLLOW_FPS / 2;
+    const uint64_t FRAME_NS = 1000000000ULL / FOLLOW_FPS;
+    const double DATAGRAM_LOSS = 0.05;
+    const uint64_t DATAGRAM_JITTER_NS = 15000000ULL;
+    const char *LABELS[] = {"setpoints as datagrams", "setpoints over TCP"};
+    printf("\n[setpoints at %d Hz over a WiFi losing %.0f%% of the packets, up to %.0f ms late]\n", FOLLOW_FPS,
+           DATAGRAM_LOSS * 100, ms(DATAGRAM_JITTER_NS));
+    waitIdle(rig);
+    long range = proxy.getRange();
+    double center = range / 2, amplitude = range / 10;
+    for (int format = 0; format < 2; format++) {
+      double latency;
+      rig.sendCommand(CLIENT, PROTOCOL_STEPS_TARGET, protocolFromInt(lround(center)));
+      rig.runUntil([]() { return proxy.operating(); }, 1000000000ULL);
+      waitIdle(rig);
+      rig.clearReplies();
+      rig.sendCommand(CLIENT, PROTOCOL_FOLLOW, 1);
+      if (!awaitReplies(rig, 1, sim::now(), latency) || rig.replies()[0].payload != 1) {
+        printf("  %-28s follow mode refused\n", LABELS[format]);
+        continue;
+      }
+      rig.clearReplies();
+      sim::esp().wifi.loss = DATAGRAM_LOSS;
+      sim::esp().wifi.jitterNs = DATAGRAM_JITTER_NS;
+      std::vector<double> error;
+      uint32_t before[STATS_PAGE_WORDS], after[STATS_PAGE_WORDS];
+      ProxyStats::getPage(0, before);
+      uint64_t start = sim::now() + FRAME_NS;
+      for (int f = 0; f < FRAMES; f++) {
+        long target = lround(center + amplitude * sin(2 * M_PI * f / (PERIOD_S * FOLLOW_FPS)));
+        sim::schedule(start + f * FRAME_NS, [&rig, &error, format, f, target, SETTLE_FRAMES]() {
+          if (f >= SETTLE_FRAMES) {
+            error.push_back(labs(proxy.getCurrentSteps() - target));
+          }
+          std::vector<sim::Command> setpoint = {{PROTOCOL_FOLLOW_SETPOINT, protocolFromInt(target)}};
+          if (format == 0) {
+            rig.sendDatagram(f + 1, setpoint);
+          } else {
+            rig.sendFrame(CLIENT, f + 1, setpoint);
+          }
+        });
+      }
+      rig.runFor(start + FRAMES * FRAME_NS - sim::now());
+      sim::esp().wifi.loss = 0;
+      sim::esp().wifi.jitterNs = 0;
+      rig.runFor(1000000000ULL);     //what TCP still retransmits
+      ProxyStats::getPage(0, after);
+      size_t replies = rig.replies().size();
+      rig.sendCommand(CLIENT, PROTOCOL_FOLLOW, 0);
+      awaitReplies(rig, replies + 1, sim::now(), latency);
+      waitIdle(rig);
+      printf("  %s\n", LABELS[format]);
+      printStats("  |position - wanted|", error, "steps");
+      printf("    %u commands handled for %d frames, %u dropped as malformed or stale\n", after[1] - before[1], FRAMES,
+             after[2] - before[2]);
+    }
+  }
+
+  struct Profile {
+    int speed;
+    float acceleration, jerk;
+  };
+
+  /* the same move with different limits: duration, and the peak acceleration the motor sees */
+  void benchProfiles(sim::Rig &rig) {
+    const Profile PROFILES[] = {
+      {DEFAULT_SPEED, PLANNER_DEFAULT_ACCELERATION, 0},
+      {DEFAULT_SPEED, PLANNER_MAX_ACCELERATION, 0},      //next to a constant-speed move
+      {2 * DEFAULT_SPEED, 2 * PLANNER_DEFAULT_ACCELERATION, 0},
+      {2 * DEFAULT_SPEED, 2 * PLANNER_DEFAULT_ACCELERATION, 40000},
+    };
+    printf("\n[planned moves 0.2 -> 0.8]\n");
+    for (size_t p = 0; p < sizeof(PROFILES) / sizeof(PROFILES[0]); p++) {
+      const Profile &profile = PROFILES[p];
+      proxy.setCurrentSpeed(profile.speed);
+      proxy.setAcceleration(profile.acceleration);
+      proxy.setJerk(profile.jerk);
+      waitIdle(rig);
+      rig.sendCommand(CLIENT, 1, 0.2);
+      rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+      waitIdle(rig);
+      rig.sendCommand(CLIENT, 1, 0.8);
+      rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+      uint64_t from = sim::now();
+      waitIdle(rig);
+      std::vector<double> intervals = stepIntervals(from, sim::now());
+      double duration = 0, peakRate = 0, peakAcceleration = 0;
+      for (size_t i = 0; i < intervals.size(); i++) {
+        duration += intervals[i];
+        peakRate = max(peakRate, 1e6 / intervals[i]);
+        if (i > 0) {
+          double change = fabs(1e6 / intervals[i] - 1e6 / intervals[i - 1]) / (intervals[i] / 1e6);
+          peakAcceleration = max(peakAcceleration, change);
+        }
+      }
+      char label[64];
+      snprintf(label, sizeof(label), "v=%d a=%.0f j=%.0f", profile.speed, profile.acceleration, profile.jerk);
+      printf("  %-28s %8.1f ms, %5u steps, peak %6.0f steps/s, peak %7.0f steps/s^2\n", label, duration / 1e3,
+             (unsigned)intervals.size() + 1, peakRate, peakAcceleration);
+    }
+    proxy.setCurrentSpeed(DEFAULT_SPEED);
+    proxy.setAcceleration(PLANNER_DEFAULT_ACCELERATION);
+    proxy.setJerk(PLANNER_DEFAULT_JERK);
+  }
+
+  /* expected time (reply to command 1) against the firmware's own measurement of the move */
+  void benchPrediction(sim::Rig &rig) {
+    const uint8_t MODES[] = {SINGLE, DOUBLE, INTERLEAVE, MICROSTEP};
+    const char *MODE_NAMES[] = {"SINGLE", "DOUBLE", "INTERLEAVE", "MICROSTEP"};
+    const int SPEEDS[] = {DEFAULT_SPEED, 2 * DEFAULT_SPEED};
+    const float DISTANCES[] = {0.05, 0.3, 0.6};
+    printf("\n[move time prediction, ms]\n");
+    printf("  %-28s %9s %9s %9s %9s\n", "mode, speed, distance", "predicted", "actual", "error", "linear");
+    for (size_t m = 0; m < sizeof(MODES); m++) {
+      proxy.setStepperMode(MODES[m]);
+      for (size_t v = 0; v < sizeof(SPEEDS) / sizeof(SPEEDS[0]); v++) {
+        proxy.setCurrentSpeed(SPEEDS[v]);
+        for (size_t d = 0; d < sizeof(DISTANCES) / sizeof(DISTANCES[0]); d++) {
+          waitIdle(rig);
+          rig.sendCommand(CLIENT, 1, 0.2);
+          rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+          waitIdle(rig);
+          rig.clearReplies();
+          rig.sendCommand(CLIENT, 1, 0.2 + DISTANCES[d]);
+          rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+          waitIdle(rig);
+          if (rig.replies().empty()) {
+            continue;
+          }
+          double predicted = rig.replies()[0].payload;
+          double actual = predicted + proxy.getPredictionError(TIMING_ERROR_LAST);
+          /* the replaced model: the calibration sweep time scaled by distance and speed */
+          double linear = ms(CALIBRATION_DOWN_NS) * DISTANCES[d] * DEFAULT_SPEED / SPEEDS[v];
+          char label[64];
+          snprintf(label, sizeof(label), "%s, %d, %.2f", MODE_NAMES[m], SPEEDS[v], DISTANCES[d]);
+          printf("  %-28s %9.0f %9.0f %9.0f %9.0f\n", label, predicted, actual, actual - predicted, linear);
+        }
+      }
+    }
+    printf("  %-28s mean |error| %ld ms, max %ld ms\n", "firmware record", proxy.getPredictionError(TIMING_ERROR_MEAN),
+           proxy.getPredictionError(TIMING_ERROR_MAX));
+    proxy.setStepperMode(DOUBLE);
+    proxy.setCurrentSpeed(DEFAULT_SPEED);
+  }
+
+  void benchPipelining(sim::Rig &rig, const Options &options) {
+    printf("\n[speed + target + status, %d repetitions]\n", options.reps);
+    std::vector<double> sequential, coalesced, framed;
+    int lost[3] = {0, 0, 0};
+    bool towardsEnd = true;
+    for (int r = 0; r < options.reps; r++) {
+      std::vector<sim::Command> commands(3);
+      commands[0].command = 2;
+      commands[0].payload = DEFAULT_SPEED;
+      commands[1].command = 1;
+      commands[1].payload = towardsEnd ? 0.6 : 0.4;
+      commands[2].command = 3;
+      commands[2].payload = 0;
+      towardsEnd = !towardsEnd;
+      double latency;
+
+      waitIdle(rig);
+      rig.clearReplies();
+      uint64_t sent = sim::now();
+      bool complete = true;
+      for (size_t i = 0; i < commands.size() && complete; i++) {
+        rig.sendCommand(CLIENT, commands[i].command, commands[i].payload);
+        complete = awaitReplies(rig, i + 1, sent, latency);
+      }
+      complete ? sequential.push_back(latency) : (void)lost[0]++;
+
+      waitIdle(rig);
+      rig.clearReplies();
+      sent = sim::now();
+      rig.sendCommands(CLIENT, commands);
+      awaitReplies(rig, commands.size(), sent, latency) ? coalesced.push_back(latency) : (void)lost[1]++;
+
+      waitIdle(rig);
+      rig.clearReplies();
+      sent = sim::now();
+      rig.sendFrame(CLIENT, r + 1, commands);
+      if (awaitReplies(rig, commands.size(), sent, latency) && rig.replies()[0].sequenceId == r + 1) {
+        framed.push_back(latency);
+      } else {
+        lost[2]++;
+      }
+    }
+    printStats("v1, one per round trip", sequential, "ms");
+    printStats("v1, coalesced in one write", coalesced, "ms");
+    printStats("v2, one frame", framed, "ms");
+    if (lost[0] + lost[1] + lost[2] > 0) {
+      printf("    incomplete: %d one by one, %d coalesced, %d framed\n", lost[0], lost[1], lost[2]);
+    }
+
+    rig.clearReplies();
+    rig.sendCommand(CLIENT, PROTOCOL_VERSION_COMMAND, 2);
+    double latency;
+    if (awaitReplies(rig, 1, sim::now(), latency)) {
+      printf("  %-28s v%.0f\n", "negotiated protocol", rig.replies()[0].payload);
+    }
+  }
+
+  /* time of the last motor step before 'until' */
+  uint64_t lastStep(uint64_t until) {
+    const std::vector<sim::MotorEvent> &events = sim::motorEvents();
+    for (size_t i = events.size(); i > 0; i--) {
+      if (events[i - 1].time < until) {
+        return events[i - 1].time;
+      }
+    }
+    return 0;
+  }
+
+  void benchTelemetry(sim::Rig &rig, const Options &options) {
+    printf("\n[move completion, pushed at %d Hz vs polled, %d repetitions]\n", PROTOCOL_TELEMETRY_MAX_RATE, options.reps);
+    std::vector<double> pushInterval, pushed, polled;
+    int lost[2] = {0, 0};
+    bool towardsEnd = true;
+
+    rig.clearReplies();
+    rig.sendCommand(CLIENT, PROTOCOL_TELEMETRY_SUBSCRIBE, PROTOCOL_TELEMETRY_MAX_RATE);
+    double latency;
+    if (!awaitReplies(rig, 1, sim::now(), latency) || rig.replies()[0].payload != PROTOCOL_TELEMETRY_MAX_RATE) {
+      printf("  subscription failed\n");
+      return;
+    }
+    for (int r = 0; r < options.reps; r++) {
+      waitIdle(rig);
+      rig.runFor(200000000ULL);
+      rig.clearReplies();
+      rig.sendCommand(CLIENT, 1, towardsEnd ? 0.7 : 0.3);
+      towardsEnd = !towardsEnd;
+      bool completed = rig.runUntil([&]() {
+        for (size_t i = 0; i < rig.replies().size(); i++) {
+          if (rig.replies()[i].command == PROTOCOL_EVENT_MOVE_COMPLETED) {
+            return true;
+          }
+        }
+        return false;
+      }, 10000000000ULL);
+      uint64_t last = 0;
+      for (size_t i = 0; i < rig.replies().size(); i++) {
+        const sim::Reply &reply = rig.replies()[i];
+        if (reply.command == PROTOCOL_TELEMETRY_POSITION) {
+          if (last != 0) {
+            pushInterval.push_back(ms(reply.time - last));
+          }
+          last = reply.time;
+        } else if (reply.command == PROTOCOL_EVENT_MOVE_COMPLETED) {
+          pushed.push_back(ms(reply.time - lastStep(reply.time)));
+        }
+      }
+      if (!completed) {
+        lost[0]++;
+      }
+    }
+
+    /* the same moves without a subscription, the client asks isTargetReached until it says so */
+    rig.clearReplies();
+    rig.sendCommand(CLIENT, PROTOCOL_TELEMETRY_SUBSCRIBE, 0);
+    awaitReplies(rig, 1, sim::now(), latency);
+    for (int r = 0; r < options.reps; r++) {
+      waitIdle(rig);
+      rig.runFor(200000000ULL);
+      rig.clearReplies();
+      rig.sendCommand(CLIENT, 1, towardsEnd ? 0.7 : 0.3);
+      towardsEnd = !towardsEnd;
+      if (!awaitReplies(rig, 1, sim::now(), latency)) {
+        lost[1]++;
+        continue;
+      }
+      bool reached = false;
+      for (int poll = 0; poll < 200 && !reached; poll++) {
+        size_t count = rig.replies().size();
+        rig.sendCommand(CLIENT, 3, 0);
+        if (!awaitReplies(rig, count + 1, sim::now(), latency)) {
+          break;
+        }
+        const sim::Reply &reply = rig.replies()[count];
+        if (reply.command == 3 && reply.payload == 1) {
+          polled.push_back(ms(reply.time - lastStep(reply.time)));
+          reached = true;
+        }
+      }
+      if (!reached) {
+        lost[1]++;
+      }
+    }
+    printStats("push interval while moving", pushInterval, "ms");
+    printStats("last step -> pushed event", pushed, "ms");
+    printStats("last step -> polled reply", polled, "ms");
+    if (lost[0] + lost[1] > 0) {
+      printf("    incomplete: %d pushed, %d polled\n", lost[0], lost[1]);
+    }
+  }
+
+  /* pauses between the segments of a script whose segments change direction: from the last step of one
+     direction to the first of the other, on port 2 (axis 0) */
+  std::vector<double> segmentGaps(uint64_t from, uint64_t to) {
+    std::vector<double> gaps;
+    const sim::MotorEvent *last = NULL;
+    for (const sim::MotorEvent &event : sim::motorEvents()) {
+      if (event.time < from || event.time >= to || event.port != 2) {
+        continue;
+      }
+      if (last != NULL && event.dir != last->dir) {
+        gaps.push_back(ms(event.time - last->time));
+      }
+      last = &event;
+    }
+    return gaps;
+  }
+
+  /* a script of five segments: sent one by one by a client that waits for MOVE_COMPLETED, or as waypoints
+     in one frame */
+  void benchWaypoints(sim::Rig &rig, const Options &options) {
+    const float SCRIPT[] = {0.3, 0.5, 0.35, 0.6, 0.4};
+    const size_t SEGMENTS = sizeof(SCRIPT) / sizeof(SCRIPT[0]);
+    printf("\n[script of %u segments, %d repetitions]\n", (unsigned)SEGMENTS, options.reps);
+    std::vector<double> gaps[2], total[2];
+    double latency;
+    waitIdle(rig);
+    rig.sendCommand(CLIENT, 1, SCRIPT[SEGMENTS - 1]);   //every repetition starts where the script ends
+    rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+    waitIdle(rig);
+    rig.clearReplies();
+    rig.sendCommand(CLIENT, PROTOCOL_TELEMETRY_SUBSCRIBE, PROTOCOL_TELEMETRY_MAX_RATE);
+    awaitReplies(rig, 1, sim::now(), latency);
+    for (int r = 0; r < options.reps; r++) {
+      waitIdle(rig);
+      rig.runFor(200000000ULL);
+      uint64_t from = sim::now();
+      for (size_t i = 0; i < SEGMENTS; i++) {
+        rig.clearReplies();
+        rig.sendCommand(CLIENT, 1, SCRIPT[i]);
+        rig.runUntil([&]() {
+          for (const sim::Reply &reply : rig.replies()) {
+            if (reply.command == PROTOCOL_EVENT_MOVE_COMPLETED) {
+              return true;
+            }
+          }
+          return false;
+        }, 10000000000ULL);
+      }
+      waitIdle(rig);
+      std::vector<double> g = segmentGaps(from, sim::now());
+      gaps[0].insert(gaps[0].end(), g.begin(), g.end());
+      total[0].push_back(ms(lastStep(sim::now()) - from));
+    }
+    rig.clearReplies();
+    rig.sendCommand(CLIENT, PROTOCOL_TELEMETRY_SUBSCRIBE, 0);
+    awaitReplies(rig, 1, sim::now(), latency);
+
+    for (int r = 0; r < options.reps; r++) {
+      waitIdle(rig);
+      rig.runFor(200000000ULL);
+      uint64_t from = sim::now();
+      std::vector<sim::Command> frame;
+      for (size_t i = 0; i < SEGMENTS; i++) {
+        frame.push_back({PROTOCOL_WAYPOINT_APPEND, SCRIPT[i]});
+      }
+      rig.sendFrame(CLIENT, 1, frame);
+      rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+      waitIdle(rig);
+      std::vector<double> g = segmentGaps(from, sim::now());
+      gaps[1].insert(gaps[1].end(), g.begin(), g.end());
+      total[1].push_back(ms(lastStep(sim::now()) - from));
+    }
+    printStats("one by one: gap", gaps[0], "ms");
+    printStats("one by one: script", total[0], "ms");
+    printStats("waypoints: gap", gaps[1], "ms");
+    printStats("waypoints: script", total[1], "ms");
+
+    /* dwell and start time: rest 200 ms at 0.5, then leave for 0.3 at 1500 ms after the queue started */
+    waitIdle(rig);
+    rig.runFor(200000000ULL);
+    rig.clearReplies();
+    uint64_t from = sim::now();
+    rig.sendFrame(CLIENT, 2, {{PROTOCOL_WAYPOINT_DWELL, 200}, {PROTOCOL_WAYPOINT_APPEND, 0.5},
+                              {PROTOCOL_WAYPOINT_START_AT, 1500}, {PROTOCOL_WAYPOINT_APPEND, 0.3}});
+    rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+    waitIdle(rig);
+    const sim::MotorEvent *first = NULL, *second = NULL;
+    for (const sim::MotorEvent &event : sim::motorEvents()) {
+      if (event.time < from || event.port != 2) {
+        continue;
+      }
+      if (first == NULL) {
+        first = &event;
+      } else if (event.dir != first->dir) {
+        second = &event;
+        break;
+      }
+    }
+    std::vector<double> g = segmentGaps(from, sim::now());
+    if (first != NULL && second != NULL && !g.empty()) {
+      printf("  dwell 200, start at 1500 ms  first step to first step %.1f ms, %.1f ms at rest in between\n",
+             ms(second->time - first->time), g[0]);
+    } else {
+      printf("  dwell 200, start at 1500 ms  incomplete\n");
+    }
+  }
+
+  /* button events go to every client, the one that spoke last as well as a silent one; a client that went away
+     is dropped on the first event it cannot take */
+  void benchClients(sim::Rig &rig, const Options &options) {
+    printf("\n[button events with a second client, %d repetitions]\n", options.reps);
+    if (!rig.connect(MONITOR)) {
+      printf("  monitor could not connect\n");
+      return;
+    }
+    rig.clearReplies();
+    rig.sendCommand(MONITOR, 0, 0);           //the monitor speaks last
+    double latency;
+    awaitReplies(rig, 1, sim::now(), latency);
+    std::vector<double> toClient[2];
+    for (int r = 0; r < options.reps; r++) {
+      waitIdle(rig);
+      rig.clearReplies();
+      uint64_t pressed = sim::now();
+      rig.pressButton();
+      rig.runFor(1000000000ULL);
+      for (const sim::Reply &reply : rig.replies()) {
+        if (reply.command == 6 + BUTTON_EVENT_DOWN && (reply.mux == CLIENT || reply.mux == MONITOR)) {
+          toClient[reply.mux == CLIENT ? 0 : 1].push_back(ms(reply.time - pressed));
+        }
+      }
+    }
+    printStats("press -> event at client", toClient[0], "ms");
+    printStats("press -> event at monitor", toClient[1], "ms");
+    printf("  sessions                     %u open\n", server.getSessionCount());
+
+    rig.disconnect(MONITOR);
+    rig.runFor(200000000ULL);
+    rig.clearReplies();
+    rig.clearLoopPeriods();
+    uint64_t pressed = sim::now();
+    rig.pressButton();
+    rig.runFor(1000000000ULL);
+    std::vector<double> loops, event;
+    for (uint64_t period : rig.loopPeriods()) {
+      loops.push_back(ms(period));
+    }
+    for (const sim::Reply &reply : rig.replies()) {
+      if (reply.command == 6 + BUTTON_EVENT_DOWN && reply.mux == CLIENT) {
+        event.push_back(ms(reply.time - pressed));
+      }
+    }
+    printf("  monitor gone\n");
+    printStats("press -> event at client", event, "ms");
+    printStats("loop period", loops, "ms");
+    printf("  sessions                     %u open\n", server.getSessionCount());
+  }
+
+  /* button presses as the clients see them: short and bouncing presses, and how close the time and position
+     reported come to the moment of the press */
+  void benchButton(sim::Rig &rig, const Options &options) {
+    printf("\n[button events, %d presses each]\n", options.reps);
+    rig.sendCommand(CLIENT, PROTOCOL_SUBSCRIBE_EVENTS, PROTOCOL_EVENTS_ALL);
+    rig.runFor(300000000ULL);
+    const uint64_t HOLDS[2] = {20000000ULL, 150000000ULL};
+    const char *LABELS[2] = {"20 ms press, no bounce", "150 ms press, 3 bounces"};
+    for (int kind = 0; kind < 2; kind++) {
+      std::vector<double> latency;
+      int events = 0;
+      for (int r = 0; r < options.reps; r++) {
+        rig.clearReplies();
+        uint64_t pressed = sim::now() + (uint64_t)(rand() % 100000) * 1000ULL;   //anywhere in a loop() pass
+        sim::schedule(pressed, [&rig, kind, &HOLDS]() { rig.pressButton(HOLDS[kind], 0, kind == 0 ? 0 : 3); });
+        rig.runFor(pressed - sim::now() + HOLDS[kind] + 400000000ULL);
+        for (const sim::Reply &reply : rig.replies()) {
+          if (reply.mux == CLIENT && (reply.command == 6 + BUTTON_EVENT_DOWN || reply.command == 6 + BUTTON_EVENT_UP)) {
+            if (events++, reply.command == 6 + BUTTON_EVENT_UP) {
+              latency.push_back(ms(reply.time - pressed));
+            }
+          }
+        }
+      }
+      printStats(LABELS[kind], latency, "ms");
+      printf("    events per press %.2f (2 = press and release)\n", (double)events / options.reps);
+    }
+
+    /* pressed while moving: the event carries the position and time of the press, the weight stops after it */
+    std::vector<double> timeError, positionError, overrun;
+    for (int r = 0; r < options.reps; r++) {
+      waitIdle(rig);
+      rig.sendCommand(CLIENT, 1, r % 2 == 0 ? 0.9 : 0.1);
+      rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+      rig.clearReplies();
+      uint64_t pressed = sim::now() + (uint64_t)(200000 + rand() % 300000) * 1000ULL;
+      sim::schedule(pressed, [&rig]() { rig.pressButton(50000000ULL); });
+      rig.runUntil([pressed]() { return sim::now() > pressed; }, 1000000000ULL);
+      waitIdle(rig);
+      rig.runFor(200000000ULL);
+      long after = 0;       //steps the motor made after the press
+      for (const sim::MotorEvent &event : sim::motorEvents()) {
+        after += event.time > pressed && event.port == 2 ? 1 : 0;
+      }
+      const std::vector<sim::Reply> &replies = rig.replies();
+      for (size_t i = 0; i + 1 < replies.size(); i++) {
+        if (replies[i].command == 6 + BUTTON_EVENT_UP && replies[i + 1].command == PROTOCOL_EVENT_TIME) {
+          uint32_t time;
+          memcpy(&time, &replies[i + 1].payload, sizeof(time));
+          double stopped = fabs(proxy.getCurrentPosition() - replies[i].payload);
+          timeError.push_back((double)time - pressed / 1000.0);
+          positionError.push_back(fabs(stopped - after * proxy.getPosition(1)) * 1000);
+          overrun.push_back(after);
+          break;
+        }
+      }
+    }
+    printStats("press while moving: time", timeError, "us");
+    printStats("  |position - at press|", positionError, "1e-3");
+    printStats("  steps after the press", overrun, "steps");
+    rig.sendCommand(CLIENT, PROTOCOL_SUBSCRIBE_EVENTS, PROTOCOL_EVENTS_BUTTON);
+    rig.runFor(300000000ULL);
+  }
+
+  /* command round trips of the only client over the TCP server (AT+CIPSEND per reply) and in passthrough,
+     and the way back to the server */
+  void benchPassthrough(sim::Rig &rig, const Options &options) {
+    printf("\n[single client: TCP server vs passthrough, %d repetitions]\n", options.reps);
+    const char *labels[2] = {"server: command -> reply", "passthrough: command -> reply"};
+    for (int mode = 0; mode < 2; mode++) {
+      if (mode == 1) {
+        rig.listen(CLIENT, CLIENT_PORT);
+        rig.sendCommand(CLIENT, PROTOCOL_PASSTHROUGH, CLIENT_PORT);
+        uint64_t asked = sim::now();
+        if (!rig.runUntil([]() { return server.isPassthrough(); }, 5000000000ULL)) {
+          printf("  passthrough did not start\n");
+          return;
+        }
+        printf("  switched to passthrough in %.1f ms\n", ms(sim::now() - asked));
+      }
+      std::vector<double> latency;
+      uint64_t bytes = 0;
+      for (int r = 0; r < options.reps; r++) {
+        waitIdle(rig);
+        uint64_t sent = sim::now() + (uint64_t)(rand() % 150) * 1000000ULL;
+        rig.clearReplies();
+        uint64_t before = sim::esp().bytesToDevice() + sim::esp().bytesFromDevice();
+        rig.sendCommandAt(sent, CLIENT, 0, 0);
+        double replied;
+        if (awaitReplies(rig, 1, sent, replied)) {
+          latency.push_back(replied);
+        }
+        rig.runFor(50000000ULL);
+        bytes += sim::esp().bytesToDevice() + sim::esp().bytesFromDevice() - before;
+      }
+      printStats(labels[mode], latency, "ms");
+      printf("    serial bytes per round trip %.1f\n", (double)bytes / options.reps);
+    }
+
+    rig.clearReplies();
+    rig.sendCommand(CLIENT, PROTOCOL_PASSTHROUGH, 0);
+    uint64_t asked = sim::now();
+    if (!rig.runUntil([]() { return !server.isPassthrough(); }, 5000000000ULL)) {
+      printf("  passthrough did not end\n");
+      return;
+    }
+    rig.runFor(1000000000ULL);
+    double latency = 0;
+    rig.clearReplies();
+    bool back = rig.connect(CLIENT);
+    rig.sendCommand(CLIENT, 0, 0);
+    back = back && awaitReplies(rig, 1, sim::now(), latency);
+    printf("  back to the server in %.1f ms, %s\n", ms(sim::now() - asked), back ? "client reconnected" : "client could not reconnect");
+  }
+
+  /* one page of the device's counters over the protocol (see PROTOCOL_STATS), false if it did not come */
+  bool readStatsPage(sim::Rig &rig, uint8_t page, uint32_t *words) {
+    rig.clearReplies();
+    rig.sendCommand(CLIENT, PROTOCOL_STATS, page);
+    double latency;
+    if (!awaitReplies(rig, 1 + STATS_PAGE_WORDS, sim::now(), latency) || rig.replies()[0].payload != page) {
+      return false;
+    }
+    for (int i = 0; i < STATS_PAGE_WORDS; i++) {
+      memcpy(&words[i], &rig.replies()[1 + i].payload, sizeof(uint32_t));
+    }
+    return true;
+  }
+
+  /* the counters the device kept over the whole run (reset after the client connected), as a client reads them */
+  void benchStats(sim::Rig &rig) {
+    printf("\n[device stats since the reset]\n");
+    uint32_t summary[STATS_PAGE_WORDS];
+    if (!readStatsPage(rig, 0, summary)) {
+      printf("  stats not received\n");
+      return;
+    }
+    printf("  %.1f s, %u commands, %u malformed bytes, %u missed step deadlines\n", summary[0] / 1000.0, summary[1],
+           summary[2], summary[3]);
+    const char *TIMINGS[STATS_TIMINGS] = {"loop period", "step lateness", "receive", "send"};
+    for (uint8_t t = 0; t < STATS_TIMINGS; t++) {
+      uint32_t h[STATS_PAGE_WORDS], buckets[STATS_PAGE_WORDS];
+      if (!readStatsPage(rig, 1 + 2 * t, h) || !readStatsPage(rig, 2 + 2 * t, buckets)) {
+        continue;
+      }
+      printf("  %-28s n=%-6u mean=%9.3f min=%9.3f max=%9.3f ms  |", TIMINGS[t], h[0], h[0] > 0 ? h[1] / 1000.0 / h[0] : 0,
+             h[2] / 1000.0, h[3] / 1000.0);
+      for (int b = 0; b < STATS_BUCKETS; b++) {
+        printf(" %u", (buckets[b / 2] >> (16 * (b % 2))) & 0xFFFF);
+      }
+      printf("\n");
+    }
+    uint32_t words[STATS_PAGE_WORDS];
+    printf("  per command:");
+    for (uint8_t page = 1 + 2 * STATS_TIMINGS; page < STATS_TASK_PAGE && readStatsPage(rig, page, words); page++) {
+      for (int i = 0; i < 2 * STATS_PAGE_WORDS; i++) {
+        uint32_t count = (words[i / 2] >> (16 * (i % 2))) & 0xFFFF;
+        if (count > 0) {
+          printf(" %d:%u", (page - 1 - 2 * STATS_TIMINGS) * 2 * STATS_PAGE_WORDS + i, count);
+        }
+      }
+    }
+    printf("\n");
+    const char *TASKS[] = {"button", "network", "motors", "feedback", "telemetry"};   //in the order of setup()
+    uint32_t overruns[STATS_PAGE_WORDS], longest[STATS_TASKS];
+    if (readStatsPage(rig, STATS_TASK_PAGE, overruns) && readStatsPage(rig, STATS_TASK_PAGE + 1, longest) &&
+        readStatsPage(rig, STATS_TASK_PAGE + 2, &longest[STATS_PAGE_WORDS])) {
+      for (uint8_t t = 0; t < TaskScheduler::count(); t++) {
+        printf("  task %-23s overruns=%-6u longest=%9.3f ms\n", TASKS[t], (overruns[t / 2] >> (16 * (t % 2))) & 0xFFFF,
+               longest[t] / 1000.0);
+      }
+    }
+    rig.clearReplies();
+    rig.sendCommand(CLIENT, PROTOCOL_STATS, PROTOCOL_STATS_RESET);
+    rig.runFor(200000000ULL);
+    bool reset = readStatsPage(rig, 0, summary) && summary[1] == 1;   //the read itself
+    printf("  reset: %s\n", reset ? "ok" : "FAILED");
+  }
+
+  /* coil current of a motor port in % of full PWM, the larger of both coils */
+  double coilCurrent(uint8_t port) {
+    uint8_t base = port == 1 ? 8 : 2;   //PWMA and PWMB at base and base + 5, as stubs/Wire.cpp
+    double current = 0;
+    for (uint8_t channel = base; channel <= base + 5; channel += 5) {
+      uint16_t on = sim::pca9685On(channel), off = sim::pca9685Off(channel);
+      current = max(current, (off & 0x1000) ? 0.0 : (on & 0x1000) ? 100.0 : off * 100.0 / 4096);
+    }
+    return current;
+  }
+
+  /* the power states of an axis at rest as a subscribed client sees them pushed, the coil current in each, and how
+     soon a move starts from each */
+  void benchPower(sim::Rig &rig, const Options &options) {
+    const long HOLD_DELAY = 500, RELEASE_DELAY = 3000;    //ms
+    const char *STATES[3] = {"full", "hold", "released"};
+    printf("\n[motor power at rest, hold after %ld ms at %d%%, released after %ld ms, %d repetitions]\n", HOLD_DELAY,
+           POWER_HOLD_CURRENT, RELEASE_DELAY, options.reps);
+    rig.sendCommands(CLIENT, {{PROTOCOL_SUBSCRIBE_EVENTS, PROTOCOL_EVENTS_BUTTON | PROTOCOL_EVENTS_POWER},
+                              {PROTOCOL_POWER_HOLD_DELAY, protocolFromInt(HOLD_DELAY)},
+                              {PROTOCOL_POWER_RELEASE_DELAY, protocolFromInt(RELEASE_DELAY)}});
+    rig.runFor(300000000ULL);
+    std::vector<double> after[3], wake[3];      //per POWER_*
+    double current[3] = {0, 0, 0};
+    for (int r = 0; r < options.reps; r++) {
+      /* at rest: the states pushed after the end of a move */
+      float direction = r % 2 == 0 ? 1 : -1;    //all moves of a repetition the same way, the counted steps lag a reversal
+      rig.sendCommand(CLIENT, 1, 0.5 + 0.1 * direction);
+      rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+      waitIdle(rig);
+      uint64_t stopped = sim::now();
+      current[POWER_FULL] = coilCurrent(2);
+      rig.clearReplies();
+      rig.runFor((RELEASE_DELAY + 500) * 1000000ULL);
+      for (const sim::Reply &reply : rig.replies()) {
+        if (reply.mux == CLIENT && reply.command == PROTOCOL_POWER_STATE) {
+          long state = protocolToInt(reply.payload);
+          if (state >= 0 && state < 3) {
+            after[state].push_back(ms(reply.time - stopped));
+          }
+        }
+      }
+      current[POWER_RELEASED] = coilCurrent(2);
+
+      /* moves from each state: command to the first step */
+      for (int state = POWER_RELEASED; state >= POWER_FULL; state--) {
+        if (state == POWER_HOLD) {
+          rig.runFor((HOLD_DELAY + 300) * 1000000ULL);
+          current[POWER_HOLD] = coilCurrent(2);
+        }
+        uint64_t sent = sim::now();
+        rig.sendCommand(CLIENT, 1, proxy.getCurrentPosition() + 0.05 * direction);
+        rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+        waitIdle(rig);
+        uint64_t first = firstStep(sent, sim::now(), 2);
+        if (first > 0) {
+          wake[state].push_back(ms(first - sent));
+        }
+      }
+    }
+    for (int state = POWER_FULL; state <= POWER_RELEASED; state++) {
+      printf("  %-28s coil current %.0f%%\n", STATES[state], current[state]);
+      if (state != POWER_FULL) {
+        printStats("  pushed after the stop", after[state], "ms");
+      }
+      printStats("  command -> first step", wake[state], "ms");
+    }
+    rig.sendCommands(CLIENT, {{PROTOCOL_SUBSCRIBE_EVENTS, PROTOCOL_EVENTS_BUTTON},
+                              {PROTOCOL_POWER_HOLD_DELAY, protocolFromInt(POWER_HOLD_DELAY)},
+                              {PROTOCOL_POWER_RELEASE_DELAY, protocolFromInt(POWER_RELEASE_DELAY)}});
+    rig.runFor(300000000ULL);
+  }
+
+  /* both stepper ports at once: independent moves at different rates share the step timer, a coordinated
+     move (staged targets) ends on both axes together */
+  void benchTwoAxes(sim::Rig &rig, const Options &options) {
+    if (StepScheduler::count() < 2) {
+      return;
+    }
+    Proxy *second = StepScheduler::get(1);
+    const uint8_t PORTS[2] = {2, 1};      //motorPort and secondMotorPort in Proxy-Controller.ino
+    const int SPEEDS[2] = {DEFAULT_SPEED, 3 * DEFAULT_SPEED / 5};
+    proxy.setCurrentSpeed(SPEEDS[0]);
+    second->setCurrentSpeed(SPEEDS[1]);
+    printf("\n[two axes at %d and %d steps/s, %d repetitions]\n", SPEEDS[0], SPEEDS[1], options.reps);
+    std::vector<double> jitter[2], finish, error;
+    for (int r = 0; r < options.reps; r++) {
+      rig.sendFrame(CLIENT, 1, {{PROTOCOL_SELECT_AXIS, 0}, {1, 0.2}, {PROTOCOL_SELECT_AXIS, 1}, {1, 0.8}});
+      rig.runUntil([second]() { return proxy.operating() && second->operating(); }, 5000000000ULL);
+      waitAllIdle(rig);
+      uint64_t from = sim::now();
+      rig.sendFrame(CLIENT, 2, {{PROTOCOL_SELECT_AXIS, 0}, {1, 0.8}, {PROTOCOL_SELECT_AXIS, 1}, {1, 0.2}});
+      rig.runUntil([second]() { return proxy.operating() && second->operating(); }, 5000000000ULL);
+      waitAllIdle(rig);
+      for (int a = 0; a < 2; a++) {
+        std::vector<double> intervals = stepIntervals(from, sim::now(), PORTS[a]);
+        size_t ramp = (size_t)ceil((double)SPEEDS[a] * SPEEDS[a] / (2 * proxy.getAcceleration())) + 1;
+        for (size_t i = ramp; i + ramp < intervals.size(); i++) {
+          jitter[a].push_back(fabs(intervals[i] - 1e6 / SPEEDS[a]));
+        }
+      }
+
+      /* coordinated: axis 0 goes twice as far as axis 1 */
+      rig.clearReplies();
+      from = sim::now();
+      rig.sendFrame(CLIENT, 3, {{PROTOCOL_SELECT_AXIS, 0}, {PROTOCOL_STAGE_TARGET, 0.2}, {PROTOCOL_SELECT_AXIS, 1},
+                                {PROTOCOL_STAGE_TARGET, 0.5}, {PROTOCOL_MOVE_STAGED, 0}});
+      rig.runUntil([second]() { return proxy.operating() || second->operating(); }, 5000000000ULL);
+      waitAllIdle(rig);
+      uint64_t starts[2] = {firstStep(from, sim::now(), PORTS[0]), firstStep(from, sim::now(), PORTS[1])};
+      uint64_t ends[2] = {lastStep(from, sim::now(), PORTS[0]), lastStep(from, sim::now(), PORTS[1])};
+      finish.push_back(fabs(ms(ends[0]) - ms(ends[1])));
+      for (const sim::Reply &reply : rig.replies()) {
+        if (reply.command == PROTOCOL_MOVE_STAGED) {
+          error.push_back(ms(max(ends[0], ends[1]) - min(starts[0], starts[1])) - reply.payload);
+        }
+      }
+    }
+    printStats("axis 0 |interval - ideal|", jitter[0], "us");
+    printStats("axis 1 |interval - ideal|", jitter[1], "us");
+    printStats("coordinated: ends apart", finish, "ms");
+    printStats("coordinated: actual - expected", error, "ms");
+    rig.sendFrame(CLIENT, 4, {{PROTOCOL_SELECT_AXIS, 0}});
+    waitAllIdle(rig);
+    proxy.setCurrentSpeed(DEFAULT_SPEED);
+    second->setCurrentSpeed(DEFAULT_SPEED);
+  }
+
+  /* flat out: the timer asks for STEP_TIMER_MAX_RATE, the I2C writes of a step decide what is reached */
+  void benchMaxStepRate(sim::Rig &rig) {
+    const uint8_t MODES[] = {SINGLE, DOUBLE, INTERLEAVE, MICROSTEP};
+    const char *MODE_NAMES[] = {"SINGLE", "DOUBLE", "INTERLEAVE", "MICROSTEP"};
+    printf("\n[max step rate per mode, 0.2 -> 0.8]\n");
+    proxy.setCurrentSpeed(STEP_TIMER_MAX_RATE);
+    proxy.setAcceleration(PLANNER_MAX_ACCELERATION);
+    for (size_t m = 0; m < sizeof(MODES); m++) {
+      proxy.setStepperMode(MODES[m]);
+      waitIdle(rig);
+      rig.sendCommand(CLIENT, 1, 0.2);
+      rig.runUntil([]() { return proxy.operating(); }, 5000000000ULL);
+      waitIdle(rig);
+      uint64_t from = sim::now();
+      uint32_t transactions = sim::i2cTransactions();
+      rig.sendCommand(CLIENT, 1, 0.8);
+      /* a MICROSTEP move may start and finish between two loop() passes */
+      rig.runUntil([]() { return proxy.operating() || proxy.getCurrentPosition() > 0.79; }, 5000000000ULL);
+      waitIdle(rig);
+      transactions = sim::i2cTransactions() - transactions;
+      std::vector<double> intervals = stepIntervals(from, sim::now());
+      if (intervals.size() < 10) {
+        continue;
+      }
+      std::sort(intervals.begin(), intervals.end());
+      double cruise = intervals[intervals.size() / 2];     //the ramps are a few steps at this acceleration
+      printf("  %-28s %6.0f steps/s, %5.1f I2C transactions per step\n", MODE_NAMES[m], 1e6 / cruise,
+             (double)transactions / (intervals.size() + 1));
+    }
+    proxy.setStepperMode(DOUBLE);
+    proxy.setCurrentSpeed(DEFAULT_SPEED);
+    proxy.setAcceleration(PLANNER_DEFAULT_ACCELERATION);
+  }
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  options.reps = 20;
+  options.seed = 1;
+  options.echo = false;
+  options.eeprom = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+      options.reps = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      options.seed = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--echo") == 0) {
+      options.echo = true;
+    } else if (strcmp(argv[i], "--eeprom") == 0 && i + 1 < argc) {
+      options.eeprom = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [--reps N] [--seed N] [--echo] [--eeprom FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+  srand(options.seed);
+  sim::setEcho(options.echo);
+
+  if (options.eeprom != NULL && sim::loadEeprom(options.eeprom)) {
+    printf("EEPROM loaded from %s\n", options.eeprom);
+  }
+  sim::Rig rig(BUTTON_PIN, SECOND_BUTTON_PIN);
+  rig.boot();
+  printf("boot finished at %.1f ms (virtual)\n", ms(sim::now()));
+  for (uint8_t axis = 0; axis < StepScheduler::count(); axis++) {
+    if (StepScheduler::get(axis)->isCalibrated()) {
+      printf("axis %d: calibration restored from EEPROM\n", axis);
+      continue;
+    }
+    if (!rig.calibrate(CALIBRATION_UP_NS, CALIBRATION_DOWN_NS, axis)) {
+      fprintf(stderr, "calibration of axis %d did not finish\n", axis);
+      return 1;
+    }
+  }
+  printf("calibrated at %.1f ms (virtual)\n", ms(sim::now()));
+  if (!rig.connect(CLIENT)) {
+    fprintf(stderr, "client could not connect\n");
+    return 1;
+  }
+  rig.runFor(500000000ULL);
+  rig.sendCommand(CLIENT, PROTOCOL_STATS, PROTOCOL_STATS_RESET);
+  rig.runFor(200000000ULL);
+
+  benchLoopPeriod(rig);
+  benchStepJitter(rig);
+  benchRetarget(rig, options);
+  benchProfiles(rig);
+  benchPrediction(rig);
+  benchMaxStepRate(rig);
+  benchTwoAxes(rig, options);
+  benchOpcodes(rig, options);
+  benchFixedPoint(rig, options);
+  benchFollow(rig);
+  benchPipelining(rig, options);
+  benchTelemetry(rig, options);
+  benchWaypoints(rig, options);
+  benchClients(rig, options);
+  benchButton(rig, options);
+  benchPassthrough(rig, options);
+  benchStats(rig);
+  benchPower(rig, options);
+
+  waitAllIdle(rig);
+  uint32_t writes = sim::eepromWrites();
+  rig.runFor((CALIBRATION_SAVE_DELAY + 500) * 1000000ULL);
+  printf("\nEEPROM: %u bytes written during the run, %u by the save at rest\n", sim::eepromWrites(),
+         sim::eepromWrites() - writes);
+  if (options.eeprom != NULL && !sim::saveEeprom(options.eeprom)) {
+    fprintf(stderr, "could not write %s\n", options.eeprom);
+    return 1;
+  }
+  benchDatagrams(rig);    //last, see there
+  return 0;
+}
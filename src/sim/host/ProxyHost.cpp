@@ -0,0 +1,222 @@
+/*
+  ProxyHost.cpp - Runs the Proxy-Controller firmware on the host, serving the protocol on a real TCP socket.
+
+  The firmware runs on the simulated rig (see Rig.h) on the main thread, the motion side, with its virtual clock held
+  to the wall clock: every loop() sleeps until the wall clock caught up with the time the loop took on the simulated
+  board. Its transport is a SocketTransport on 127.0.0.1, whose network thread talks to it over lock-free queues only,
+  so the clients are real TCP connections and the timing of the firmware stays that of the board.
+
+    proxy-host [--port N] [--seconds S]         serves on port N (default 8090, 0 = any free port), for S seconds
+                                                (default 0: until interrupted)
+    proxy-host --load N [--seconds S]           also starts N clients (at most PROTOCOL_MAX_CONNECTIONS) on threads of
+                                                their own that send position requests (command 0) back to back for S
+                                                seconds (default 5), the first one a new target every LOAD_MOVE_EVERY
+                                                requests; reports the round trips and the commands handled per second
+
+  The axes are calibrated in virtual time first, as by the bench.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "host/SocketTransport.h"
+#include "Rig.h"
+#include "Arduino.h"
+#include "Proxy.h"
+#include "StepScheduler.h"
+
+extern ProxyTransport *transport;
+
+#define BUTTON_PIN 2          //buttonPin in Proxy-Controller.ino
+#define SECOND_BUTTON_PIN 5   //secondButtonPin
+#define CALIBRATION_UP_NS 200000000ULL
+#define CALIBRATION_DOWN_NS 2000000000ULL
+#define DEFAULT_PORT 8090     //as the ESP8266 serves
+#define LOAD_SECONDS 5
+#define LOAD_MOVE_EVERY 50    //requests of the first client between new targets
+#define HOST_LATE_NS 1000000  //a loop done this much later on the host than on the board counts as behind
+
+namespace {
+
+  volatile sig_atomic_t interrupted = 0;
+  std::atomic<int> activeClients(0);      //load clients still sending, the firmware serves them to the end
+
+  void onInterrupt(int) {
+    interrupted = 1;
+  }
+
+  /* round trips of one load client, in ms */
+  struct LoadClient {
+    std::vector<double> roundTrips;
+    unsigned errors;
+  };
+
+  double wallMs(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+
+  bool readAll(int fd, uint8_t *buffer, size_t len) {
+    while (len > 0) {
+      ssize_t n = recv(fd, buffer, len, 0);
+      if (n <= 0) return false;
+      buffer += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  /* one client: a v1 command, waits for its reply, and again until the deadline */
+  void runLoadClient(uint16_t port, int index, std::chrono::steady_clock::time_point deadline, LoadClient &result) {
+    result.errors = 0;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (fd < 0 || connect(fd, (sockaddr *)&address, sizeof(address)) != 0) {
+      result.errors++;
+      if (fd >= 0) close(fd);
+      return;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    timeval timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    uint8_t packet[PROTOCOL_PACKET_SIZE];
+    for (unsigned n = 0; std::chrono::steady_clock::now() < deadline && !interrupted; n++) {
+      if (index == 0 && n % LOAD_MOVE_EVERY == 0) {
+        protocolWritePacket(packet, 1, (n / LOAD_MOVE_EVERY) % 2 == 0 ? 0.8f : 0.2f);   //SEND_NEW_TARGET
+      } else {
+        protocolWritePacket(packet, 0, 0);                                               //REQUEST_POSITION
+      }
+      std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+      uint8_t reply[PROTOCOL_PACKET_SIZE];
+      if (send(fd, packet, sizeof(packet), MSG_NOSIGNAL) != (ssize_t)sizeof(packet) || !readAll(fd, reply, sizeof(reply))) {
+        result.errors++;
+        break;
+      }
+      if (reply[0] != packet[0]) {
+        result.errors++;      //not the reply, e.g. a button event
+        continue;
+      }
+      result.roundTrips.push_back(wallMs(std::chrono::steady_clock::now() - sent));
+    }
+    close(fd);
+  }
+
+  void runLoadClientThread(uint16_t port, int index, std::chrono::steady_clock::time_point deadline, LoadClient &result) {
+    runLoadClient(port, index, deadline, result);
+    activeClients--;
+  }
+
+  void printRoundTrips(const char *name, const std::vector<double> &roundTrips, unsigned errors, double seconds) {
+    if (roundTrips.empty()) {
+      printf("  %-8s no replies, %u errors\n", name, errors);
+      return;
+    }
+    printf("  %-8s %7zu replies %8.0f/s  round trip p50 %6.3f  p99 %6.3f  max %6.3f ms  %u errors\n", name,
+           roundTrips.size(), roundTrips.size() / seconds, sim::percentile(roundTrips, 0.5), sim::percentile(roundTrips, 0.99),
+           sim::percentile(roundTrips, 1.0), errors);
+  }
+
+}
+
+int main(int argc, char **argv) {
+  int port = DEFAULT_PORT;
+  double seconds = -1;
+  int load = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+      port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+      load = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s [--port N] [--seconds S] [--load N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (load < 0 || load > PROTOCOL_MAX_CONNECTIONS || port < 0 || port > 65535) {
+    fprintf(stderr, "--load takes 0 to %d clients, --port 0 to 65535\n", PROTOCOL_MAX_CONNECTIONS);
+    return 2;
+  }
+  if (seconds < 0) seconds = load > 0 ? LOAD_SECONDS : 0;
+  signal(SIGINT, onInterrupt);
+  signal(SIGTERM, onInterrupt);
+
+  host::SocketTransport socketTransport(port);
+  transport = &socketTransport;       //before setup() hands it to the server
+  sim::Rig rig(BUTTON_PIN, SECOND_BUTTON_PIN);
+  rig.boot();
+  if (socketTransport.getPort() == 0 || (port != 0 && socketTransport.getPort() != port)) {
+    fprintf(stderr, "could not serve on 127.0.0.1:%d\n", port);
+    return 1;
+  }
+  for (uint8_t axis = 0; axis < StepScheduler::count(); axis++) {
+    if (!StepScheduler::get(axis)->isCalibrated() && !rig.calibrate(CALIBRATION_UP_NS, CALIBRATION_DOWN_NS, axis)) {
+      fprintf(stderr, "calibration of axis %d did not finish\n", axis);
+      return 1;
+    }
+  }
+  printf("serving on 127.0.0.1:%u\n", socketTransport.getPort());
+  fflush(stdout);
+
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point deadline = wallStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(seconds));
+  std::vector<LoadClient> clients(load);
+  std::vector<std::thread> threads;
+  activeClients = load;
+  for (int i = 0; i < load; i++) {
+    threads.emplace_back(runLoadClientThread, socketTransport.getPort(), i, deadline, std::ref(clients[i]));
+  }
+
+  uint64_t simStart = sim::now();
+  uint64_t loops = 0;
+  uint64_t behind = 0;
+  while (!interrupted && (seconds == 0 || std::chrono::steady_clock::now() < deadline || activeClients > 0)) {
+    loop();
+    loops++;
+    std::chrono::steady_clock::time_point due = wallStart + std::chrono::nanoseconds(sim::now() - simStart);
+    if (std::chrono::steady_clock::now() > due + std::chrono::nanoseconds(HOST_LATE_NS)) {
+      behind++;
+    } else {
+      std::this_thread::sleep_until(due);
+    }
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  double elapsed = wallMs(std::chrono::steady_clock::now() - wallStart) / 1000.0;
+  printf("%llu loops in %.2f s, %llu behind the wall clock\n", (unsigned long long)loops, elapsed, (unsigned long long)behind);
+  if (load > 0) {
+    printf("load: %d clients, %.1f s\n", load, seconds);
+    std::vector<double> all;
+    unsigned errors = 0;
+    for (int i = 0; i < load; i++) {
+      char name[16];
+      snprintf(name, sizeof(name), "client %d", i);
+      printRoundTrips(name, clients[i].roundTrips, clients[i].errors, seconds);
+      all.insert(all.end(), clients[i].roundTrips.begin(), clients[i].roundTrips.end());
+      errors += clients[i].errors;
+    }
+    printRoundTrips("all", all, errors, seconds);
+  }
+  socketTransport.stop();
+  return 0;
+}
@@ -0,0 +1,203 @@
+/*
+  SocketTransport.cpp - TCP server on localhost as the transport of the ProxyControlServer in the host build.
+*/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "SocketTransport.h"
+
+namespace host {
+
+  SocketTransport::SocketTransport(uint16_t port) : _port(port), _listenFd(-1), _running(false) {
+    _wakeFds[0] = _wakeFds[1] = -1;
+    for (uint8_t i = 0; i < PROTOCOL_MAX_CONNECTIONS; i++) {
+      _clientFds[i] = -1;
+      _connected[i] = false;
+    }
+  }
+
+  SocketTransport::~SocketTransport() {
+    stop();
+  }
+
+  /* binds 127.0.0.1 and starts the network thread */
+  bool SocketTransport::start() {
+    if (_running) return true;
+    _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listenFd < 0) return false;
+    int on = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(_port);
+    socklen_t length = sizeof(address);
+    if (bind(_listenFd, (sockaddr *)&address, sizeof(address)) != 0 || listen(_listenFd, PROTOCOL_MAX_CONNECTIONS) != 0
+        || getsockname(_listenFd, (sockaddr *)&address, &length) != 0 || pipe2(_wakeFds, O_NONBLOCK) != 0) {
+      ::close(_listenFd);
+      _listenFd = -1;
+      return false;
+    }
+    _port = ntohs(address.sin_port);
+    _running = true;
+    _thread = std::thread(&SocketTransport::run, this);
+    return true;
+  }
+
+  /* closes the clients and the server, the motion side is not told */
+  bool SocketTransport::stop() {
+    if (!_running) return true;
+    _running = false;
+    uint8_t wake = 0;
+    if (::write(_wakeFds[1], &wake, 1) < 0) {}    //a full pipe wakes the thread as well
+    _thread.join();
+    for (uint8_t i = 0; i < PROTOCOL_MAX_CONNECTIONS; i++) {
+      if (_clientFds[i] >= 0) ::close(_clientFds[i]);
+      _clientFds[i] = -1;
+      _connected[i] = false;
+    }
+    ::close(_listenFd);
+    ::close(_wakeFds[0]);
+    ::close(_wakeFds[1]);
+    _listenFd = _wakeFds[0] = _wakeFds[1] = -1;
+    return true;
+  }
+
+  /* motion side: hands what the network thread queued to the listener */
+  bool SocketTransport::poll() {
+    bool data = false;
+    SocketMessage message;
+    while (_received.pop(message)) {
+      if (message.length == 0) {
+        if (_listener != NULL) _listener->onClosed(message.mux);
+        continue;
+      }
+      data = true;
+      if (_listener == NULL) continue;
+      for (uint8_t i = 0; i < message.length; i++) {
+        _listener->onReceived(message.mux, message.data[i]);
+      }
+    }
+    return data;
+  }
+
+  /* motion side: queues the bytes for the network thread, false if the client is gone */
+  bool SocketTransport::send(uint8_t mux_id, const uint8_t *buffer, uint8_t len) {
+    if (mux_id >= PROTOCOL_MAX_CONNECTIONS || !_connected[mux_id]) return false;
+    SocketMessage message;
+    message.mux = mux_id;
+    for (uint8_t sent = 0; sent < len; sent += message.length) {
+      message.length = min(len - sent, SOCKET_MESSAGE_SIZE);
+      memcpy(message.data, buffer + sent, message.length);
+      while (!_outgoing.push(message)) {
+        std::this_thread::yield();     //the network thread is behind by a full queue, let it catch up
+      }
+    }
+    uint8_t wake = 0;
+    if (::write(_wakeFds[1], &wake, 1) < 0) {}    //already woken if the pipe is full
+    return true;
+  }
+
+  void SocketTransport::run() {
+    pollfd fds[2 + PROTOCOL_MAX_CONNECTIONS];
+    uint8_t muxes[2 + PROTOCOL_MAX_CONNECTIONS];
+    while (_running) {
+      fds[0].fd = _wakeFds[0];
+      fds[1].fd = _listenFd;
+      nfds_t count = 2;
+      for (uint8_t i = 0; i < PROTOCOL_MAX_CONNECTIONS; i++) {
+        if (_clientFds[i] < 0) continue;
+        fds[count].fd = _clientFds[i];
+        muxes[count++] = i;
+      }
+      for (nfds_t i = 0; i < count; i++) {
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+      }
+      if (::poll(fds, count, SOCKET_POLL_TIMEOUT) < 0 && errno != EINTR) break;
+
+      if (fds[0].revents & POLLIN) {
+        uint8_t drain[64];
+        while (::read(_wakeFds[0], drain, sizeof(drain)) > 0) {}
+      }
+      write();
+      for (nfds_t i = 2; i < count; i++) {
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) read(muxes[i]);
+      }
+      if (fds[1].revents & POLLIN) accept();
+    }
+  }
+
+  void SocketTransport::accept() {
+    int fd = ::accept(_listenFd, NULL, NULL);
+    if (fd < 0) return;
+    for (uint8_t i = 0; i < PROTOCOL_MAX_CONNECTIONS; i++) {
+      if (_clientFds[i] >= 0) continue;
+      int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));    //replies are a few bytes each
+      _clientFds[i] = fd;
+      _connected[i] = true;
+      return;
+    }
+    ::close(fd);      //all mux ids are taken, as the ESP8266 does
+  }
+
+  /* false if the client closed */
+  bool SocketTransport::read(uint8_t mux) {
+    if (_clientFds[mux] < 0) return false;      //closed by write() in the same round
+    SocketMessage message;
+    ssize_t n = recv(_clientFds[mux], message.data, SOCKET_MESSAGE_SIZE, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return true;
+    if (n <= 0) {
+      close(mux);
+      return false;
+    }
+    message.mux = mux;
+    message.length = n;
+    deliver(message);
+    return true;
+  }
+
+  /* sends the queued replies of the clients still connected */
+  void SocketTransport::write() {
+    SocketMessage message;
+    while (_outgoing.pop(message)) {
+      int fd = _clientFds[message.mux];
+      for (uint8_t sent = 0; fd >= 0 && sent < message.length;) {
+        ssize_t n = ::send(fd, message.data + sent, message.length - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+          close(message.mux);
+          break;
+        }
+        sent += n;
+      }
+    }
+  }
+
+  void SocketTransport::close(uint8_t mux) {
+    ::close(_clientFds[mux]);
+    _clientFds[mux] = -1;
+    _connected[mux] = false;
+    SocketMessage message;
+    message.mux = mux;
+    message.length = 0;
+    deliver(message);
+  }
+
+  void SocketTransport::deliver(const SocketMessage &message) {
+    while (!_received.push(message) && _running) {
+      std::this_thread::yield();       //the firmware takes the queue every loop, a full one drains within ms
+    }
+  }
+
+}
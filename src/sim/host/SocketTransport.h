@@ -0,0 +1,64 @@
+/*
+  SocketTransport.h - TCP server on localhost as the transport of the ProxyControlServer in the host build.
+
+  A network thread accepts up to PROTOCOL_MAX_CONNECTIONS clients (mux ids as on the ESP8266, a client beyond them is
+  closed right away), reads their sockets and writes the replies. It meets the thread running the firmware (the motion
+  side, which calls poll() and send()) only through two SpscQueues: what the clients sent and closed goes one way, the
+  replies the other. send() does not wait for the client, so the firmware never blocks on the network.
+*/
+
+#ifndef SocketTransport_h
+#define SocketTransport_h
+
+#include <atomic>
+#include <thread>               //before Arduino.h, whose min() and max() are macros
+
+#include "ProxyTransport.h"
+#include "ProxyProtocol.h"
+#include "SpscQueue.h"
+
+#define SOCKET_MESSAGE_SIZE 32      //bytes of one queued read or reply
+#define SOCKET_QUEUE_SIZE 1024      //messages per direction
+#define SOCKET_POLL_TIMEOUT 100     //ms the network thread sleeps without traffic
+
+namespace host {
+
+  struct SocketMessage {
+    uint8_t mux;
+    uint8_t length;                 //0 from the network thread: the client closed
+    uint8_t data[SOCKET_MESSAGE_SIZE];
+  };
+
+  class SocketTransport : public ProxyTransport {
+    public:
+      /* port 0 binds any free port, see getPort() */
+      SocketTransport(uint16_t port);
+      ~SocketTransport();
+      bool start();
+      bool stop();
+      bool poll();
+      bool send(uint8_t mux_id, const uint8_t *buffer, uint8_t len);
+      uint16_t getPort() const { return _port; }
+
+    private:
+      uint16_t _port;
+      int _listenFd;
+      int _wakeFds[2];                                        //a pipe, wakes the network thread for replies
+      int _clientFds[PROTOCOL_MAX_CONNECTIONS];               //network thread only
+      std::atomic<bool> _connected[PROTOCOL_MAX_CONNECTIONS];
+      std::atomic<bool> _running;
+      std::thread _thread;
+      SpscQueue<SocketMessage, SOCKET_QUEUE_SIZE> _received;  //network thread -> motion side
+      SpscQueue<SocketMessage, SOCKET_QUEUE_SIZE> _outgoing;  //motion side -> network thread
+
+      void run();
+      void accept();
+      bool read(uint8_t mux);
+      void write();
+      void close(uint8_t mux);
+      void deliver(const SocketMessage &message);
+  };
+
+}
+
+#endif
@@ -0,0 +1,49 @@
+/*
+  SpscQueue.h - Lock-free queue between exactly one producer thread and one consumer thread.
+
+  A ring of N slots (a power of two). Only the producer moves the tail and only the consumer moves the head; each
+  side reads the other's index with acquire and publishes its own with release, so a slot is written before the
+  consumer sees it and read before the producer writes it again. push() fails on a full ring, pop() on an empty one.
+*/
+
+#ifndef SpscQueue_h
+#define SpscQueue_h
+
+#include <atomic>
+#include <stddef.h>
+
+namespace host {
+
+  template <typename T, size_t N> class SpscQueue {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "the capacity is a power of two");
+
+    public:
+      SpscQueue() : _head(0), _tail(0) {}
+
+      /* producer */
+      bool push(const T &item) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == N) return false;
+        _items[tail & (N - 1)] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+      }
+
+      /* consumer */
+      bool pop(T &item) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) return false;
+        item = _items[head & (N - 1)];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+    private:
+      T _items[N];
+      alignas(64) std::atomic<size_t> _head;    //own cache lines, the two threads do not share one
+      alignas(64) std::atomic<size_t> _tail;
+  };
+
+}
+
+#endif
@@ -0,0 +1,451 @@
+/*
+  ProxyReplay.cpp - Replays a trace of the controller's traffic (see ProxyTrace.h) against the firmware on the simulated rig.
+
+  The commands of the trace are sent by simulated clients at the times the controller handled them, and the button
+  edges are made at theirs; the firmware takes them through its own loop() (handleCommand(), Proxy::go()) and traces
+  its traffic meanwhile. Reports per command id the latency from handling a command to its reply, in the trace and in
+  the replay, the largest latencies of the trace next to what the replay made of them, and how far the times the
+  replay handled the commands at drift from the trace's.
+
+    proxy-replay FILE [--max-divergence MS]     replays FILE, exits with 1 if a command was handled more than MS
+                                                earlier or later than in the trace (times from the first command
+                                                on, less the median), or not at all
+    proxy-replay --capture FILE [--reps N]      records FILE from a scripted session of two clients on the simulated
+                                                rig, read over PROTOCOL_TRACE_READ as a client on the device would
+
+  A trace file is "PXTR" followed by the records as read, two uint32 words each (little endian, see PROTOCOL_TRACE).
+  The simulated axes are calibrated as by the bench; all times are virtual (see stubs/Sim.h), so replays are reproducible.
+*/
+
+#include "Rig.h"
+#include "Arduino.h"
+#include "Proxy.h"
+#include "ProxyProtocol.h"
+#include "ProxyTrace.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern Proxy proxy;
+
+#define BUTTON_PIN 2          //buttonPin in Proxy-Controller.ino
+#define SECOND_BUTTON_PIN 5   //secondButtonPin
+#define CLIENT 0
+#define MONITOR 1             //a second client that polls the position meanwhile
+#define CALIBRATION_UP_NS 200000000ULL
+#define CALIBRATION_DOWN_NS 2000000000ULL
+#define REPLAY_LEAD_NS 100000000ULL     //from the start of the replay to its first command
+#define REPLAY_TAIL_NS 2000000000ULL    //after the last event of the trace
+#define REPLAY_MATCH_WINDOW_MS 50.0     //a command handled further off than this is taken for another one
+#define SPIKES_SHOWN 5
+
+namespace {
+
+  /* one record of a trace, at its absolute time */
+  struct Event {
+    uint64_t time;      //us, micros() of the controller
+    uint8_t kind;
+    uint8_t mux;
+    uint8_t command;
+    float payload;
+  };
+
+  /* a received command with the reply it got, -1 without */
+  struct Handled {
+    uint64_t time;
+    uint8_t mux;
+    uint8_t command;
+    double latency;     //ms
+    float reply;
+  };
+
+  void printStats(const char *label, const std::vector<double> &v, const char *unit) {
+    if (v.empty()) {
+      printf("  %-28s %8s\n", label, "-");
+      return;
+    }
+    double sum = 0;
+    for (size_t i = 0; i < v.size(); i++) {
+      sum += v[i];
+    }
+    printf("  %-28s n=%-5u mean=%9.3f p50=%9.3f p95=%9.3f p99=%9.3f max=%9.3f %s\n", label, (unsigned)v.size(),
+           sum / v.size(), sim::percentile(v, 0.5), sim::percentile(v, 0.95), sim::percentile(v, 0.99),
+           sim::percentile(v, 1.0), unit);
+  }
+
+  /* the records as read (two words each) into events; lost counts the records the device could not keep */
+  std::vector<Event> decode(const std::vector<uint32_t> &words, unsigned &lost) {
+    std::vector<Event> events;
+    uint64_t time = 0;
+    lost = 0;
+    for (size_t i = 0; i + 1 < words.size(); i += 2) {
+      Event e;
+      e.kind = (words[i] >> 20) & 0x0F;
+      e.mux = (words[i] >> 16) & 0x0F;
+      e.command = words[i] >> 24;
+      if (e.kind == TRACE_TIME) {
+        time = words[i + 1];
+        lost += e.command;
+        continue;
+      }
+      time += words[i] & 0xFFFF;
+      e.time = time;
+      e.payload = protocolFromInt(words[i + 1]);
+      events.push_back(e);
+    }
+    return events;
+  }
+
+  /* every command received, with the first packet of the same command id sent back on its connection before the
+     next one of that id came */
+  std::vector<Handled> handled(const std::vector<Event> &events) {
+    std::vector<Handled> commands;
+    for (size_t i = 0; i < events.size(); i++) {
+      if (events[i].kind != TRACE_RECEIVED) {
+        continue;
+      }
+      Handled h = {events[i].time, events[i].mux, events[i].command, -1, 0};
+      for (size_t j = i + 1; j < events.size(); j++) {
+        const Event &e = events[j];
+        if (e.mux != h.mux || e.command != h.command) {
+          continue;
+        }
+        if (e.kind == TRACE_SENT) {
+          h.latency = (e.time - h.time) / 1e3;
+          h.reply = e.payload;
+        }
+        if (e.kind == TRACE_SENT || e.kind == TRACE_RECEIVED) {
+          break;
+        }
+      }
+      commands.push_back(h);
+    }
+    return commands;
+  }
+
+  bool load(const char *path, std::vector<uint32_t> &words) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+      return false;
+    }
+    char magic[4];
+    bool ok = fread(magic, 1, 4, f) == 4 && memcmp(magic, "PXTR", 4) == 0;
+    uint8_t b[4];
+    while (ok && fread(b, 1, 4, f) == 4) {
+      words.push_back(b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24));
+    }
+    fclose(f);
+    return ok;
+  }
+
+  bool save(const char *path, const std::vector<uint32_t> &words) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+      return false;
+    }
+    fwrite("PXTR", 1, 4, f);
+    for (uint32_t w : words) {
+      uint8_t b[4] = {(uint8_t)w, (uint8_t)(w >> 8), (uint8_t)(w >> 16), (uint8_t)(w >> 24)};
+      fwrite(b, 1, 4, f);
+    }
+    return fclose(f) == 0;
+  }
+
+  bool boot(sim::Rig &rig) {
+    rig.boot();
+    for (uint8_t axis = 0; axis < StepScheduler::count(); axis++) {
+      if (!rig.calibrate(CALIBRATION_UP_NS, CALIBRATION_DOWN_NS, axis)) {
+        fprintf(stderr, "calibration of axis %d did not finish\n", axis);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /* sends TRACE_READ until the trace is empty, the words of the records read appended */
+  bool readTrace(sim::Rig &rig, std::vector<uint32_t> &words) {
+    while (true) {
+      rig.clearReplies();
+      rig.sendCommand(CLIENT, PROTOCOL_TRACE_READ, 0);
+      long records = -1;
+      bool complete = rig.runUntil([&]() {
+        const std::vector<sim::Reply> &replies = rig.replies();
+        size_t header = replies.size();
+        for (size_t i = 0; i < replies.size() && header == replies.size(); i++) {
+          if (replies[i].mux == CLIENT && replies[i].command == PROTOCOL_TRACE_READ) {
+            header = i;
+          }
+        }
+        if (header == replies.size()) {
+          return false;
+        }
+        records = protocolToInt(replies[header].payload);
+        return replies.size() >= header + 1 + 2 * records;
+      }, 3000000000ULL);
+      if (!complete) {
+        return false;
+      }
+      if (records == 0) {
+        return true;
+      }
+      for (const sim::Reply &r : rig.replies()) {
+        if (r.mux == CLIENT && r.command == PROTOCOL_TRACE_DATA) {
+          words.push_back(protocolToInt(r.payload));
+        }
+      }
+    }
+  }
+
+  void waitIdle(sim::Rig &rig) {
+    rig.runUntil([]() { return !proxy.operating(); }, 60000000000ULL);
+  }
+
+  /* a session of moves, speed changes and button presses by CLIENT while MONITOR polls the position; the trace is read
+     after every move, before the ring fills up */
+  int capture(const char *path, int reps) {
+    sim::Rig rig(BUTTON_PIN, SECOND_BUTTON_PIN);
+    if (!boot(rig) || !rig.connect(CLIENT) || !rig.connect(MONITOR)) {
+      return 1;
+    }
+    rig.runFor(500000000ULL);
+    rig.sendCommand(CLIENT, PROTOCOL_TRACE, 1);
+    rig.runFor(100000000ULL);
+    std::vector<uint32_t> words;
+    for (int r = 0; r < reps; r++) {
+      uint64_t moveNs = (300 + rand() % 500) * 1000000ULL;
+      if (r % 4 == 1) {
+        rig.sendCommand(CLIENT, 2, 300 + rand() % 500);
+        rig.runFor(50000000ULL);
+      }
+      float target = 0.1 + (rand() % 800) / 1000.0;
+      if (r % 3 == 2) {
+        rig.sendCommand(CLIENT, PROTOCOL_STEPS_TARGET, protocolFromInt(lround(target * proxy.getRange())));
+      } else {
+        rig.sendCommand(CLIENT, 1, target);
+      }
+      uint64_t start = sim::now();
+      for (uint64_t t = 50000000ULL; t < moveNs; t += 100000000ULL) {
+        rig.sendCommandAt(start + t, MONITOR, 0, 0);
+      }
+      if (r % 5 == 3) {
+        sim::schedule(start + moveNs / 2, [&rig]() { rig.pressButton(); });
+      }
+      rig.runFor(moveNs);
+      waitIdle(rig);
+      rig.runFor(200000000ULL);
+      if (!readTrace(rig, words)) {
+        fprintf(stderr, "trace not received\n");
+        return 1;
+      }
+    }
+    if (!save(path, words)) {
+      fprintf(stderr, "could not write %s\n", path);
+      return 1;
+    }
+    unsigned lost;
+    std::vector<Event> events = decode(words, lost);
+    printf("%u records (%u lost) over %.1f s written to %s\n", (unsigned)events.size(), lost,
+           events.empty() ? 0 : (events.back().time - events.front().time) / 1e6, path);
+    return 0;
+  }
+
+  void printLatencies(const char *title, const std::vector<Handled> &commands) {
+    printf("\n[%s: command -> reply per command id]\n", title);
+    for (int command = 0; command < 256; command++) {
+      std::vector<double> latency;
+      for (const Handled &h : commands) {
+        if (h.command == command && h.latency >= 0) {
+          latency.push_back(h.latency);
+        }
+      }
+      if (!latency.empty()) {
+        char label[32];
+        snprintf(label, sizeof(label), "command %d", command);
+        printStats(label, latency, "ms");
+      }
+    }
+  }
+
+  int replay(const char *path, double maxDivergence) {
+    std::vector<uint32_t> words;
+    if (!load(path, words)) {
+      fprintf(stderr, "%s is not a trace\n", path);
+      return 2;
+    }
+    unsigned lost;
+    std::vector<Event> trace = decode(words, lost);
+    uint64_t first = 0;
+    for (const Event &e : trace) {
+      if (e.kind == TRACE_RECEIVED) {
+        first = e.time;
+        break;
+      }
+    }
+    if (first == 0) {
+      fprintf(stderr, "%s holds no commands\n", path);
+      return 2;
+    }
+    printf("%s: %u records, %u lost, %.1f s\n", path, (unsigned)trace.size(), lost, (trace.back().time - first) / 1e6);
+
+    sim::Rig rig(BUTTON_PIN, SECOND_BUTTON_PIN);
+    if (!boot(rig)) {
+      return 1;
+    }
+    bool connected[sim::EspModule::MAX_CONNECTIONS] = {false};
+    for (const Event &e : trace) {
+      if (e.kind == TRACE_RECEIVED && !connected[e.mux % sim::EspModule::MAX_CONNECTIONS]) {
+        connected[e.mux % sim::EspModule::MAX_CONNECTIONS] = rig.connect(e.mux);
+      }
+    }
+    rig.runFor(500000000ULL);
+
+    /* commands handled one right after the other without a reply in between came in one write */
+    uint64_t start = sim::now() + REPLAY_LEAD_NS;
+    for (size_t i = 0; i < trace.size(); i++) {
+      const Event &e = trace[i];
+      if (e.time < first) {
+        continue;
+      }
+      uint64_t at = start + (e.time - first) * 1000;
+      if (e.kind == TRACE_BUTTON) {
+        int level = e.command == 6 + BUTTON_EVENT_DOWN ? LOW : HIGH;
+        sim::schedule(at, [level]() { sim::setPin(BUTTON_PIN, level); });
+      } else if (e.kind == TRACE_RECEIVED) {
+        std::vector<sim::Command> write = {{e.command, e.payload}};
+        while (i + 1 < trace.size() && trace[i + 1].kind == TRACE_RECEIVED && trace[i + 1].mux == e.mux &&
+               trace[i + 1].time - trace[i].time < 1000) {
+          i++;
+          write.push_back({trace[i].command, trace[i].payload});
+        }
+        uint8_t mux = e.mux;
+        sim::schedule(at, [&rig, mux, write]() { rig.sendCommands(mux, write); });
+      }
+    }
+    std::vector<uint32_t> replayed;
+    ProxyTrace::start();
+    uint64_t end = start + (trace.back().time - first) * 1000 + REPLAY_TAIL_NS;
+    rig.runUntil([&]() {
+      uint32_t record[2];
+      while (ProxyTrace::take(record)) {
+        replayed.push_back(record[0]);
+        replayed.push_back(record[1]);
+      }
+      return sim::now() >= end;
+    }, end - sim::now() + 1000000000ULL);
+    ProxyTrace::stop();
+
+    unsigned replayLost;
+    std::vector<Handled> before = handled(trace), after = handled(decode(replayed, replayLost));
+    std::vector<Handled> traced;
+    for (const Handled &h : before) {
+      if (h.time >= first) {
+        traced.push_back(h);
+      }
+    }
+    printLatencies("trace", traced);
+    printLatencies("replay", after);
+
+    /* a command of the trace is the next one of the replay with its connection and id that was handled within
+       REPLAY_MATCH_WINDOW_MS of it, counted from the start of each; the commands in between are extra */
+    std::vector<int> match(traced.size(), -1);
+    std::vector<double> drift;
+    std::vector<size_t> order;
+    size_t next = 0;
+    int missing = 0, replies = 0;
+    for (size_t i = 0; i < traced.size(); i++) {
+      double at = (traced[i].time - first) / 1e3;
+      for (size_t j = next; j < after.size(); j++) {
+        double offset = (after[j].time * 1000.0 - start) / 1e6 - at;
+        if (offset > REPLAY_MATCH_WINDOW_MS) {
+          break;
+        }
+        if (after[j].mux == traced[i].mux && after[j].command == traced[i].command && offset >= -REPLAY_MATCH_WINDOW_MS) {
+          match[i] = j;
+          next = j + 1;
+          drift.push_back(offset);
+          if (protocolToInt(traced[i].reply) != protocolToInt(after[j].reply)) {
+            replies++;
+          }
+          break;
+        }
+      }
+      if (match[i] < 0) {
+        missing++;
+      }
+      if (traced[i].latency >= 0) {
+        order.push_back(i);
+      }
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return traced[a].latency > traced[b].latency; });
+    printf("\n[largest latencies of the trace]\n");
+    for (size_t i = 0; i < order.size() && i < SPIKES_SHOWN; i++) {
+      const Handled &t = traced[order[i]];
+      printf("  at %9.3f s  command %-3d on %d   trace %8.3f ms   replay ", (t.time - first) / 1e6, t.command, t.mux,
+             t.latency);
+      if (match[order[i]] < 0) {
+        printf("not handled\n");
+      } else if (after[match[order[i]]].latency < 0) {
+        printf("no reply\n");
+      } else {
+        printf("%8.3f ms\n", after[match[order[i]]].latency);
+      }
+    }
+
+    /* the trace has the times the commands were handled at, the replay sends them then: its times are later by the
+       time from a client's write to the handling, which is taken out */
+    double delay = sim::percentile(drift, 0.5);
+    std::vector<double> divergence;
+    for (double offset : drift) {
+      divergence.push_back(fabs(offset - delay));
+    }
+    printf("\n[replay against the trace]\n");
+    printf("  %u commands traced, %d not handled in the replay, %u extra; %u records lost in the replay\n",
+           (unsigned)traced.size(), missing, (unsigned)(after.size() - (traced.size() - missing)), replayLost);
+    for (size_t i = 0, shown = 0; i < traced.size() && shown < SPIKES_SHOWN; i++) {
+      if (match[i] < 0) {
+        printf("  not handled: at %9.3f s  command %-3d on %d\n", (traced[i].time - first) / 1e6, traced[i].command,
+               traced[i].mux);
+        shown++;
+      }
+    }
+    printf("  %-28s %9.3f ms (median)\n", "write -> handled", delay);
+    printStats("|handled: replay - trace|", divergence, "ms");
+    printf("  %d replies with a different payload\n", replies);
+    double worst = divergence.empty() ? 0 : sim::percentile(divergence, 1.0);
+    if (maxDivergence >= 0 && (missing > 0 || worst > maxDivergence)) {
+      printf("  DIVERGED (more than %.3f ms)\n", maxDivergence);
+      return 1;
+    }
+    return 0;
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *path = NULL;
+  bool record = false;
+  int reps = 20;
+  double maxDivergence = -1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+      record = true;
+      path = argv[++i];
+    } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+      reps = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--max-divergence") == 0 && i + 1 < argc) {
+      maxDivergence = atof(argv[++i]);
+    } else if (path == NULL && argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      path = NULL;
+      break;
+    }
+  }
+  if (path == NULL) {
+    fprintf(stderr, "usage: %s FILE [--max-divergence MS] | --capture FILE [--reps N]\n", argv[0]);
+    return 2;
+  }
+  srand(1);
+  return record ? capture(path, reps) : replay(path, maxDivergence);
+}
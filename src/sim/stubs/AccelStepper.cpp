@@ -0,0 +1,221 @@
+/*
+  AccelStepper.cpp - Host-side stand-in for the AccelStepper library (Adafruit fork).
+*/
+
+#include "AccelStepper.h"
+
+AccelStepper::AccelStepper(uint8_t interface, uint8_t pin1, uint8_t pin2, uint8_t pin3, uint8_t pin4, bool enable) {
+  (void)interface;
+  (void)pin1;
+  (void)pin2;
+  (void)pin3;
+  (void)pin4;
+  (void)enable;
+  init();
+  _forward = NULL;
+  _backward = NULL;
+}
+
+AccelStepper::AccelStepper(void (*forward)(), void (*backward)()) {
+  init();
+  _forward = forward;
+  _backward = backward;
+}
+
+void AccelStepper::init() {
+  _currentPos = 0;
+  _targetPos = 0;
+  _speed = 0.0;
+  _maxSpeed = 1.0;
+  _acceleration = 0.0;
+  _stepInterval = 0;
+  _lastStepTime = 0;
+  _n = 0;
+  _c0 = 0.0;
+  _cn = 0.0;
+  _cmin = 1.0;
+  _direction = DIRECTION_CCW;
+  setAcceleration(1);
+}
+
+void AccelStepper::moveTo(long absolute) {
+  if (_targetPos != absolute) {
+    _targetPos = absolute;
+    computeNewSpeed();
+  }
+}
+
+void AccelStepper::move(long relative) {
+  moveTo(_currentPos + relative);
+}
+
+boolean AccelStepper::runSpeed() {
+  if (!_stepInterval) {
+    return false;
+  }
+  unsigned long time = micros();
+  if (time - _lastStepTime >= _stepInterval) {
+    if (_direction == DIRECTION_CW) {
+      _currentPos += 1;
+    } else {
+      _currentPos -= 1;
+    }
+    step(_currentPos);
+    _lastStepTime = time;
+    return true;
+  }
+  return false;
+}
+
+long AccelStepper::distanceToGo() {
+  return _targetPos - _currentPos;
+}
+
+long AccelStepper::targetPosition() {
+  return _targetPos;
+}
+
+long AccelStepper::currentPosition() {
+  return _currentPos;
+}
+
+void AccelStepper::setCurrentPosition(long position) {
+  _targetPos = _currentPos = position;
+  _n = 0;
+  _stepInterval = 0;
+  _speed = 0.0;
+}
+
+unsigned long AccelStepper::computeNewSpeed() {
+  long distanceTo = distanceToGo();
+  long stepsToStop = (long)((_speed * _speed) / (2.0 * _acceleration));
+
+  if (distanceTo == 0 && stepsToStop <= 1) {
+    _stepInterval = 0;
+    _speed = 0.0;
+    _n = 0;
+    return _stepInterval;
+  }
+
+  if (distanceTo > 0) {
+    if (_n > 0) {
+      if ((stepsToStop >= distanceTo) || _direction == DIRECTION_CCW) {
+        _n = -stepsToStop;
+      }
+    } else if (_n < 0) {
+      if ((stepsToStop < distanceTo) && _direction == DIRECTION_CW) {
+        _n = -_n;
+      }
+    }
+  } else if (distanceTo < 0) {
+    if (_n > 0) {
+      if ((stepsToStop >= -distanceTo) || _direction == DIRECTION_CW) {
+        _n = -stepsToStop;
+      }
+    } else if (_n < 0) {
+      if ((stepsToStop < -distanceTo) && _direction == DIRECTION_CCW) {
+        _n = -_n;
+      }
+    }
+  }
+
+  if (_n == 0) {
+    _cn = _c0;
+    _direction = (distanceTo > 0) ? DIRECTION_CW : DIRECTION_CCW;
+  } else {
+    _cn = _cn - ((2.0 * _cn) / ((4.0 * _n) + 1));
+    _cn = max(_cn, _cmin);
+  }
+  _n++;
+  _stepInterval = _cn;
+  _speed = 1000000.0 / _cn;
+  if (_direction == DIRECTION_CCW) {
+    _speed = -_speed;
+  }
+  return _stepInterval;
+}
+
+boolean AccelStepper::run() {
+  if (runSpeed()) {
+    computeNewSpeed();
+  }
+  return _speed != 0.0 || distanceToGo() != 0;
+}
+
+void AccelStepper::setMaxSpeed(float speed) {
+  if (_maxSpeed != speed) {
+    _maxSpeed = speed;
+    _cmin = 1000000.0 / speed;
+    if (_n > 0) {
+      _n = (long)((_speed * _speed) / (2.0 * _acceleration));
+      computeNewSpeed();
+    }
+  }
+}
+
+void AccelStepper::setAcceleration(float acceleration) {
+  if (acceleration == 0.0) {
+    return;
+  }
+  if (_acceleration != acceleration) {
+    _n = _n * (_acceleration / acceleration);
+    _c0 = 0.676 * sqrt(2.0 / acceleration) * 1000000.0;
+    _acceleration = acceleration;
+    computeNewSpeed();
+  }
+}
+
+void AccelStepper::setSpeed(float speed) {
+  if (speed == _speed) {
+    return;
+  }
+  speed = constrain(speed, -_maxSpeed, _maxSpeed);
+  if (speed == 0.0) {
+    _stepInterval = 0;
+  } else {
+    _stepInterval = fabs(1000000.0 / speed);
+    _direction = (speed > 0.0) ? DIRECTION_CW : DIRECTION_CCW;
+  }
+  _speed = speed;
+}
+
+float AccelStepper::speed() {
+  return _speed;
+}
+
+void AccelStepper::step(long step) {
+  (void)step;
+  if (_speed > 0) {
+    if (_forward) _forward();
+  } else {
+    if (_backward) _backward();
+  }
+}
+
+void AccelStepper::runToPosition() {
+  while (run()) {
+  }
+}
+
+boolean AccelStepper::runSpeedToPosition() {
+  if (_targetPos == _currentPos) {
+    return false;
+  }
+  if (_targetPos > _currentPos) {
+    _direction = DIRECTION_CW;
+  } else {
+    _direction = DIRECTION_CCW;
+  }
+  return runSpeed();
+}
+
+void AccelStepper::stop() {
+  if (_speed != 0.0) {
+    long stepsToStop = (long)((_speed * _speed) / (2.0 * _acceleration)) + 1;
+    if (_speed > 0) {
+      move(stepsToStop);
+    } else {
+      move(-stepsToStop);
+    }
+  }
+}
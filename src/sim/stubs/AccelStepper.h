@@ -0,0 +1,70 @@
+/*
+  AccelStepper.h - Host-side stand-in for the AccelStepper library (Adafruit fork), ported
+  from the original so that step scheduling against micros() behaves the same.
+*/
+
+#ifndef AccelStepper_h
+#define AccelStepper_h
+
+#include "Arduino.h"
+
+class AccelStepper {
+  public:
+    typedef enum {
+      FUNCTION = 0,
+      DRIVER = 1,
+      FULL2WIRE = 2,
+      FULL3WIRE = 3,
+      FULL4WIRE = 4,
+      HALF3WIRE = 6,
+      HALF4WIRE = 8
+    } MotorInterfaceType;
+
+    AccelStepper(uint8_t interface = AccelStepper::FULL4WIRE, uint8_t pin1 = 2, uint8_t pin2 = 3, uint8_t pin3 = 4, uint8_t pin4 = 5, bool enable = true);
+    AccelStepper(void (*forward)(), void (*backward)());
+
+    void moveTo(long absolute);
+    void move(long relative);
+    boolean run();
+    boolean runSpeed();
+    void setMaxSpeed(float speed);
+    void setAcceleration(float acceleration);
+    void setSpeed(float speed);
+    float speed();
+    long distanceToGo();
+    long targetPosition();
+    long currentPosition();
+    void setCurrentPosition(long position);
+    void runToPosition();
+    boolean runSpeedToPosition();
+    void stop();
+
+  protected:
+    typedef enum {
+      DIRECTION_CCW = 0,
+      DIRECTION_CW = 1
+    } Direction;
+
+    unsigned long computeNewSpeed();
+    void step(long step);
+
+  private:
+    void init();
+
+    boolean _direction;
+    long _currentPos;
+    long _targetPos;
+    float _speed;
+    float _maxSpeed;
+    float _acceleration;
+    unsigned long _stepInterval;
+    unsigned long _lastStepTime;
+    long _n;
+    float _c0;
+    float _cn;
+    float _cmin;
+    void (*_forward)();
+    void (*_backward)();
+};
+
+#endif
@@ -0,0 +1,175 @@
+/*
+  Adafruit_MotorShield.cpp - Host-side stand-in for the Adafruit Motor Shield v2 library.
+*/
+
+#include "Adafruit_MotorShield.h"
+
+static const uint8_t microstepcurve[] = {0, 25, 50, 74, 98, 120, 141, 162, 180, 197, 212, 225, 236, 244, 250, 253, 255};
+
+Adafruit_MotorShield::Adafruit_MotorShield(uint8_t addr) : _addr(addr), _freq(1600), _pwm(addr) {}
+
+void Adafruit_MotorShield::begin(uint16_t freq) {
+  _pwm.begin();
+  _freq = freq;
+  _pwm.setPWMFreq(_freq);
+  for (uint8_t i = 0; i < 16; i++) {
+    _pwm.setPWM(i, 0, 0);
+  }
+}
+
+void Adafruit_MotorShield::setPWM(uint8_t pin, uint16_t value) {
+  if (value > 4095) {
+    _pwm.setPWM(pin, 4096, 0);
+  } else {
+    _pwm.setPWM(pin, 0, value);
+  }
+}
+
+void Adafruit_MotorShield::setPin(uint8_t pin, boolean value) {
+  if (value == LOW) {
+    _pwm.setPWM(pin, 0, 0);
+  } else {
+    _pwm.setPWM(pin, 4096, 0);
+  }
+}
+
+Adafruit_StepperMotor *Adafruit_MotorShield::getStepper(uint16_t steps, uint8_t num) {
+  if (num > 2) {
+    return NULL;
+  }
+  num--;
+  if (steppers[num].steppernum == 0) {
+    steppers[num].steppernum = num;
+    steppers[num].revsteps = steps;
+    steppers[num].MC = this;
+    uint8_t pwma, pwmb, ain1, ain2, bin1, bin2;
+    if (num == 0) {
+      pwma = 8; ain2 = 9; ain1 = 10;
+      pwmb = 13; bin2 = 12; bin1 = 11;
+    } else {
+      pwma = 2; ain2 = 3; ain1 = 4;
+      pwmb = 7; bin2 = 6; bin1 = 5;
+    }
+    steppers[num].PWMApin = pwma;
+    steppers[num].PWMBpin = pwmb;
+    steppers[num].AIN1pin = ain1;
+    steppers[num].AIN2pin = ain2;
+    steppers[num].BIN1pin = bin1;
+    steppers[num].BIN2pin = bin2;
+  }
+  return &steppers[num];
+}
+
+Adafruit_StepperMotor::Adafruit_StepperMotor(void) {
+  usperstep = 0;
+  revsteps = steppernum = currentstep = 0;
+  PWMApin = AIN1pin = AIN2pin = PWMBpin = BIN1pin = BIN2pin = 0;
+  MC = NULL;
+}
+
+void Adafruit_StepperMotor::setSpeed(uint16_t rpm) {
+  usperstep = 60000000 / ((uint32_t)revsteps * (uint32_t)rpm);
+}
+
+void Adafruit_StepperMotor::release(void) {
+  MC->setPin(AIN1pin, LOW);
+  MC->setPin(AIN2pin, LOW);
+  MC->setPin(BIN1pin, LOW);
+  MC->setPin(BIN2pin, LOW);
+  MC->setPWM(PWMApin, 0);
+  MC->setPWM(PWMBpin, 0);
+}
+
+void Adafruit_StepperMotor::step(uint16_t steps, uint8_t dir, uint8_t style) {
+  uint32_t uspers = usperstep;
+  if (style == INTERLEAVE) {
+    uspers /= 2;
+  } else if (style == MICROSTEP) {
+    uspers /= MICROSTEPS;
+    steps *= MICROSTEPS;
+  }
+  while (steps--) {
+    onestep(dir, style);
+    delayMicroseconds(uspers);
+  }
+}
+
+uint8_t Adafruit_StepperMotor::onestep(uint8_t dir, uint8_t style) {
+  uint8_t ocrb, ocra;
+  ocra = ocrb = 255;
+
+  if (style == SINGLE) {
+    if ((currentstep / (MICROSTEPS / 2)) % 2) {
+      if (dir == FORWARD) currentstep += MICROSTEPS / 2;
+      else currentstep -= MICROSTEPS / 2;
+    } else {
+      if (dir == FORWARD) currentstep += MICROSTEPS;
+      else currentstep -= MICROSTEPS;
+    }
+  } else if (style == DOUBLE) {
+    if (!(currentstep / (MICROSTEPS / 2) % 2)) {
+      if (dir == FORWARD) currentstep += MICROSTEPS / 2;
+      else currentstep -= MICROSTEPS / 2;
+    } else {
+      if (dir == FORWARD) currentstep += MICROSTEPS;
+      else currentstep -= MICROSTEPS;
+    }
+  } else if (style == INTERLEAVE) {
+    if (dir == FORWARD) currentstep += MICROSTEPS / 2;
+    else currentstep -= MICROSTEPS / 2;
+  }
+
+  if (style == MICROSTEP) {
+    if (dir == FORWARD) currentstep++;
+    else currentstep--;
+    currentstep += MICROSTEPS * 4;
+    currentstep %= MICROSTEPS * 4;
+
+    ocra = ocrb = 0;
+    if (currentstep < MICROSTEPS) {
+      ocra = microstepcurve[MICROSTEPS - currentstep];
+      ocrb = microstepcurve[currentstep];
+    } else if (currentstep < MICROSTEPS * 2) {
+      ocra = microstepcurve[currentstep - MICROSTEPS];
+      ocrb = microstepcurve[MICROSTEPS * 2 - currentstep];
+    } else if (currentstep < MICROSTEPS * 3) {
+      ocra = microstepcurve[MICROSTEPS * 3 - currentstep];
+      ocrb = microstepcurve[currentstep - MICROSTEPS * 2];
+    } else {
+      ocra = microstepcurve[currentstep - MICROSTEPS * 3];
+      ocrb = microstepcurve[MICROSTEPS * 4 - currentstep];
+    }
+  }
+
+  currentstep += MICROSTEPS * 4;
+  currentstep %= MICROSTEPS * 4;
+
+  MC->setPWM(PWMApin, ocra * 16);
+  MC->setPWM(PWMBpin, ocrb * 16);
+
+  uint8_t latch_state = 0;
+  if (style == MICROSTEP) {
+    if (currentstep < MICROSTEPS) latch_state |= 0x03;
+    else if (currentstep < MICROSTEPS * 2) latch_state |= 0x06;
+    else if (currentstep < MICROSTEPS * 3) latch_state |= 0x0C;
+    else latch_state |= 0x09;
+  } else {
+    switch (currentstep / (MICROSTEPS / 2)) {
+      case 0: latch_state |= 0x1; break;
+      case 1: latch_state |= 0x3; break;
+      case 2: latch_state |= 0x2; break;
+      case 3: latch_state |= 0x6; break;
+      case 4: latch_state |= 0x4; break;
+      case 5: latch_state |= 0xC; break;
+      case 6: latch_state |= 0x8; break;
+      case 7: latch_state |= 0x9; break;
+    }
+  }
+
+  MC->setPin(AIN2pin, (latch_state & 0x1) ? HIGH : LOW);
+  MC->setPin(BIN1pin, (latch_state & 0x2) ? HIGH : LOW);
+  MC->setPin(AIN1pin, (latch_state & 0x4) ? HIGH : LOW);
+  MC->setPin(BIN2pin, (latch_state & 0x8) ? HIGH : LOW);
+
+  return currentstep;
+}
@@ -0,0 +1,63 @@
+/*
+  Adafruit_MotorShield.h - Host-side stand-in for the Adafruit Motor Shield v2 library.
+
+  Ported from the original so that every onestep() issues the same PCA9685 I2C traffic;
+  the simulation reads the motor's steps from that traffic (see Wire.cpp).
+*/
+
+#ifndef _Adafruit_MotorShield_h_
+#define _Adafruit_MotorShield_h_
+
+#include <inttypes.h>
+#include <Wire.h>
+#include "utility/Adafruit_MS_PWMServoDriver.h"
+
+#define MICROSTEPS 16
+
+#define FORWARD 1
+#define BACKWARD 2
+#define BRAKE 3
+#define RELEASE 4
+
+#define SINGLE 1
+#define DOUBLE 2
+#define INTERLEAVE 3
+#define MICROSTEP 4
+
+class Adafruit_MotorShield;
+
+class Adafruit_StepperMotor {
+  public:
+    Adafruit_StepperMotor(void);
+    void setSpeed(uint16_t);
+    void step(uint16_t steps, uint8_t dir, uint8_t style = SINGLE);
+    uint8_t onestep(uint8_t dir, uint8_t style);
+    void release(void);
+    uint32_t usperstep;
+
+  private:
+    friend class Adafruit_MotorShield;
+    uint8_t PWMApin, AIN1pin, AIN2pin;
+    uint8_t PWMBpin, BIN1pin, BIN2pin;
+    uint16_t revsteps;
+    uint8_t currentstep;
+    uint8_t steppernum;
+    Adafruit_MotorShield *MC;
+};
+
+class Adafruit_MotorShield {
+  public:
+    Adafruit_MotorShield(uint8_t addr = 0x60);
+    void begin(uint16_t freq = 1600);
+    void setPWM(uint8_t pin, uint16_t val);
+    void setPin(uint8_t pin, boolean val);
+    Adafruit_StepperMotor *getStepper(uint16_t steps, uint8_t n);
+
+  private:
+    uint8_t _addr;
+    uint16_t _freq;
+    Adafruit_StepperMotor steppers[2];
+    Adafruit_MS_PWMServoDriver _pwm;
+};
+
+#endif
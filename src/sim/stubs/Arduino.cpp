@@ -0,0 +1,245 @@
+/*
+  Arduino.cpp - Host-side stand-in for the Arduino AVR core, running on the simulation clock.
+*/
+
+#include "Arduino.h"
+#include "Sim.h"
+
+#include <stdio.h>
+
+uint8_t TWBR = 0;
+
+/* ---------- digital I/O ---------- */
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+  sim::spend(sim::costs.digitalWriteNs);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  sim::spend(sim::costs.digitalWriteNs);
+  sim::setPin(pin, val ? HIGH : LOW);
+}
+
+int digitalRead(uint8_t pin) {
+  sim::spend(sim::costs.digitalReadNs);
+  return sim::pinLevel(pin) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  sim::spend(112000);   //one ADC conversion
+  return sim::pinLevel(pin) ? 1023 : 0;
+}
+
+/* ---------- timing ---------- */
+
+unsigned long millis(void) {
+  sim::spend(sim::costs.timeReadNs);
+  return (unsigned long)(sim::now() / 1000000ULL);
+}
+
+unsigned long micros(void) {
+  sim::spend(sim::costs.timeReadNs);
+  return (unsigned long)((sim::now() / 4000ULL) * 4ULL);   //4 us resolution as on the AVR
+}
+
+void delay(unsigned long ms) {
+  sim::waitUntil(sim::now() + ms * 1000000ULL);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::spend(us * 1000ULL);
+}
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration) {
+  (void)frequency;
+  (void)duration;
+  (void)pin;
+  sim::spend(sim::costs.toneNs);
+}
+
+void noTone(uint8_t pin) {
+  (void)pin;
+  sim::spend(sim::costs.toneNs);
+}
+
+/* ---------- external interrupts (INT0 on pin 2, INT1 on pin 3) ---------- */
+
+#define INT0_VECTOR 1
+
+namespace {
+  void (*g_interruptFuncs[2])(void);
+
+  sim::Irq &externalInterrupt(uint8_t interruptNum) {
+    static sim::Irq int0(INT0_VECTOR, []() { if (g_interruptFuncs[0] != NULL) g_interruptFuncs[0](); });
+    static sim::Irq int1(INT0_VECTOR + 1, []() { if (g_interruptFuncs[1] != NULL) g_interruptFuncs[1](); });
+    return interruptNum == 0 ? int0 : int1;
+  }
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode) {
+  if (interruptNum > 1) {
+    return;
+  }
+  g_interruptFuncs[interruptNum] = userFunc;
+  sim::Irq &irq = externalInterrupt(interruptNum);
+  sim::watchPin(2 + interruptNum, [&irq, mode](int level) {
+    if (mode == CHANGE || (mode == RISING && level == HIGH) || (mode == FALLING && level == LOW)) {
+      irq.raise();
+    }
+  });
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+  if (interruptNum > 1) {
+    return;
+  }
+  g_interruptFuncs[interruptNum] = NULL;
+  sim::watchPin(2 + interruptNum, NULL);
+}
+
+/* ---------- String ---------- */
+
+static std::string numberToString(unsigned long n, unsigned char base, bool negative) {
+  std::string out;
+  if (base < 2) {
+    base = 10;
+  }
+  do {
+    unsigned long digit = n % base;
+    out.insert(out.begin(), (char)(digit < 10 ? '0' + digit : 'A' + digit - 10));
+    n /= base;
+  } while (n > 0);
+  if (negative) {
+    out.insert(out.begin(), '-');
+  }
+  return out;
+}
+
+String::String(const char *cstr) : _s(cstr != NULL ? cstr : "") {}
+String::String(const std::string &s) : _s(s) {}
+String::String(char c) : _s(1, c) {}
+String::String(int value, unsigned char base) : _s(numberToString(value < 0 ? -(long)value : value, base, value < 0)) {}
+String::String(unsigned int value, unsigned char base) : _s(numberToString(value, base, false)) {}
+String::String(long value, unsigned char base) : _s(numberToString(value < 0 ? -value : value, base, value < 0)) {}
+String::String(unsigned long value, unsigned char base) : _s(numberToString(value, base, false)) {}
+
+int String::indexOf(char c, unsigned int from) const {
+  sim::spend(sim::costs.stringOpNs);
+  size_t pos = _s.find(c, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String &s, unsigned int from) const {
+  sim::spend(sim::costs.stringOpNs + _s.length() * 250);
+  size_t pos = _s.find(s._s, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from) const {
+  return from >= _s.length() ? String("") : String(_s.substr(from));
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    std::swap(from, to);
+  }
+  if (from >= _s.length()) {
+    return String("");
+  }
+  return String(_s.substr(from, to - from));
+}
+
+void String::trim() {
+  size_t begin = _s.find_first_not_of(" \t\r\n");
+  size_t end = _s.find_last_not_of(" \t\r\n");
+  _s = begin == std::string::npos ? std::string() : _s.substr(begin, end - begin + 1);
+}
+
+String operator+(const String &lhs, const String &rhs) {
+  String out(lhs);
+  out += rhs;
+  return out;
+}
+
+/* ---------- Print ---------- */
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::print(const __FlashStringHelper *s) { return write(reinterpret_cast<const char *>(s)); }
+size_t Print::print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+size_t Print::print(const char s[]) { return write(s); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char n, int base) { return print((unsigned long)n, base); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+
+size_t Print::print(long n, int base) {
+  if (base == DEC && n < 0) {
+    return print('-') + printNumber(-n, base);
+  }
+  return printNumber(n, base);
+}
+
+size_t Print::print(unsigned long n, int base) { return printNumber(n, base); }
+size_t Print::print(double n, int digits) { return printFloat(n, digits); }
+
+size_t Print::println(void) { return write("\r\n"); }
+size_t Print::println(const __FlashStringHelper *s) { return print(s) + println(); }
+size_t Print::println(const String &s) { return print(s) + println(); }
+size_t Print::println(const char s[]) { return print(s) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char n, int base) { return print(n, base) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+  return write(numberToString(n, base, false).c_str());
+}
+
+size_t Print::printFloat(double number, uint8_t digits) {
+  if (isnan(number)) return print("nan");
+  if (isinf(number)) return print("inf");
+  if (number > 4294967040.0 || number < -4294967040.0) return print("ovf");
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, number);
+  return write(buffer);
+}
+
+/* ---------- Serial (USB) ---------- */
+
+HardwareSerial Serial;
+
+
+void HardwareSerial::begin(unsigned long baud) {
+  _baud = baud;
+}
+
+/* write() only blocks once the 64 byte TX ring buffer is full */
+size_t HardwareSerial::write(uint8_t c) {
+  const uint64_t byteNs = 10ULL * 1000000000ULL / (_baud != 0 ? _baud : 9600);
+  const uint64_t bufferNs = 63ULL * byteNs;
+  sim::spend(sim::costs.serialWriteNs);
+  if (_drainedAt > sim::now() + bufferNs) {
+    sim::waitUntil(_drainedAt - bufferNs);
+  }
+  _drainedAt = (_drainedAt > sim::now() ? _drainedAt : sim::now()) + byteNs;
+  if (sim::echo()) {
+    fputc(c, stdout);
+  }
+  return 1;
+}
+
+void HardwareSerial::flush() {
+  sim::waitUntil(_drainedAt);
+}
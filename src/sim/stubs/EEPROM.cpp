@@ -0,0 +1,89 @@
+/*
+  EEPROM.cpp - Host-side stand-in for the AVR EEPROM library.
+*/
+
+#include "EEPROM.h"
+#include "Sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define EEPROM_READ_NS 500            //EEAR, EERE, 4 cycles halted, call overhead
+#define EEPROM_WRITE_NS 500           //EEMPE, EEPE, call overhead
+#define EEPROM_PROGRAM_NS 3400000ULL  //erase + write, EEPE set meanwhile
+
+EEPROMClass EEPROM;
+
+namespace {
+  uint8_t g_eeprom[EEPROM_SIZE];
+  bool g_erased = false;
+  uint32_t g_writes = 0;
+  uint64_t g_ready = 0;
+
+  void waitReady() {
+    if (sim::now() < g_ready) {
+      sim::spend(g_ready - sim::now());   //busy loop on EEPE, interrupts still serviced
+    }
+  }
+
+  uint8_t *cells() {
+    if (!g_erased) {
+      memset(g_eeprom, 0xFF, sizeof(g_eeprom));
+      g_erased = true;
+    }
+    return g_eeprom;
+  }
+}
+
+uint8_t EEPROMClass::read(int address) {
+  waitReady();
+  sim::spend(EEPROM_READ_NS);
+  return address >= 0 && address < EEPROM_SIZE ? cells()[address] : 0xFF;
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  if (address < 0 || address >= EEPROM_SIZE) {
+    return;
+  }
+  waitReady();
+  sim::spend(EEPROM_WRITE_NS);
+  g_ready = sim::now() + EEPROM_PROGRAM_NS;
+  cells()[address] = value;
+  g_writes++;
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+  if (read(address) != value) {
+    write(address, value);
+  }
+}
+
+namespace sim {
+  bool loadEeprom(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+      return false;
+    }
+    size_t length = fread(cells(), 1, EEPROM_SIZE, file);
+    fclose(file);
+    return length == EEPROM_SIZE;
+  }
+
+  bool saveEeprom(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+      return false;
+    }
+    size_t length = fwrite(cells(), 1, EEPROM_SIZE, file);
+    fclose(file);
+    return length == EEPROM_SIZE;
+  }
+
+  bool eepromReady() {
+    return sim::now() >= g_ready;
+  }
+
+  uint32_t eepromWrites() {
+    return g_writes;
+  }
+}
@@ -0,0 +1,53 @@
+/*
+  EEPROM.h - Host-side stand-in for the AVR EEPROM library.
+
+  1 KB of EEPROM (ATmega328P), erased to 0xFF. A byte written is programmed for 3.4 ms in the
+  background; reads and writes in that time wait for it (EEPE), as avr-libc does. Every byte written
+  counts towards sim::eepromWrites() (wear).
+  The contents can be kept in a file between runs, see sim::loadEeprom().
+*/
+
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include "Arduino.h"
+#include <avr/eeprom.h>
+
+#define EEPROM_SIZE 1024
+
+class EEPROMClass {
+  public:
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    void update(int address, uint8_t value);
+    uint16_t length() { return EEPROM_SIZE; }
+
+    template <typename T> T &get(int address, T &t) {
+      uint8_t *bytes = (uint8_t *)&t;
+      for (size_t i = 0; i < sizeof(T); i++) {
+        bytes[i] = read(address + i);
+      }
+      return t;
+    }
+
+    /* as the AVR library: writes the bytes that differ only */
+    template <typename T> const T &put(int address, const T &t) {
+      const uint8_t *bytes = (const uint8_t *)&t;
+      for (size_t i = 0; i < sizeof(T); i++) {
+        update(address + i, bytes[i]);
+      }
+      return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+namespace sim {
+  /* false if the file does not exist (the EEPROM stays erased) */
+  bool loadEeprom(const char *path);
+  bool saveEeprom(const char *path);
+  /* bytes written since power-on */
+  uint32_t eepromWrites();
+}
+
+#endif
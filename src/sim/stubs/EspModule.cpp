@@ -0,0 +1,441 @@
+/*
+  EspModule.cpp - Simulated ESP8266 WiFi module (AT firmware 0.18) on the far end of the serial line.
+*/
+
+#include "EspModule.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace sim {
+
+  EspModule &esp() {
+    static EspModule module;
+    return module;
+  }
+
+  UartDevice *uartDevice(int rxPin, int txPin) {
+    EspModule &module = esp();
+    /* the module's TX drives the device's RX and vice versa */
+    if (module.rxPin == txPin && module.txPin == rxPin) {
+      return &module;
+    }
+    return NULL;
+  }
+
+  EspModule::EspModule() : rxPin(8), txPin(7), baud(9600), _port(NULL), _txFree(0), _sendMode(false), _sendMux(0),
+    _sendRemaining(0), _mux(0), _server(false), _mode(3), _echo(true), _cipmode(false), _passthrough(false), _single(0), _passthroughStart(0), _flushPending(false),
+    _random(2463534242UL), _bytesIn(0), _bytesOut(0) {
+    timing.atResponseNs = 1000000ULL;
+    timing.sendPromptNs = 2000000ULL;
+    timing.sendOkNs = 8000000ULL;
+    timing.joinNs = 3000000000ULL;
+    timing.resetNs = 600000000ULL;
+    timing.connectNs = 5000000ULL;
+    timing.passthroughNs = 20000000ULL;
+    wifi.loss = 0;
+    wifi.jitterNs = 0;
+    wifi.retransmitNs = 200000000ULL;
+    for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+      _connected[i] = false;
+      _listenPort[i] = -1;
+      _udpPort[i] = -1;
+      _arrival[0][i] = _arrival[1][i] = 0;
+    }
+  }
+
+  void EspModule::connect(UartPort *port) {
+    _port = port;
+  }
+
+  /* queue a message; it goes on the wire once the line is free */
+  void EspModule::emit(const std::string &s, uint64_t delayNs) {
+    schedule(now() + delayNs, [this, s]() { commit(s); });
+  }
+
+  void EspModule::commit(const std::string &s) {
+    if (_port == NULL) {
+      return;
+    }
+    const uint64_t byteNs = uartByteNs(baud);
+    bool garbled = _port->baud() != baud;
+    uint64_t start = _txFree > now() ? _txFree : now();
+    for (size_t i = 0; i < s.size(); i++) {
+      _port->lineIn((uint8_t)s[i], start + i * byteNs, garbled);
+    }
+    _txFree = start + s.size() * byteNs;
+    _bytesOut += s.size();
+  }
+
+  void EspModule::ok(const std::string &info) {
+    emit(info + "\r\nOK\r\n", timing.atResponseNs);
+  }
+
+  void EspModule::error() {
+    emit("\r\nERROR\r\n", timing.atResponseNs);
+  }
+
+  void EspModule::receive(uint8_t b, long deviceBaud) {
+    _bytesIn++;
+    if (deviceBaud != baud) {
+      return;   //framing errors, nothing the AT parser can use
+    }
+
+    if (_passthrough) {
+      passthroughIn(b);
+      return;
+    }
+
+    if (_sendMode) {
+      _sendData.push_back(b);
+      if (--_sendRemaining == 0) {
+        _sendMode = false;
+        char recv[32];
+        snprintf(recv, sizeof(recv), "\r\nRecv %u bytes\r\n", (unsigned)_sendData.size());
+        emit(recv, timing.atResponseNs);
+        bool lost;
+        uint64_t air = airTime(_sendMux, false, lost);
+        if (!lost) {
+          deliver(_sendMux, _sendData, timing.sendOkNs + air);
+        }
+        emit("\r\nSEND OK\r\n", timing.sendOkNs + (_udpPort[_sendMux] < 0 ? air : 0));
+      }
+      return;
+    }
+
+    if (b == '\n') {
+      if (_echo) {
+        emit("\r\n");
+      }
+      std::string line = _line;
+      _line.clear();
+      if (!line.empty() && line[line.size() - 1] == '\r') {
+        line.erase(line.size() - 1);
+      }
+      handleLine(line);
+    } else {
+      _line += (char)b;
+      if (_echo) {
+        emit(std::string(1, (char)b));
+      }
+    }
+  }
+
+  void EspModule::deliver(uint8_t mux, const std::vector<uint8_t> &data, uint64_t delayNs) {
+    Packet p;
+    p.time = now() + delayNs;
+    p.mux = mux;
+    p.datagram = _udpPort[mux] >= 0;
+    p.data = data;
+    schedule(p.time, [this, p]() {
+      _sent.push_back(p);
+      if (onSend) {
+        onSend(p);
+      }
+    });
+  }
+
+  /* collected and sent on the next tick of the passthrough interval; "+++" on its own ends passthrough */
+  void EspModule::passthroughIn(uint8_t b) {
+    _passthroughData.push_back(b);
+    if (_flushPending) {
+      return;
+    }
+    _flushPending = true;
+    uint64_t ticks = (now() - _passthroughStart) / timing.passthroughNs + 1;
+    schedule(_passthroughStart + ticks * timing.passthroughNs, [this]() {
+      _flushPending = false;
+      std::vector<uint8_t> data;
+      data.swap(_passthroughData);
+      if (data.size() == 3 && data[0] == '+' && data[1] == '+' && data[2] == '+') {
+        _passthrough = false;
+      } else if (_connected[_single]) {
+        deliver(_single, data, timing.sendOkNs);
+      }
+    });
+  }
+
+  /* extra time of a transmission on mux over the air. A lost datagram is lost; a TCP segment is sent until it gets
+     through, and not before the one ahead of it on its connection. */
+  uint64_t EspModule::airTime(uint8_t mux, bool toModule, bool &lost) {
+    lost = false;
+    uint64_t air = 0;
+    if (wifi.jitterNs > 0) {
+      air += (uint64_t)(uniform() * wifi.jitterNs);
+    }
+    bool datagram = _udpPort[mux] >= 0;
+    while (wifi.loss > 0 && uniform() < wifi.loss) {
+      if (datagram) {
+        lost = true;
+        return air;
+      }
+      air += wifi.retransmitNs;
+    }
+    if (!datagram) {
+      uint64_t &last = _arrival[toModule ? 0 : 1][mux];
+      if (now() + air < last) {
+        air = last - now();
+      }
+      last = now() + air;
+    }
+    return air;
+  }
+
+  /* in [0, 1) */
+  double EspModule::uniform() {
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random / 4294967296.0;
+  }
+
+  bool EspModule::anyConnected() const {
+    for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+      if (_connected[i]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void EspModule::handleLine(const std::string &line) {
+    if (line.empty()) {
+      return;
+    }
+    if (line == "AT") {
+      ok();
+    } else if (line == "ATE0" || line == "ATE1") {
+      ok();
+      _echo = line[3] == '1';
+    } else if (line.compare(0, 12, "AT+UART_CUR=") == 0) {
+      long rate = atol(line.c_str() + 12);
+      ok();
+      /* the OK still goes out at the old rate, the module switches once it is on the wire */
+      schedule(now() + timing.atResponseNs, [this, rate]() {
+        schedule(_txFree > now() ? _txFree : now(), [this, rate]() { baud = rate; });
+      });
+    } else if (line == "AT+RST") {
+      ok();
+      for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+        _connected[i] = false;
+        _udpPort[i] = -1;
+      }
+      _mux = 0;
+      _server = false;
+      _echo = true;
+      _cipmode = false;
+      _passthrough = false;
+      emit("\r\n ets Jan  8 2013,rst cause:2, boot mode:(3,6)\r\n\r\nready\r\n", timing.resetNs);
+    } else if (line == "AT+GMR") {
+      ok("AT version:0.18.0.0(Jun 15 2016 10:37:58)\r\nSDK version:1.5.4(baaeaebb)\r\ncompile time:Jun 15 2016 11:29:39\r\n");
+    } else if (line == "AT+CWMODE?") {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "+CWMODE:%d\r\n", _mode);
+      ok(buf);
+    } else if (line.compare(0, 10, "AT+CWMODE=") == 0) {
+      _mode = atoi(line.c_str() + 10);
+      ok();
+    } else if (line.compare(0, 9, "AT+CWJAP=") == 0) {
+      emit("WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n", timing.joinNs);
+    } else if (line == "AT+CIFSR") {
+      ok("+CIFSR:APIP,\"192.168.4.1\"\r\n+CIFSR:STAIP,\"192.168.1.50\"\r\n");
+    } else if (line.compare(0, 10, "AT+CIPMUX=") == 0) {
+      int mux = atoi(line.c_str() + 10);
+      if (mux == 0 && (_server || anyConnected())) {
+        emit("link is builded\r\n\r\nERROR\r\n", timing.atResponseNs);
+      } else {
+        _mux = mux;
+        ok();
+      }
+    } else if (line.compare(0, 11, "AT+CIPMODE=") == 0) {
+      bool mode = line[11] == '1';
+      if (mode && _mux) {
+        error();
+      } else {
+        _cipmode = mode;
+        ok();
+      }
+    } else if (line.compare(0, 12, "AT+CIPSTART=") == 0 && _mux) {
+      int id = -1, mode = 0;
+      unsigned remotePort = 0, localPort = 0;
+      char ip[32] = "";
+      int fields = sscanf(line.c_str() + 12, "%d,\"UDP\",\"%31[^\"]\",%u,%u,%d", &id, ip, &remotePort, &localPort, &mode);
+      if (fields < 3 || id < 0 || id >= MAX_CONNECTIONS || _connected[id]) {
+        error();
+      } else {
+        _udpPort[id] = fields >= 4 ? localPort : remotePort;
+        _connected[id] = true;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%d,CONNECT\r\n\r\nOK\r\n", id);
+        emit(buf, timing.atResponseNs);
+      }
+    } else if (line.compare(0, 12, "AT+CIPSTART=") == 0) {
+      char ip[32] = "";
+      unsigned port = 0;
+      sscanf(line.c_str() + 12, "\"TCP\",\"%31[^\"]\",%u", ip, &port);
+      int client = -1;
+      for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+        char address[32];
+        snprintf(address, sizeof(address), "192.168.1.%u", 10 + i);
+        if (_listenPort[i] == (int)port && std::string(ip) == address) {
+          client = i;
+        }
+      }
+      if (_mux || anyConnected() || client < 0) {
+        emit("ERROR\r\nCLOSED\r\n", timing.connectNs);
+      } else {
+        _single = client;
+        _connected[client] = true;
+        emit("CONNECT\r\n\r\nOK\r\n", timing.connectNs);
+      }
+    } else if (line == "AT+CIPSEND") {
+      if (!_cipmode || _mux || !_connected[_single]) {
+        error();
+      } else {
+        emit("\r\nOK\r\n\r\n>", timing.sendPromptNs);
+        _passthrough = true;
+        _passthroughStart = now();
+      }
+    } else if (line == "AT+CIPCLOSE") {
+      if (_mux || !_connected[_single]) {
+        error();
+      } else {
+        _connected[_single] = false;
+        ok("CLOSED\r\n");
+      }
+    } else if (line.compare(0, 13, "AT+CIPSERVER=") == 0) {
+      _server = line[13] == '1';
+      if (_server && !_mux) {
+        error();
+      } else {
+        ok();
+      }
+    } else if (line.compare(0, 10, "AT+CIPSTO=") == 0) {
+      ok();
+    } else if (line == "AT+CIPSTATUS") {
+      std::string status = "STATUS:3\r\n";
+      for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+        if (_connected[i]) {
+          char buf[64];
+          if (_udpPort[i] >= 0) {
+            snprintf(buf, sizeof(buf), "+CIPSTATUS:%u,\"UDP\",\"0.0.0.0\",%d,%d,1\r\n", i, _udpPort[i], _udpPort[i]);
+          } else {
+            snprintf(buf, sizeof(buf), "+CIPSTATUS:%u,\"TCP\",\"192.168.1.%u\",%u,1\r\n", i, 10 + i, 50000 + i);
+          }
+          status += buf;
+        }
+      }
+      ok(status);
+    } else if (line.compare(0, 12, "AT+CIPCLOSE=") == 0) {
+      int id = atoi(line.c_str() + 12);
+      if (id == MAX_CONNECTIONS) {      //all of them
+        std::string closed;
+        for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+          if (_connected[i]) {
+            _connected[i] = false;
+            _udpPort[i] = -1;
+            closed += std::to_string(i) + ",CLOSED\r\n";
+          }
+        }
+        ok(closed);
+      } else if (id >= 0 && id < MAX_CONNECTIONS && _connected[id]) {
+        _connected[id] = false;
+        _udpPort[id] = -1;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%d,CLOSED\r\n", id);
+        ok(buf);
+      } else {
+        emit("link is not valid\r\n\r\nERROR\r\n", timing.atResponseNs);
+      }
+    } else if (line.compare(0, 11, "AT+CIPSEND=") == 0) {
+      int id = 0, len = 0;
+      if (_mux) {
+        sscanf(line.c_str() + 11, "%d,%d", &id, &len);
+      } else {
+        len = atoi(line.c_str() + 11);
+      }
+      if (id < 0 || id >= MAX_CONNECTIONS || !_connected[id] || len <= 0 || len > 2048) {
+        emit("link is not valid\r\n\r\nERROR\r\n", timing.atResponseNs);
+      } else {
+        _sendMode = true;
+        _sendMux = id;
+        _sendRemaining = len;
+        _sendData.clear();
+        emit("\r\nOK\r\n> ", timing.sendPromptNs);
+      }
+    } else {
+      error();
+    }
+  }
+
+  bool EspModule::clientConnect(uint8_t mux) {
+    if (!_server || mux >= MAX_CONNECTIONS || _connected[mux]) {
+      return false;
+    }
+    _connected[mux] = true;
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u,CONNECT\r\n", mux);
+    emit(buf);
+    return true;
+  }
+
+  void EspModule::clientSend(uint8_t mux, const uint8_t *data, size_t len) {
+    if (mux >= MAX_CONNECTIONS || !_connected[mux]) {
+      return;
+    }
+    if (_passthrough) {
+      if (mux == _single) {
+        emit(std::string((const char *)data, len));
+      }
+      return;
+    }
+    char header[32];
+    if (_mux) {
+      snprintf(header, sizeof(header), "\r\n+IPD,%u,%u:", mux, (unsigned)len);
+    } else {
+      snprintf(header, sizeof(header), "\r\n+IPD,%u:", (unsigned)len);
+    }
+    bool lost;
+    emit(std::string(header) + std::string((const char *)data, len), airTime(mux, true, lost));
+  }
+
+  bool EspModule::clientSendDatagram(uint16_t port, const uint8_t *data, size_t len) {
+    for (uint8_t i = 0; i < MAX_CONNECTIONS; i++) {
+      if (!_connected[i] || _udpPort[i] != port || _passthrough) {
+        continue;
+      }
+      bool lost;
+      uint64_t air = airTime(i, true, lost);
+      if (!lost) {
+        char header[32];
+        snprintf(header, sizeof(header), "\r\n+IPD,%u,%u:", i, (unsigned)len);
+        emit(std::string(header) + std::string((const char *)data, len), air);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  void EspModule::clientClose(uint8_t mux) {
+    if (mux >= MAX_CONNECTIONS || !_connected[mux]) {
+      return;
+    }
+    _connected[mux] = false;
+    if (_passthrough) {
+      return;     //the module keeps trying to connect again, silently
+    }
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u,CLOSED\r\n", mux);
+    emit(buf);
+  }
+
+  void EspModule::clientListen(uint8_t mux, uint16_t port) {
+    if (mux < MAX_CONNECTIONS) {
+      _listenPort[mux] = port;
+    }
+  }
+
+  bool EspModule::clientConnected(uint8_t mux) const {
+    return mux < MAX_CONNECTIONS && _connected[mux];
+  }
+}
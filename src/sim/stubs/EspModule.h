@@ -0,0 +1,127 @@
+/*
+  EspModule.h - Simulated ESP8266 WiFi module (AT firmware 0.18) on the far end of the serial line.
+
+  Understands the AT commands the firmware issues (see EspTransport), echoes command lines like the real
+  module and serialises every byte it emits at the configured baud rate. The client side of the
+  TCP server is driven by the benchmark through clientConnect() / clientSend() / clientClose().
+  A client may also listen (clientListen()) for the module to connect to it (AT+CIPSTART), in
+  passthrough (AT+CIPMODE=1) the bytes go through raw, sent to the client every 20 ms like the
+  real module does, until "+++".
+  A UDP link (AT+CIPSTART=<id>,"UDP",...) takes datagrams from clientSendDatagram() and hands the
+  device's to onSend as datagrams. The air between clients and module may lose transmissions (wifi):
+  a lost datagram is gone, a lost TCP segment comes after the retransmission timeout and holds up
+  everything behind it on its connection, SEND OK included, as the module reports it once acknowledged.
+*/
+
+#ifndef EspModule_h
+#define EspModule_h
+
+#include "Sim.h"
+#include "SimUart.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+  class EspModule : public UartDevice {
+    public:
+      struct Timing {
+        uint64_t atResponseNs;    //command line received -> response starts
+        uint64_t sendPromptNs;    //AT+CIPSEND -> '>' prompt
+        uint64_t sendOkNs;        //payload received -> SEND OK (WiFi transmission)
+        uint64_t joinNs;          //AT+CWJAP
+        uint64_t resetNs;         //AT+RST -> ready
+        uint64_t connectNs;       //AT+CIPSTART -> CONNECT
+        uint64_t passthroughNs;   //interval at which passthrough data is sent
+      };
+
+      struct Packet {
+        uint64_t time;
+        uint8_t mux;
+        bool datagram;
+        std::vector<uint8_t> data;
+      };
+
+      /* the radio between the clients and the module, in both directions; all 0 = perfect (the default) */
+      struct Wifi {
+        double loss;              //probability that a transmission is lost
+        uint64_t jitterNs;        //extra air time, uniform in [0, jitterNs)
+        uint64_t retransmitNs;    //a lost TCP segment is sent again after this
+      };
+
+      static const uint8_t MAX_CONNECTIONS = 5;
+
+      EspModule();
+
+      Timing timing;
+      Wifi wifi;
+      int rxPin, txPin;   //device pins the module is wired to
+      long baud;          //module UART rate, changed with AT+UART_CUR
+
+      /* UartDevice */
+      void connect(UartPort *port);
+      void receive(uint8_t b, long baud);
+
+      /* client side */
+      bool clientConnect(uint8_t mux);
+      void clientSend(uint8_t mux, const uint8_t *data, size_t len);
+      void clientClose(uint8_t mux);
+      bool clientConnected(uint8_t mux) const;
+      /* the client on mux accepts a connection from the module on port, at 192.168.1.(10 + mux) */
+      void clientListen(uint8_t mux, uint16_t port);
+      bool passthrough() const { return _passthrough; }
+      /* one datagram to the module's UDP link on port, false if there is none; it may be lost on the air */
+      bool clientSendDatagram(uint16_t port, const uint8_t *data, size_t len);
+
+      /* everything the device sent to its clients (time = delivered over WiFi) */
+      const std::vector<Packet> &sent() const { return _sent; }
+      void clearSent() { _sent.clear(); }
+      std::function<void(const Packet &)> onSend;
+
+      uint64_t bytesToDevice() const { return _bytesOut; }
+      uint64_t bytesFromDevice() const { return _bytesIn; }
+
+    private:
+      void emit(const std::string &s, uint64_t delayNs = 0);
+      void commit(const std::string &s);
+      void handleLine(const std::string &line);
+      void ok(const std::string &info = "");
+      void error();
+      void deliver(uint8_t mux, const std::vector<uint8_t> &data, uint64_t delayNs);
+      uint64_t airTime(uint8_t mux, bool toModule, bool &lost);
+      double uniform();
+      void passthroughIn(uint8_t b);
+      bool anyConnected() const;
+
+      UartPort *_port;
+      uint64_t _txFree;
+      std::string _line;
+      bool _sendMode;
+      uint8_t _sendMux;
+      size_t _sendRemaining;
+      std::vector<uint8_t> _sendData;
+      bool _connected[MAX_CONNECTIONS];
+      int _mux;
+      bool _server;
+      int _mode;
+      bool _echo;                 //ATE1 (default) / ATE0
+      bool _cipmode;              //AT+CIPMODE=1
+      bool _passthrough;          //after AT+CIPSEND in CIPMODE 1
+      uint8_t _single;            //client of the connection in single connection mode
+      uint64_t _passthroughStart;
+      std::vector<uint8_t> _passthroughData;
+      bool _flushPending;
+      int _listenPort[MAX_CONNECTIONS];
+      int _udpPort[MAX_CONNECTIONS];      //local port of a UDP link, -1 = TCP
+      uint64_t _arrival[2][MAX_CONNECTIONS];   //of the last TCP segment, from and to the module, for the order
+      uint32_t _random;                   //own generator (xorshift), the bench's rand() sequence stays as it is
+      std::vector<Packet> _sent;
+      uint64_t _bytesIn, _bytesOut;
+  };
+
+  EspModule &esp();
+}
+
+#endif
@@ -0,0 +1,218 @@
+/*
+  Sim.cpp - Virtual clock, interrupt dispatch and cycle-cost model behind the host-side stand-ins.
+*/
+
+#include "Sim.h"
+
+#include <algorithm>
+#include <map>
+#include <queue>
+
+namespace sim {
+
+  CostModel costs = {
+    3750,   //digitalReadNs
+    4000,   //digitalWriteNs
+    3500,   //timeReadNs
+    20000,  //toneNs
+    1000,   //loopOverheadNs
+    6000,   //stringOpNs
+    1500,   //streamOpNs
+    2500,   //serialWriteNs
+    30000,  //i2cTransactionNs
+  };
+
+  namespace {
+    struct Event {
+      uint64_t t;
+      uint64_t seq;
+      std::function<void()> fn;
+    };
+    struct EventLater {
+      bool operator()(const Event &a, const Event &b) const {
+        return a.t != b.t ? a.t > b.t : a.seq > b.seq;
+      }
+    };
+
+    const uint32_t ISR_OVERHEAD_NS = 2500;   //vector, register save/restore, reti
+
+    uint64_t g_now = 0;
+    uint64_t g_seq = 0;
+    bool g_irqEnabled = true;
+    bool g_echo = false;
+
+    /* function-local so that stand-ins constructed as the sketch's globals can use them */
+    std::priority_queue<Event, std::vector<Event>, EventLater> &events() {
+      static std::priority_queue<Event, std::vector<Event>, EventLater> queue;
+      return queue;
+    }
+    std::vector<Irq*> &irqs() {
+      static std::vector<Irq*> vectors;
+      return vectors;
+    }
+    std::map<int, int> &pins() {
+      static std::map<int, int> levels;
+      return levels;
+    }
+    std::map<int, std::function<void(int)>> &pinWatchers() {
+      static std::map<int, std::function<void(int)>> watchers;
+      return watchers;
+    }
+    std::vector<MotorEvent> &motorLog() {
+      static std::vector<MotorEvent> log;
+      return log;
+    }
+  }
+
+  /* the CPU takes one pending interrupt: clears 'I', runs the vector, reti sets 'I' again */
+  static bool dispatchOne() {
+    Irq *irq = NULL;
+    for (size_t i = 0; i < irqs().size(); i++) {
+      if (irqs()[i]->pending() && (irq == NULL || irqs()[i]->priority() < irq->priority())) {
+        irq = irqs()[i];
+      }
+    }
+    if (irq == NULL) {
+      return false;
+    }
+    irq->clear();
+    g_irqEnabled = false;
+    spend(ISR_OVERHEAD_NS);
+    irq->service();
+    g_irqEnabled = true;
+    return true;
+  }
+
+  static void runUntil(uint64_t target, bool stretch) {
+    for (;;) {
+      if (g_irqEnabled) {
+        uint64_t before = g_now;
+        if (dispatchOne()) {
+          if (stretch) {
+            target += g_now - before;
+          }
+          continue;
+        }
+      }
+      if (!events().empty() && events().top().t <= target) {
+        Event e = events().top();
+        events().pop();
+        if (e.t > g_now) {
+          g_now = e.t;
+        }
+        e.fn();
+        continue;
+      }
+      if (g_now < target) {
+        g_now = target;
+      }
+      return;
+    }
+  }
+
+  uint64_t now() {
+    return g_now;
+  }
+
+  void spend(uint64_t ns) {
+    runUntil(g_now + ns, true);
+  }
+
+  void waitUntil(uint64_t t) {
+    runUntil(t, false);
+  }
+
+  void schedule(uint64_t t, std::function<void()> fn) {
+    Event e;
+    e.t = t;
+    e.seq = g_seq++;
+    e.fn = fn;
+    events().push(e);
+  }
+
+  Irq::Irq(int priority, std::function<void()> handler) : _priority(priority), _pending(false), _handler(handler) {
+    irqs().push_back(this);
+  }
+
+  Irq::~Irq() {
+    irqs().erase(std::remove(irqs().begin(), irqs().end(), this), irqs().end());
+  }
+
+  void Irq::raise() {
+    _pending = true;
+  }
+
+  int Irq::priority() const {
+    return _priority;
+  }
+
+  void Irq::service() {
+    _handler();
+  }
+
+  void Irq::clear() {
+    _pending = false;
+  }
+
+  bool Irq::pending() const {
+    return _pending;
+  }
+
+  bool interruptsEnabled() {
+    return g_irqEnabled;
+  }
+
+  void setInterruptsEnabled(bool on) {
+    g_irqEnabled = on;
+    if (on) {
+      dispatchPending();
+    }
+  }
+
+  void dispatchPending() {
+    while (g_irqEnabled && dispatchOne()) {
+    }
+  }
+
+  void setPin(int pin, int level) {
+    int before = pinLevel(pin);
+    pins()[pin] = level;
+    std::map<int, std::function<void(int)>>::const_iterator it = pinWatchers().find(pin);
+    if (level != before && it != pinWatchers().end() && it->second) {
+      it->second(level);
+    }
+  }
+
+  void watchPin(int pin, std::function<void(int level)> onChange) {
+    pinWatchers()[pin] = onChange;
+  }
+
+  int pinLevel(int pin) {
+    std::map<int, int>::const_iterator it = pins().find(pin);
+    return it == pins().end() ? 0 : it->second;
+  }
+
+  void recordMotorEvent(uint8_t port, int8_t dir) {
+    MotorEvent e;
+    e.time = g_now;
+    e.port = port;
+    e.dir = dir;
+    motorLog().push_back(e);
+  }
+
+  const std::vector<MotorEvent>& motorEvents() {
+    return motorLog();
+  }
+
+  void clearMotorEvents() {
+    motorLog().clear();
+  }
+
+  void setEcho(bool on) {
+    g_echo = on;
+  }
+
+  bool echo() {
+    return g_echo;
+  }
+}
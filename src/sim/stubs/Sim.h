@@ -0,0 +1,115 @@
+/*
+  Sim.h - Virtual clock, interrupt dispatch and cycle-cost model behind the host-side stand-ins.
+
+  All stand-ins (Arduino core, Wire, Adafruit Motor Shield, SoftwareSerial, ESP8266 module) charge
+  their CPU cost to one virtual clock. Peripherals schedule events on that clock and raise
+  interrupts, which the CPU services in between the firmware's own work, like on the AVR.
+*/
+
+#ifndef Sim_h
+#define Sim_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <vector>
+
+namespace sim {
+
+  /* CPU time charged by the stand-ins, in nanoseconds (ATmega328P @ 16 MHz) */
+  struct CostModel {
+    uint32_t digitalReadNs;
+    uint32_t digitalWriteNs;
+    uint32_t timeReadNs;        //millis() / micros()
+    uint32_t toneNs;
+    uint32_t loopOverheadNs;    //Arduino main() around loop()
+    uint32_t stringOpNs;        //String append / indexOf
+    uint32_t streamOpNs;        //available() / read() on a serial port
+    uint32_t serialWriteNs;     //HardwareSerial::write() without blocking
+    uint32_t i2cTransactionNs;  //start + stop + Wire library overhead
+  };
+  extern CostModel costs;
+
+  const uint64_t NEVER = UINT64_MAX;
+
+  /* virtual time in nanoseconds since power-on */
+  uint64_t now();
+
+  /* CPU is busy for ns; interrupts serviced meanwhile stretch the work */
+  void spend(uint64_t ns);
+  /* CPU idles (e.g. in delay()) until virtual time t; interrupts are still serviced */
+  void waitUntil(uint64_t t);
+
+  /* peripheral events: run at time t without consuming CPU time */
+  void schedule(uint64_t t, std::function<void()> fn);
+
+  /* an interrupt vector; lower priority value = serviced first (AVR vector order) */
+  class Irq {
+    public:
+      Irq(int priority, std::function<void()> handler);
+      ~Irq();
+      void raise();
+      void clear();
+      bool pending() const;
+      int priority() const;
+      void service();
+    private:
+      int _priority;
+      bool _pending;
+      std::function<void()> _handler;
+  };
+
+  bool interruptsEnabled();
+  void setInterruptsEnabled(bool on);
+  /* services pending interrupts if enabled (called when 'I' gets set again) */
+  void dispatchPending();
+
+  /* a peripheral I/O register: reads and writes go through the peripheral's model */
+  template <typename T>
+  class Register {
+    public:
+      /* constexpr: the sketch's globals may touch registers during static initialisation */
+      constexpr Register(void (*onWrite)(T before) = NULL, T (*onRead)() = NULL)
+        : _value(0), _onWrite(onWrite), _onRead(onRead) {}
+      operator T() const { return _onRead != NULL ? _onRead() : _value; }
+      Register &operator=(T value) {
+        T before = _value;
+        _value = value;
+        if (_onWrite != NULL) {
+          _onWrite(before);
+        }
+        return *this;
+      }
+      Register &operator|=(T bits) { return *this = (T)(*this | bits); }
+      Register &operator&=(T bits) { return *this = (T)(*this & bits); }
+      /* the stored value, bypassing the peripheral */
+      T raw() const { return _value; }
+      void setRaw(T value) { _value = value; }
+    private:
+      T _value;
+      void (*_onWrite)(T before);
+      T (*_onRead)();
+  };
+
+  /* digital pins as seen by digitalRead() */
+  void setPin(int pin, int level);
+  int pinLevel(int pin);
+  /* onChange runs whenever setPin() changes the level of pin (external interrupts), NULL to stop */
+  void watchPin(int pin, std::function<void(int level)> onChange);
+
+  /* one logical step of a stepper as seen on the motor shield */
+  struct MotorEvent {
+    uint64_t time;
+    uint8_t port;
+    int8_t dir;
+  };
+  void recordMotorEvent(uint8_t port, int8_t dir);
+  const std::vector<MotorEvent>& motorEvents();
+  void clearMotorEvents();
+
+  /* echo the firmware's Serial (USB) output to stdout */
+  void setEcho(bool on);
+  bool echo();
+}
+
+#endif
@@ -0,0 +1,39 @@
+/*
+  SimUart.h - A serial line between a device-side port (SoftwareSerial, HardwareSerial) and a
+  simulated peripheral (the ESP8266 module).
+*/
+
+#ifndef SimUart_h
+#define SimUart_h
+
+#include <stdint.h>
+
+namespace sim {
+
+  /* device-side end of the line */
+  class UartPort {
+    public:
+      virtual ~UartPort() {}
+      /* a byte whose start bit begins at 'startBit'; 'garbled' if sent at a different baud rate */
+      virtual void lineIn(uint8_t b, uint64_t startBit, bool garbled) = 0;
+      virtual long baud() const = 0;
+  };
+
+  /* peripheral-side end of the line */
+  class UartDevice {
+    public:
+      virtual ~UartDevice() {}
+      virtual void connect(UartPort *port) = 0;
+      /* a complete byte written by the device at 'baud' */
+      virtual void receive(uint8_t b, long baud) = 0;
+  };
+
+  /* the peripheral wired to the given device pins, or NULL */
+  UartDevice *uartDevice(int rxPin, int txPin);
+
+  inline uint64_t uartByteNs(long baud) {
+    return 10ULL * 1000000000ULL / (uint64_t)baud;
+  }
+}
+
+#endif
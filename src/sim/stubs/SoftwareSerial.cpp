@@ -0,0 +1,104 @@
+/*
+  SoftwareSerial.cpp - Host-side stand-in for the AVR SoftwareSerial library.
+*/
+
+#include "SoftwareSerial.h"
+
+#define PCINT2_VECTOR 6   //pins 0..7
+
+SoftwareSerial::SoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic)
+  : _receivePin(receivePin), _transmitPin(transmitPin), _baud(9600), _head(0), _tail(0), _overflow(false), _corrupted(0),
+    _pcint(PCINT2_VECTOR, [this]() { recv(); }), _device(NULL) {
+  (void)inverse_logic;
+}
+
+SoftwareSerial::~SoftwareSerial() {
+}
+
+void SoftwareSerial::begin(long speed) {
+  _baud = speed;
+  _device = sim::uartDevice(_receivePin, _transmitPin);
+  if (_device != NULL) {
+    _device->connect(this);
+  }
+}
+
+bool SoftwareSerial::overflow() {
+  bool ret = _overflow;
+  _overflow = false;
+  return ret;
+}
+
+int SoftwareSerial::available() {
+  sim::spend(sim::costs.streamOpNs);
+  return (_tail + _SS_MAX_RX_BUFF - _head) % _SS_MAX_RX_BUFF;
+}
+
+int SoftwareSerial::read() {
+  sim::spend(sim::costs.streamOpNs);
+  if (_head == _tail) {
+    return -1;
+  }
+  uint8_t d = _buffer[_head];
+  _head = (_head + 1) % _SS_MAX_RX_BUFF;
+  return d;
+}
+
+int SoftwareSerial::peek() {
+  sim::spend(sim::costs.streamOpNs);
+  if (_head == _tail) {
+    return -1;
+  }
+  return _buffer[_head];
+}
+
+/* bit-banged with interrupts disabled for the whole frame, as in the original */
+size_t SoftwareSerial::write(uint8_t b) {
+  bool interruptsWereOn = sim::interruptsEnabled();
+  sim::setInterruptsEnabled(false);
+  sim::spend(sim::uartByteNs(_baud));
+  if (_device != NULL) {
+    _device->receive(b, _baud);
+  }
+  sim::setInterruptsEnabled(interruptsWereOn);
+  return 1;
+}
+
+void SoftwareSerial::lineIn(uint8_t b, uint64_t startBit, bool garbled) {
+  Incoming in;
+  in.b = b;
+  in.startBit = startBit;
+  in.garbled = garbled;
+  _incoming.push_back(in);
+  sim::schedule(startBit, [this]() { _pcint.raise(); });
+}
+
+/* pin-change ISR: samples the frame bit by bit until the stop bit */
+void SoftwareSerial::recv() {
+  const uint64_t bitNs = sim::uartByteNs(_baud) / 10;
+  while (!_incoming.empty() && _incoming.front().startBit + 10 * bitNs < sim::now()) {
+    _incoming.pop_front();    //the whole frame passed while interrupts were off
+    _corrupted++;
+  }
+  if (_incoming.empty() || _incoming.front().startBit > sim::now()) {
+    return;
+  }
+  Incoming in = _incoming.front();
+  _incoming.pop_front();
+
+  uint8_t d = in.b;
+  if (in.garbled || sim::now() > in.startBit + bitNs / 2) {
+    d = (in.b >> 1) | 0x80;   //sampled out of phase
+    _corrupted++;
+  }
+  uint64_t stopBit = sim::now() + bitNs * 19 / 2;
+  sim::spend(stopBit - sim::now());
+
+  uint8_t next = (_tail + 1) % _SS_MAX_RX_BUFF;
+  if (next != _head) {
+    _buffer[_tail] = d;
+    _tail = next;
+  } else {
+    _overflow = true;
+  }
+}
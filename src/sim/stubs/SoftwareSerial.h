@@ -0,0 +1,64 @@
+/*
+  SoftwareSerial.h - Host-side stand-in for the AVR SoftwareSerial library.
+
+  Like the original, writes bit-bang each byte with interrupts disabled, and every received
+  byte occupies the pin-change ISR for the whole frame. A byte whose start bit is serviced
+  late (because interrupts were off) is sampled out of phase and arrives corrupted.
+*/
+
+#ifndef SoftwareSerial_h
+#define SoftwareSerial_h
+
+#include "Arduino.h"
+#include "Sim.h"
+#include "SimUart.h"
+
+#include <deque>
+
+#define _SS_MAX_RX_BUFF 64
+
+class SoftwareSerial : public Stream, public sim::UartPort {
+  public:
+    SoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic = false);
+    ~SoftwareSerial();
+    void begin(long speed);
+    bool listen() { return true; }
+    void end() {}
+    bool isListening() { return true; }
+    bool overflow();
+
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t byte);
+    using Print::write;
+    void flush() {}
+    operator bool() { return true; }
+
+    /* sim::UartPort */
+    void lineIn(uint8_t b, uint64_t startBit, bool garbled);
+    long baud() const { return _baud; }
+
+    uint32_t corruptedBytes() const { return _corrupted; }
+
+  private:
+    struct Incoming {
+      uint8_t b;
+      uint64_t startBit;
+      bool garbled;
+    };
+
+    void recv();
+
+    uint8_t _receivePin, _transmitPin;
+    long _baud;
+    uint8_t _buffer[_SS_MAX_RX_BUFF];
+    volatile uint8_t _head, _tail;
+    bool _overflow;
+    uint32_t _corrupted;
+    std::deque<Incoming> _incoming;
+    sim::Irq _pcint;
+    sim::UartDevice *_device;
+};
+
+#endif
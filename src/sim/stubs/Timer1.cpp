@@ -0,0 +1,164 @@
+/*
+  Timer1.cpp - Timer/Counter1 of the ATmega328P on the simulation clock.
+
+  Models the counter in normal mode and in CTC mode with OCR1A as TOP, the compare match A
+  interrupt (TIMER1_COMPA_vect) and the prescaler selected in TCCR1B.
+*/
+
+#include "Arduino.h"
+#include "Sim.h"
+
+#define TIMER1_COMPA_VECTOR 11
+
+extern "C" void __vector_11(void) __attribute__((weak));
+
+namespace {
+  void onControlWrite(uint8_t before);
+  void onCounterWrite(uint16_t before);
+  uint16_t onCounterRead();
+  void onCompareWrite(uint16_t before);
+  void onMaskWrite(uint8_t before);
+  void onFlagWrite(uint8_t before);
+}
+
+sim::Register<uint8_t> TCCR1A;
+sim::Register<uint8_t> TCCR1B(onControlWrite);
+sim::Register<uint16_t> TCNT1(onCounterWrite, onCounterRead);
+sim::Register<uint16_t> OCR1A(onCompareWrite);
+sim::Register<uint8_t> TIMSK1(onMaskWrite);
+sim::Register<uint8_t> TIFR1(onFlagWrite);
+
+namespace {
+  uint64_t g_zeroAt = 0;      //virtual time at which the running counter was (or will be) 0
+  uint16_t g_stoppedAt = 0;   //counter value while no clock is selected
+  uint16_t g_heldTop = 0;     //TOP the counter holds for the tick after a compare match in CTC mode
+  uint64_t g_generation = 0;  //invalidates compare events scheduled for an older setting
+
+  sim::Irq &compareA() {
+    static sim::Irq irq(TIMER1_COMPA_VECTOR, []() {
+      TIFR1.setRaw(TIFR1.raw() & ~_BV(OCF1A));   //cleared by hardware when the vector is taken
+      if (__vector_11 != NULL) {
+        __vector_11();
+      }
+    });
+    return irq;
+  }
+
+  uint16_t prescaler() {
+    static const uint16_t DIVIDERS[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    return DIVIDERS[TCCR1B.raw() & (_BV(CS12) | _BV(CS11) | _BV(CS10))];
+  }
+
+  bool ctc() {
+    return (TCCR1B.raw() & (_BV(WGM13) | _BV(WGM12))) == _BV(WGM12);
+  }
+
+  /* one counter increment, in picoseconds to keep the undivided clock exact */
+  uint64_t tickPs() {
+    return prescaler() * (1000000000000ULL / F_CPU);
+  }
+
+  uint32_t top() {
+    return ctc() ? OCR1A.raw() : 0xFFFF;
+  }
+
+  uint16_t counter() {
+    if (prescaler() == 0) {
+      return g_stoppedAt;
+    }
+    if (sim::now() < g_zeroAt) {
+      return g_heldTop;         //still on TOP for the tick after a compare match, even if OCR1A changed since
+    }
+    uint64_t ticks = (sim::now() - g_zeroAt) * 1000ULL / tickPs();
+    return (uint16_t)(ticks % (top() + 1));
+  }
+
+  void setFlag() {
+    TIFR1.setRaw(TIFR1.raw() | _BV(OCF1A));
+    if (TIMSK1.raw() & _BV(OCIE1A)) {
+      compareA().raise();
+    }
+  }
+
+  /* schedules the next compare match A from the current counter value, on the grid of the counter's ticks */
+  void reschedule() {
+    uint64_t generation = ++g_generation;
+    if (prescaler() == 0) {
+      return;
+    }
+    uint64_t at;
+    uint32_t compare = OCR1A.raw();
+    if (sim::now() < g_zeroAt) {    //on TOP until the counter is cleared at g_zeroAt
+      at = g_zeroAt + compare * tickPs() / 1000ULL;
+    } else {
+      uint64_t elapsed = (sim::now() - g_zeroAt) * 1000ULL / tickPs();
+      uint32_t count = (uint32_t)(elapsed % (top() + 1));
+      /* in CTC mode a TOP below the counter lets it run to 0xFFFF and wrap first */
+      uint32_t ticks = compare >= count ? compare - count : 0x10000 - count + compare;
+      if (ticks == 0) {
+        ticks = top() + 1;
+      }
+      at = g_zeroAt + (elapsed + ticks) * tickPs() / 1000ULL;
+    }
+    sim::schedule(at, [generation]() {
+      if (generation != g_generation) {
+        return;
+      }
+      if (ctc()) {
+        g_heldTop = OCR1A.raw();
+        g_zeroAt = sim::now() + tickPs() / 1000ULL;   //cleared on the next tick, independent of a new TOP
+      }
+      setFlag();
+      reschedule();
+    });
+  }
+
+  void onControlWrite(uint8_t before) {
+    uint8_t clockBits = _BV(CS12) | _BV(CS11) | _BV(CS10);
+    bool wasRunning = (before & clockBits) != 0;
+    if (wasRunning && prescaler() == 0) {
+      uint8_t after = TCCR1B.raw();
+      TCCR1B.setRaw(before);
+      g_stoppedAt = counter();
+      TCCR1B.setRaw(after);
+    } else if (!wasRunning && prescaler() != 0) {
+      g_zeroAt = sim::now() - g_stoppedAt * tickPs() / 1000ULL;
+    }
+    reschedule();
+  }
+
+  void onCounterWrite(uint16_t before) {
+    (void)before;
+    g_stoppedAt = TCNT1.raw();
+    if (prescaler() != 0) {
+      g_zeroAt = sim::now() - TCNT1.raw() * tickPs() / 1000ULL;
+    }
+    reschedule();
+  }
+
+  uint16_t onCounterRead() {
+    return counter();
+  }
+
+  void onCompareWrite(uint16_t before) {
+    (void)before;
+    reschedule();
+  }
+
+  void onMaskWrite(uint8_t before) {
+    (void)before;
+    if (!(TIMSK1.raw() & _BV(OCIE1A))) {
+      compareA().clear();
+    } else if (TIFR1.raw() & _BV(OCF1A)) {
+      compareA().raise();
+    }
+  }
+
+  /* flags are cleared by writing a logical one to them */
+  void onFlagWrite(uint8_t before) {
+    TIFR1.setRaw(before & ~TIFR1.raw());
+    if (!(TIFR1.raw() & _BV(OCF1A))) {
+      compareA().clear();
+    }
+  }
+}
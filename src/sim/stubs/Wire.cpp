@@ -0,0 +1,199 @@
+/*
+  Wire.cpp - Host-side stand-in for the AVR TWI (I2C) library.
+*/
+
+#include "Wire.h"
+#include "Sim.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PCA9685_ADDRESS 0x60
+#define PCA9685_MODE1 0x00
+#define PCA9685_MODE1_AI 0x20
+#define PCA9685_LED0_ON_L 0x06
+#define MOTOR_PORTS 2
+
+namespace {
+  uint8_t g_pcaRegs[256];
+  uint8_t g_pcaPointer = 0;
+  uint32_t g_transactions = 0;
+
+  /* electrical angle of the coils of one motor port, unwrapped, and where the last step was counted */
+  struct Coils {
+    bool energized;
+    double raw, angle, lastStep;
+  };
+  Coils g_coils[MOTOR_PORTS];
+
+  uint16_t duty(uint8_t channel) {
+    if (sim::pca9685Off(channel) & 0x1000) {
+      return 0;
+    }
+    return (sim::pca9685On(channel) & 0x1000) ? 4096 : sim::pca9685Off(channel);
+  }
+
+  int high(uint8_t channel) {
+    return duty(channel) > 2048 ? 1 : 0;
+  }
+
+  /* A logical step turns the coil field by 90 degrees in every stepping mode (one SINGLE or DOUBLE
+     onestep, two INTERLEAVE or 16 MICROSTEP ones), so a step is counted whenever the field has moved
+     a quarter turn from the last one. This does not depend on how the writes are split into transactions. */
+  void observeCoils() {
+    for (uint8_t p = 0; p < MOTOR_PORTS; p++) {
+      uint8_t port = p + 1;
+      uint8_t base = port == 1 ? 8 : 2;   //PWMA, AIN2, AIN1, BIN1, BIN2, PWMB
+      double a = duty(base) * (high(base + 1) - high(base + 2));
+      double b = duty(base + 5) * (high(base + 3) - high(base + 4));
+      if (a == 0 && b == 0) {
+        continue;
+      }
+      Coils &coils = g_coils[p];
+      double raw = atan2(b, a) * 180.0 / M_PI;
+      if (!coils.energized) {
+        coils.energized = true;
+        coils.raw = coils.angle = coils.lastStep = raw;
+        continue;
+      }
+      double delta = raw - coils.raw;
+      delta -= 360.0 * floor((delta + 180.0) / 360.0);
+      coils.raw = raw;
+      coils.angle += delta;
+      while (coils.angle >= coils.lastStep + 89.0) {
+        coils.lastStep += 90.0;
+        sim::recordMotorEvent(port, 1);
+      }
+      while (coils.angle <= coils.lastStep - 89.0) {
+        coils.lastStep -= 90.0;
+        sim::recordMotorEvent(port, -1);
+      }
+    }
+  }
+
+  void pcaWrite(const uint8_t *data, uint8_t length) {
+    if (length == 0) {
+      return;
+    }
+    g_pcaPointer = data[0];
+    for (uint8_t i = 1; i < length; i++) {
+      g_pcaRegs[g_pcaPointer] = data[i];
+      if (g_pcaRegs[PCA9685_MODE1] & PCA9685_MODE1_AI) {
+        g_pcaPointer++;
+      }
+    }
+  }
+}
+
+namespace sim {
+  uint64_t i2cTransactionNs(size_t bytes) {
+    uint32_t clock = F_CPU / (16 + 2 * (uint32_t)TWBR);
+    return costs.i2cTransactionNs + (1 + bytes) * 9ULL * 1000000000ULL / clock;
+  }
+
+  uint8_t pca9685Register(uint8_t reg) {
+    return g_pcaRegs[reg];
+  }
+
+  uint16_t pca9685On(uint8_t channel) {
+    uint8_t reg = PCA9685_LED0_ON_L + 4 * channel;
+    return g_pcaRegs[reg] | (g_pcaRegs[reg + 1] << 8);
+  }
+
+  uint16_t pca9685Off(uint8_t channel) {
+    uint8_t reg = PCA9685_LED0_ON_L + 4 * channel + 2;
+    return g_pcaRegs[reg] | (g_pcaRegs[reg + 1] << 8);
+  }
+
+  uint32_t i2cTransactions() {
+    return g_transactions;
+  }
+}
+
+/* the AVR TWI driver is interrupt driven and spins forever if 'I' is cleared */
+static void requireInterrupts() {
+  if (!sim::interruptsEnabled()) {
+    fprintf(stderr, "Wire: I2C transfer with interrupts disabled, this hangs the AVR\n");
+    abort();
+  }
+}
+
+TwoWire Wire;
+
+TwoWire::TwoWire() : _address(0), _txLength(0), _rxLength(0), _rxIndex(0), _transmitting(false) {}
+
+void TwoWire::begin() {
+  TWBR = ((F_CPU / 100000L) - 16) / 2;
+}
+
+void TwoWire::setClock(uint32_t clock) {
+  TWBR = ((F_CPU / clock) - 16) / 2;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  _address = address;
+  _txLength = 0;
+  _transmitting = true;
+}
+
+/* blocks until the bus transfer is done; interrupts keep being serviced meanwhile */
+uint8_t TwoWire::endTransmission(uint8_t sendStop) {
+  (void)sendStop;
+  requireInterrupts();
+  uint64_t done = sim::now() + sim::i2cTransactionNs(_txLength);
+  sim::spend(sim::costs.i2cTransactionNs);
+  sim::waitUntil(done);
+  g_transactions++;
+  if (_address == PCA9685_ADDRESS) {
+    pcaWrite(_txBuffer, _txLength);
+    observeCoils();
+  }
+  _transmitting = false;
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) {
+  if (quantity > BUFFER_LENGTH) {
+    quantity = BUFFER_LENGTH;
+  }
+  requireInterrupts();
+  uint64_t done = sim::now() + sim::i2cTransactionNs(quantity);
+  sim::spend(sim::costs.i2cTransactionNs);
+  sim::waitUntil(done);
+  g_transactions++;
+  for (uint8_t i = 0; i < quantity; i++) {
+    _rxBuffer[i] = address == PCA9685_ADDRESS ? g_pcaRegs[(uint8_t)(g_pcaPointer + i)] : 0;
+  }
+  _rxLength = quantity;
+  _rxIndex = 0;
+  return quantity;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  if (!_transmitting || _txLength >= BUFFER_LENGTH) {
+    return 0;
+  }
+  _txBuffer[_txLength++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity) {
+  size_t n = 0;
+  for (size_t i = 0; i < quantity; i++) {
+    n += write(data[i]);
+  }
+  return n;
+}
+
+int TwoWire::available() {
+  return _rxLength - _rxIndex;
+}
+
+int TwoWire::read() {
+  return _rxIndex < _rxLength ? _rxBuffer[_rxIndex++] : -1;
+}
+
+int TwoWire::peek() {
+  return _rxIndex < _rxLength ? _rxBuffer[_rxIndex] : -1;
+}
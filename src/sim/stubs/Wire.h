@@ -0,0 +1,53 @@
+/*
+  Wire.h - Host-side stand-in for the AVR TWI (I2C) library.
+
+  Transactions are charged at the bus clock derived from TWBR, and writes are delivered to
+  a register model of the PCA9685 PWM driver on the Adafruit Motor Shield. The steps of the
+  motors are read from the coil channels of that model (see sim::motorEvents()).
+*/
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+class TwoWire : public Stream {
+  public:
+    TwoWire();
+    void begin();
+    void setClock(uint32_t clock);
+    void beginTransmission(uint8_t address);
+    uint8_t endTransmission(uint8_t sendStop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t quantity);
+    using Print::write;
+    int available();
+    int read();
+    int peek();
+
+  private:
+    uint8_t _address;
+    uint8_t _txBuffer[BUFFER_LENGTH];
+    uint8_t _txLength;
+    uint8_t _rxBuffer[BUFFER_LENGTH];
+    uint8_t _rxLength, _rxIndex;
+    bool _transmitting;
+};
+
+extern TwoWire Wire;
+
+namespace sim {
+  /* bus time for one transaction carrying 'bytes' bytes after the address */
+  uint64_t i2cTransactionNs(size_t bytes);
+
+  /* register file of the PCA9685 at 0x60 (Adafruit Motor Shield default address) */
+  uint8_t pca9685Register(uint8_t reg);
+  uint16_t pca9685On(uint8_t channel);
+  uint16_t pca9685Off(uint8_t channel);
+  uint32_t i2cTransactions();
+}
+
+#endif
@@ -0,0 +1,15 @@
+/*
+  avr/eeprom.h - EEPROM status, backed by the EEPROM model in stubs/EEPROM.cpp.
+*/
+
+#ifndef Sim_avr_eeprom_h
+#define Sim_avr_eeprom_h
+
+namespace sim {
+  bool eepromReady();
+}
+
+/* false while the last byte written is still being programmed (EEPE set) */
+inline bool eeprom_is_ready() { return sim::eepromReady(); }
+
+#endif
@@ -0,0 +1,20 @@
+/*
+  avr/interrupt.h - Global interrupt enable and interrupt vectors, backed by the simulation.
+*/
+
+#ifndef Sim_avr_interrupt_h
+#define Sim_avr_interrupt_h
+
+#include "Sim.h"
+
+inline void cli() { sim::setInterruptsEnabled(false); }
+inline void sei() { sim::setInterruptsEnabled(true); }
+
+/* vector numbers as in iom328p.h; the peripheral models call the vectors they raise */
+#define TIMER1_COMPA_vect __vector_11
+
+/* ISR attributes are accepted but ignored: vectors always run with 'I' cleared (ISR_BLOCK) */
+#define ISR_BLOCK
+#define ISR(vector, ...) extern "C" void vector(void); extern "C" void vector(void)
+
+#endif
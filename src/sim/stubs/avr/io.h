@@ -0,0 +1,36 @@
+/*
+  avr/io.h - ATmega328P registers used by the firmware, backed by the simulation.
+*/
+
+#ifndef Sim_avr_io_h
+#define Sim_avr_io_h
+
+#include <stdint.h>
+#include "Sim.h"
+
+#define _BV(bit) (1 << (bit))
+
+/* TWI bit rate register; Wire derives the I2C clock from it */
+extern uint8_t TWBR;
+
+/* Timer/Counter1 (16 bit), modelled in stubs/Timer1.cpp: normal and CTC mode, compare match A */
+extern sim::Register<uint8_t> TCCR1A;
+extern sim::Register<uint8_t> TCCR1B;
+extern sim::Register<uint16_t> TCNT1;
+extern sim::Register<uint16_t> OCR1A;
+extern sim::Register<uint8_t> TIMSK1;
+extern sim::Register<uint8_t> TIFR1;
+
+#define WGM10 0
+#define WGM11 1
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+#define TOIE1 0
+#define OCIE1A 1
+#define TOV1 0
+#define OCF1A 1
+
+#endif
@@ -0,0 +1,62 @@
+/*
+  Adafruit_MS_PWMServoDriver.cpp - Host-side stand-in for the PCA9685 driver bundled with the
+  Adafruit Motor Shield v2 library.
+*/
+
+#include "Adafruit_MS_PWMServoDriver.h"
+#include <Wire.h>
+
+Adafruit_MS_PWMServoDriver::Adafruit_MS_PWMServoDriver(uint8_t addr) {
+  _i2caddr = addr;
+}
+
+void Adafruit_MS_PWMServoDriver::begin(void) {
+  Wire.begin();
+  reset();
+}
+
+void Adafruit_MS_PWMServoDriver::reset(void) {
+  write8(PCA9685_MODE1, 0x0);
+}
+
+void Adafruit_MS_PWMServoDriver::setPWMFreq(float freq) {
+  freq *= 0.9;  // correct for overshoot in the frequency setting
+  float prescaleval = 25000000;
+  prescaleval /= 4096;
+  prescaleval /= freq;
+  prescaleval -= 1;
+  uint8_t prescale = floor(prescaleval + 0.5);
+
+  uint8_t oldmode = read8(PCA9685_MODE1);
+  uint8_t newmode = (oldmode & 0x7F) | 0x10; // sleep
+  write8(PCA9685_MODE1, newmode);
+  write8(PCA9685_PRESCALE, prescale);
+  write8(PCA9685_MODE1, oldmode);
+  delay(5);
+  write8(PCA9685_MODE1, oldmode | 0xa1);  //  This sets the MODE1 register to turn on auto increment.
+}
+
+void Adafruit_MS_PWMServoDriver::setPWM(uint8_t num, uint16_t on, uint16_t off) {
+  Wire.beginTransmission(_i2caddr);
+  Wire.write(LED0_ON_L + 4 * num);
+  Wire.write(on);
+  Wire.write(on >> 8);
+  Wire.write(off);
+  Wire.write(off >> 8);
+  Wire.endTransmission();
+}
+
+uint8_t Adafruit_MS_PWMServoDriver::read8(uint8_t addr) {
+  Wire.beginTransmission(_i2caddr);
+  Wire.write(addr);
+  Wire.endTransmission();
+  Wire.requestFrom((uint8_t)_i2caddr, (uint8_t)1);
+  return Wire.read();
+}
+
+void Adafruit_MS_PWMServoDriver::write8(uint8_t addr, uint8_t d) {
+  Wire.beginTransmission(_i2caddr);
+  Wire.write(addr);
+  Wire.write(d);
+  Wire.endTransmission();
+}